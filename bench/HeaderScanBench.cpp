@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "HTTPRequest.hpp"
+
+// Times the scanning kernels of the response parser, the scalar ones
+// against SSE2 and AVX2, on the same block of typical response headers.
+// Every set is checked against the scalar one before it's timed
+
+namespace
+{
+namespace scan = http::scan;
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t HEADER_COPIES = 256;
+constexpr std::size_t ROUNDS = 200;
+constexpr std::size_t REPEATS = 10;
+
+const char *HEADER =
+    "HTTP/1.1 200 OK\r\n"
+    "Date: Sat, 17 Oct 2026 12:00:00 GMT\r\n"
+    "Server: Apache/2.4.58 (Unix) OpenSSL/3.0.13\r\n"
+    "Last-Modified: Fri, 16 Oct 2026 08:30:12 GMT\r\n"
+    "ETag: \"72e5d654c33a732ded35912485a4c3d1\"\r\n"
+    "Accept-Ranges: bytes\r\n"
+    "Content-Length: 50000000\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Disposition: attachment; filename=\"release-1.4.2.tar.gz\"\r\n"
+    "Cache-Control: public, max-age=31536000, immutable\r\n"
+    "Strict-Transport-Security: max-age=63072000; includeSubDomains\r\n"
+    "X-Content-Type-Options: nosniff\r\n"
+    "X-Request-Id: 4f1c2d9e-8b7a-4c3e-9d2f-1a0b3c4d5e6f\r\n"
+    "Vary: Accept-Encoding\r\n"
+    "Via: 1.1 varnish, 1.1 cache-fra-eddf8230095-FRA\r\n"
+    "Age: 3127\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+struct KernelSet
+{
+    const char *name;
+    scan::Kernels kernels;
+};
+
+struct Result
+{
+    // NOTE: Offsets found and case-folded bytes, compared between sets
+    uint64_t digest = 0;
+    double lineTime = 0;
+    double contentTime = 0;
+    double lowerTime = 0;
+};
+
+std::vector<KernelSet> GetKernelSets(void)
+{
+    std::vector<KernelSet> sets = {
+        {"scalar",
+         {scan::findByteScalar, scan::findFieldContentEndScalar,
+          scan::toLowerScalar}}};
+
+#ifdef HTTPREQUEST_X86_SIMD
+    sets.push_back({"sse2",
+                    {scan::findByteSse2, scan::findFieldContentEndSse2,
+                     scan::toLowerSse2}});
+    if (__builtin_cpu_supports("avx2"))
+    {
+        sets.push_back({"avx2",
+                        {scan::findByteAvx2, scan::findFieldContentEndAvx2,
+                         scan::toLowerAvx2}});
+    }
+#endif // HTTPREQUEST_X86_SIMD
+
+    return sets;
+}
+
+// NOTE: Nanoseconds per header of the fastest repeat, so the ones slowed
+// down by the scheduler don't count
+template <typename Function>
+double Time(Function function)
+{
+    double best = 0;
+    for (std::size_t repeat = 0; repeat < REPEATS; ++repeat)
+    {
+        const Clock::time_point start = Clock::now();
+        for (std::size_t round = 0; round < ROUNDS; ++round)
+        {
+            function();
+        }
+        const double elapsed =
+            std::chrono::duration<double, std::nano>(Clock::now() - start)
+                .count() /
+            static_cast<double>(ROUNDS * HEADER_COPIES);
+
+        if (repeat == 0 || elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+Result Run(const scan::Kernels &kernels, const std::string &block)
+{
+    const auto *begin = reinterpret_cast<const uint8_t *>(block.data());
+    const auto *end = begin + block.size();
+    Result result;
+
+    // NOTE: Parser looks for the CR of every line, then for the colon of
+    // a field and the end of its value
+    uint64_t lineDigest = 0;
+    result.lineTime = Time([&]() {
+        lineDigest = 0;
+        for (const uint8_t *line = begin; line != end;)
+        {
+            const uint8_t *lineEnd = kernels.findByte(line, end, '\r');
+            lineDigest += static_cast<uint64_t>(lineEnd - begin);
+            line = lineEnd == end ? end : lineEnd + 2;
+        }
+    });
+
+    uint64_t contentDigest = 0;
+    result.contentTime = Time([&]() {
+        contentDigest = 0;
+        for (const uint8_t *line = begin; line != end;)
+        {
+            const uint8_t *lineEnd = kernels.findByte(line, end, '\r');
+            const uint8_t *colon = kernels.findByte(line, lineEnd, ':');
+            if (colon != lineEnd)
+            {
+                const uint8_t *contentEnd =
+                    kernels.findFieldContentEnd(colon + 1, end);
+                contentDigest += static_cast<uint64_t>(contentEnd - begin);
+            }
+            line = lineEnd == end ? end : lineEnd + 2;
+        }
+    });
+
+    // NOTE: Field names are case-folded one at a time, as the parser does
+    std::vector<std::string> names;
+    for (const uint8_t *line = begin; line != end;)
+    {
+        const uint8_t *lineEnd = scan::findByteScalar(line, end, '\r');
+        const uint8_t *colon = scan::findByteScalar(line, lineEnd, ':');
+        if (colon != lineEnd)
+        {
+            names.emplace_back(reinterpret_cast<const char *>(line),
+                               reinterpret_cast<const char *>(colon));
+        }
+        line = lineEnd == end ? end : lineEnd + 2;
+    }
+
+    std::vector<std::string> lowered(names);
+    result.lowerTime = Time([&]() {
+        for (std::size_t i = 0; i < names.size(); ++i)
+        {
+            std::copy(names[i].begin(), names[i].end(), lowered[i].begin());
+            kernels.toLower(lowered[i].data(), lowered[i].size());
+        }
+    });
+
+    result.digest = lineDigest * 31 + contentDigest;
+    for (const std::string &name : lowered)
+    {
+        for (const char c : name)
+        {
+            result.digest = result.digest * 131 + static_cast<uint8_t>(c);
+        }
+    }
+
+    return result;
+}
+} // namespace
+
+int main(void)
+{
+    std::string block;
+    for (std::size_t i = 0; i < HEADER_COPIES; ++i)
+    {
+        block += HEADER;
+    }
+
+    std::printf("%zu headers of %zu bytes, best of %zu, ns per header\n",
+                HEADER_COPIES, std::char_traits<char>::length(HEADER),
+                REPEATS);
+    std::printf("%-8s %10s %10s %10s\n", "kernels", "lines", "content",
+                "lower");
+
+    uint64_t expectedDigest = 0;
+    for (const KernelSet &set : GetKernelSets())
+    {
+        const Result result = Run(set.kernels, block);
+        if (expectedDigest == 0)
+        {
+            expectedDigest = result.digest;
+        }
+        else if (result.digest != expectedDigest)
+        {
+            std::fprintf(stderr, "Error: %s kernels disagree with scalar\n",
+                         set.name);
+            return EXIT_FAILURE;
+        }
+
+        std::printf("%-8s %10.1f %10.1f %10.1f\n", set.name, result.lineTime,
+                    result.contentTime, result.lowerTime);
+    }
+
+    return EXIT_SUCCESS;
+}
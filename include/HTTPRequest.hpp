@@ -83,6 +83,11 @@ extern "C" char *_strdup(const char *strSource);
 #  include <unistd.h>
 #endif // defined(_WIN32) || defined(__CYGWIN__)
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#  define HTTPREQUEST_X86_SIMD
+#  include <immintrin.h>
+#endif // (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+
 namespace http
 {
     class RequestError final: public std::logic_error
@@ -208,6 +213,15 @@ namespace http
         std::vector<std::uint8_t> body;
     };
 
+    // Receives the decoded response body piece by piece, in the order it
+    // arrives from the server. When a sink is passed to Request::send the
+    // body is not collected into Response::body.
+    using BodySink = std::function<void(const std::uint8_t* data, std::size_t size)>;
+
+    // Receives the status and the header fields of the final response before
+    // any of its body is passed to the body sink, may throw to reject it
+    using HeaderHandler = std::function<void(const Response& response)>;
+
     inline namespace detail
     {
 #if defined(_WIN32) || defined(__CYGWIN__)
@@ -446,6 +460,75 @@ namespace http
                 return static_cast<std::size_t>(result);
             }
 
+            Type getHandle() const noexcept
+            {
+                return endpoint;
+            }
+
+            // Non-blocking counterparts of connect, send and recv for callers
+            // that do their own readiness polling (e.g. with epoll)
+            static constexpr std::size_t wouldBlock = static_cast<std::size_t>(-1);
+
+            // Returns false if the connection is still in progress
+            bool startConnect(const struct sockaddr* address, const socklen_t addressSize)
+            {
+                auto result = ::connect(endpoint, address, addressSize);
+                while (result == -1 && getLastError() == interrupted)
+                    result = ::connect(endpoint, address, addressSize);
+
+                if (result == -1)
+                {
+                    if (getLastError() == inProgress) return false;
+                    throw std::system_error{getLastError(), std::system_category(), "Failed to connect"};
+                }
+
+                return true;
+            }
+
+            int getSocketError() const
+            {
+                int socketError = 0;
+                socklen_t optionLength = sizeof(socketError);
+                if (getsockopt(endpoint, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&socketError), &optionLength) == -1)
+                    throw std::system_error{getLastError(), std::system_category(), "Failed to get socket option"};
+
+                return socketError;
+            }
+
+            std::size_t trySend(const void* buffer, const std::size_t length)
+            {
+#if defined(_WIN32) || defined(__CYGWIN__)
+                auto result = ::send(endpoint, reinterpret_cast<const char*>(buffer), static_cast<int>(length), 0);
+#else
+                auto result = ::send(endpoint, reinterpret_cast<const char*>(buffer), length, noSignal);
+#endif // defined(_WIN32) || defined(__CYGWIN__)
+                if (result == -1)
+                {
+                    const auto error = getLastError();
+                    if (error == interrupted || error == tryAgain) return wouldBlock;
+                    throw std::system_error{error, std::system_category(), "Failed to send data"};
+                }
+
+                return static_cast<std::size_t>(result);
+            }
+
+            std::size_t tryRecv(void* buffer, const std::size_t length)
+            {
+#if defined(_WIN32) || defined(__CYGWIN__)
+                auto result = ::recv(endpoint, reinterpret_cast<char*>(buffer), static_cast<int>(length), 0);
+#else
+                auto result = ::recv(endpoint, reinterpret_cast<char*>(buffer), length, noSignal);
+#endif // defined(_WIN32) || defined(__CYGWIN__)
+                if (result == -1)
+                {
+                    const auto error = getLastError();
+                    if (error == interrupted || error == tryAgain) return wouldBlock;
+                    throw std::system_error{error, std::system_category(), "Failed to read data"};
+                }
+
+                return static_cast<std::size_t>(result);
+            }
+
         private:
             enum class SelectType
             {
@@ -521,6 +604,16 @@ namespace http
             static constexpr int noSignal = 0;
 #endif // defined(__unix__) && !defined(__APPLE__)
 
+#if defined(_WIN32) || defined(__CYGWIN__)
+            static constexpr int interrupted = WSAEINTR;
+            static constexpr int inProgress = WSAEWOULDBLOCK;
+            static constexpr int tryAgain = WSAEWOULDBLOCK;
+#else
+            static constexpr int interrupted = EINTR;
+            static constexpr int inProgress = EINPROGRESS;
+            static constexpr int tryAgain = EAGAIN;
+#endif // defined(_WIN32) || defined(__CYGWIN__)
+
             Type endpoint = invalid;
         };
 
@@ -585,6 +678,203 @@ namespace http
                 static_cast<unsigned char>(c) <= 0xFF;
         }
 
+        // Scanning kernels for the response parser, picked once at run time
+        // by the features of the CPU with a scalar fallback for the rest
+        namespace scan
+        {
+            // RFC 7230, 3.2. Header Fields, field-content is made of
+            // white spaces, visible and obsolete text characters
+            constexpr bool isFieldContentChar(const std::uint8_t c) noexcept
+            {
+                return c == 0x09 || (c >= 0x20 && c != 0x7F);
+            }
+
+            inline const std::uint8_t* findByteScalar(const std::uint8_t* begin, const std::uint8_t* end, const std::uint8_t value) noexcept
+            {
+                const auto result = static_cast<const std::uint8_t*>(std::memchr(begin, value, static_cast<std::size_t>(end - begin)));
+                return result ? result : end;
+            }
+
+            inline const std::uint8_t* findFieldContentEndScalar(const std::uint8_t* begin, const std::uint8_t* end) noexcept
+            {
+                for (; begin != end && isFieldContentChar(*begin); ++begin);
+                return begin;
+            }
+
+            inline void toLowerScalar(char* data, const std::size_t size) noexcept
+            {
+                for (std::size_t i = 0; i < size; ++i)
+                    if (data[i] >= 'A' && data[i] <= 'Z')
+                        data[i] = static_cast<char>(data[i] + ('a' - 'A'));
+            }
+
+#ifdef HTTPREQUEST_X86_SIMD
+            // 16 bytes at a time, SSE2 is a part of every x86-64 CPU
+            inline const std::uint8_t* findByteSse2(const std::uint8_t* begin, const std::uint8_t* end, const std::uint8_t value) noexcept
+            {
+                const auto needle = _mm_set1_epi8(static_cast<char>(value));
+                for (; end - begin >= 16; begin += 16)
+                {
+                    const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+                    const auto mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+                    if (mask != 0) return begin + __builtin_ctz(static_cast<unsigned>(mask));
+                }
+
+                return findByteScalar(begin, end, value);
+            }
+
+            inline const std::uint8_t* findFieldContentEndSse2(const std::uint8_t* begin, const std::uint8_t* end) noexcept
+            {
+                const auto lastControl = _mm_set1_epi8(0x1F);
+                const auto tab = _mm_set1_epi8(0x09);
+                const auto del = _mm_set1_epi8(0x7F);
+                for (; end - begin >= 16; begin += 16)
+                {
+                    const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+                    // unsigned c <= 0x1F is min(c, 0x1F) == c
+                    const auto control = _mm_andnot_si128(_mm_cmpeq_epi8(block, tab),
+                                                          _mm_cmpeq_epi8(_mm_min_epu8(block, lastControl), block));
+                    const auto mask = _mm_movemask_epi8(_mm_or_si128(control, _mm_cmpeq_epi8(block, del)));
+                    if (mask != 0) return begin + __builtin_ctz(static_cast<unsigned>(mask));
+                }
+
+                return findFieldContentEndScalar(begin, end);
+            }
+
+            inline void toLowerSse2(char* data, const std::size_t size) noexcept
+            {
+                // 'A' - 'Z' are moved to the bottom of the signed range, so
+                // one signed comparison finds them
+                const auto shift = _mm_set1_epi8(static_cast<char>(0x80 - 'A'));
+                const auto limit = _mm_set1_epi8(static_cast<char>(0x80 + 26));
+                const auto difference = _mm_set1_epi8('a' - 'A');
+
+                std::size_t i = 0;
+                for (; size - i >= 16; i += 16)
+                {
+                    const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                    const auto upper = _mm_cmplt_epi8(_mm_add_epi8(block, shift), limit);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i),
+                                     _mm_add_epi8(block, _mm_and_si128(upper, difference)));
+                }
+
+                toLowerScalar(data + i, size - i);
+            }
+
+            // 32 bytes at a time on CPUs which have AVX2
+            __attribute__((target("avx2")))
+            inline const std::uint8_t* findByteAvx2(const std::uint8_t* begin, const std::uint8_t* end, const std::uint8_t value) noexcept
+            {
+                const auto needle = _mm256_set1_epi8(static_cast<char>(value));
+                for (; end - begin >= 32; begin += 32)
+                {
+                    const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+                    const auto mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+                    if (mask != 0) return begin + __builtin_ctz(static_cast<unsigned>(mask));
+                }
+
+                return findByteSse2(begin, end, value);
+            }
+
+            __attribute__((target("avx2")))
+            inline const std::uint8_t* findFieldContentEndAvx2(const std::uint8_t* begin, const std::uint8_t* end) noexcept
+            {
+                const auto lastControl = _mm256_set1_epi8(0x1F);
+                const auto tab = _mm256_set1_epi8(0x09);
+                const auto del = _mm256_set1_epi8(0x7F);
+                for (; end - begin >= 32; begin += 32)
+                {
+                    const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+                    const auto control = _mm256_andnot_si256(_mm256_cmpeq_epi8(block, tab),
+                                                             _mm256_cmpeq_epi8(_mm256_min_epu8(block, lastControl), block));
+                    const auto mask = _mm256_movemask_epi8(_mm256_or_si256(control, _mm256_cmpeq_epi8(block, del)));
+                    if (mask != 0) return begin + __builtin_ctz(static_cast<unsigned>(mask));
+                }
+
+                return findFieldContentEndSse2(begin, end);
+            }
+
+            __attribute__((target("avx2")))
+            inline void toLowerAvx2(char* data, const std::size_t size) noexcept
+            {
+                const auto shift = _mm256_set1_epi8(static_cast<char>(0x80 - 'A'));
+                const auto limit = _mm256_set1_epi8(static_cast<char>(0x80 + 26));
+                const auto difference = _mm256_set1_epi8('a' - 'A');
+
+                std::size_t i = 0;
+                for (; size - i >= 32; i += 32)
+                {
+                    const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                    const auto upper = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(block, shift));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i),
+                                        _mm256_add_epi8(block, _mm256_and_si256(upper, difference)));
+                }
+
+                toLowerSse2(data + i, size - i);
+            }
+#endif // HTTPREQUEST_X86_SIMD
+
+            struct Kernels final
+            {
+                const std::uint8_t* (*findByte)(const std::uint8_t*, const std::uint8_t*, std::uint8_t) noexcept;
+                const std::uint8_t* (*findFieldContentEnd)(const std::uint8_t*, const std::uint8_t*) noexcept;
+                void (*toLower)(char*, std::size_t) noexcept;
+            };
+
+            inline const Kernels& getKernels() noexcept
+            {
+                static const Kernels kernels = []() noexcept -> Kernels {
+#ifdef HTTPREQUEST_X86_SIMD
+                    if (__builtin_cpu_supports("avx2"))
+                        return {findByteAvx2, findFieldContentEndAvx2, toLowerAvx2};
+
+                    return {findByteSse2, findFieldContentEndSse2, toLowerSse2};
+#else
+                    return {findByteScalar, findFieldContentEndScalar, toLowerScalar};
+#endif // HTTPREQUEST_X86_SIMD
+                }();
+
+                return kernels;
+            }
+
+            inline const std::uint8_t* findByte(const std::uint8_t* begin, const std::uint8_t* end, const std::uint8_t value) noexcept
+            {
+                // short lines like chunk sizes end before a vector would be
+                // filled, they are checked in place
+                const auto head = begin + (std::min)(end - begin, std::ptrdiff_t{8});
+                for (; begin != head; ++begin)
+                    if (*begin == value) return begin;
+
+                return (begin == end) ? end : getKernels().findByte(begin, end, value);
+            }
+
+            // Finds the first byte which can't be a part of a field value,
+            // normally the CR at the end of the line
+            inline const std::uint8_t* findFieldContentEnd(const std::uint8_t* begin, const std::uint8_t* end) noexcept
+            {
+                return getKernels().findFieldContentEnd(begin, end);
+            }
+
+            inline void toLower(std::string& value) noexcept
+            {
+                getKernels().toLower(&value[0], value.size());
+            }
+
+            // Finds a delimiter which starts with CR, like CRLF or CRLFCRLF
+            template <std::size_t size>
+            const std::uint8_t* findDelimiter(const std::uint8_t* begin, const std::uint8_t* end,
+                                              const std::array<std::uint8_t, size>& delimiter) noexcept
+            {
+                for (auto i = findByte(begin, end, delimiter[0]); i != end; i = findByte(i + 1, end, delimiter[0]))
+                {
+                    if (static_cast<std::size_t>(end - i) < size) return end;
+                    if (std::equal(delimiter.cbegin() + 1, delimiter.cend(), i + 1)) return i;
+                }
+
+                return end;
+            }
+        }
+
         template <class Iterator>
         Iterator skipWhiteSpaces(const Iterator begin, const Iterator end)
         {
@@ -857,6 +1147,44 @@ namespace http
             return {i, {std::move(fieldName), std::move(fieldValue)}};
         }
 
+        // RFC 7230, 3.2. Header Fields
+        // Same as above for a contiguous header section, delimiters are
+        // found with the scanning kernels instead of byte by byte
+        inline std::pair<const std::uint8_t*, HeaderField> parseHeaderField(const std::uint8_t* const begin, const std::uint8_t* const end)
+        {
+            const auto nameEnd = scan::findByte(begin, end, ':');
+            if (nameEnd == begin || nameEnd == end || !std::all_of(begin, nameEnd, isTokenChar<std::uint8_t>))
+                throw ResponseError{nameEnd == begin ? "Invalid token" : "Invalid header"};
+
+            std::string fieldName(begin, nameEnd);
+            std::string fieldValue;
+
+            auto i = skipWhiteSpaces(nameEnd + 1, end);
+            for (;;)
+            {
+                const auto valueEnd = scan::findFieldContentEnd(i, end);
+                auto trimmedEnd = valueEnd;
+                while (trimmedEnd != i && isWhiteSpaceChar(*(trimmedEnd - 1))) --trimmedEnd;
+                fieldValue.append(i, trimmedEnd);
+                i = valueEnd;
+
+                // Handle obsolete fold as per RFC 7230, 3.2.4. Field Parsing
+                if (end - i < 3 || i[0] != '\r' || i[1] != '\n' || !isWhiteSpaceChar(i[2]))
+                    break;
+
+                fieldValue.push_back(' ');
+                i += 3;
+            }
+
+            if (i == end || *i++ != '\r')
+                throw ResponseError{"Invalid header"};
+
+            if (i == end || *i++ != '\n')
+                throw ResponseError{"Invalid header"};
+
+            return {i, {std::move(fieldName), std::move(fieldValue)}};
+        }
+
         // RFC 7230, 3.1.2. Status Line
         template <class Iterator>
         std::pair<Iterator, Status> parseStatusLine(const Iterator begin, const Iterator end)
@@ -991,8 +1319,9 @@ namespace http
                                                     const std::vector<uint8_t>& body,
                                                     HeaderFields headerFields)
         {
-            if (uri.scheme != "http")
-                throw RequestError{"Only HTTP scheme is supported"};
+            // NOTE: TLS of the "https" scheme is up to the transport
+            if (uri.scheme != "http" && uri.scheme != "https")
+                throw RequestError{"Only HTTP and HTTPS schemes are supported"};
 
             // RFC 7230, 5.3. Request Target
             const std::string requestTarget = uri.path + (uri.query.empty() ? ""  : '?' + uri.query);
@@ -1019,6 +1348,381 @@ namespace http
 
             return result;
         }
+
+        // Incremental parser of a single response, it can be fed with the
+        // data in pieces of any size as it is received from the socket.
+        // Body is handed to the sink straight from the given data, only a
+        // header section or a chunk line split between two pieces is copied
+        class ResponseParser final
+        {
+        public:
+            ResponseParser(Response& parsedResponse, BodySink sink, HeaderHandler handler = {}):
+                response{parsedResponse},
+                bodySink{std::move(sink)},
+                headerHandler{std::move(handler)}
+            {
+            }
+
+            // Returns true when the whole response has been parsed
+            bool parse(const std::uint8_t* data, const std::size_t size)
+            {
+                const auto end = data + size;
+                auto i = data;
+
+                while (!complete && i != end)
+                {
+                    switch (state)
+                    {
+                        case State::header: i = parseHeaderSection(i, end); break;
+                        case State::body: i = parseBody(i, end); break;
+                        case State::bodyUntilClose: i = parseBodyUntilClose(i, end); break;
+                        case State::chunkSize: i = parseChunkSize(i, end); break;
+                        case State::chunkData: i = parseChunkData(i, end); break;
+                        case State::chunkDataEnd: i = parseChunkDataEnd(i, end); break;
+                        case State::trailer: i = parseTrailer(i, end); break;
+                    }
+                }
+
+                parsedSize = static_cast<std::size_t>(i - data);
+                return complete;
+            }
+
+            // Must be called when the server closed the connection, throws if
+            // the response can't be considered complete at this point
+            void finish()
+            {
+                if (complete) return;
+
+                // RFC 7230, 3.3.3. Message Body Length
+                if (state != State::bodyUntilClose)
+                    throw ResponseError{"Connection closed before the response was complete"};
+
+                complete = true;
+                closeDelimited = true;
+            }
+
+            bool isComplete() const noexcept { return complete; }
+
+            // Number of bytes of the last parsed piece which belong to this
+            // response, the rest of it is the beginning of the next response
+            // on a pipelined connection (RFC 7230, 6.3.2. Pipelining)
+            std::size_t getParsedSize() const noexcept { return parsedSize; }
+
+            // Number of body bytes still expected when the body is delimited by
+            // Content-Length, so the rest of it can be read past the parser
+            // (RFC 7230, 3.3.2. Content-Length)
+            std::size_t remainingBodySize() const noexcept
+            {
+                return (state == State::body && !complete) ? contentLength - bodySize : 0U;
+            }
+
+            // Accounts for body bytes which were delivered without the parser
+            void skipBody(const std::size_t size)
+            {
+                if (size > remainingBodySize())
+                    throw ResponseError{"Body is longer than its Content-Length"};
+
+                bodySize += size;
+                if (bodySize >= contentLength)
+                    complete = true;
+            }
+
+            // RFC 7230, 6.3. Persistence
+            // True if the connection can carry another request after this response
+            bool isKeepAlive() const noexcept
+            {
+                return complete && !closeDelimited && !connectionClose &&
+                    (response.status.httpVersion.major > 1 ||
+                     (response.status.httpVersion.major == 1 &&
+                      (response.status.httpVersion.minor >= 1 || connectionKeepAlive)));
+            }
+
+        private:
+            enum class State
+            {
+                header,
+                body,
+                bodyUntilClose,
+                chunkSize,
+                chunkData,
+                chunkDataEnd,
+                trailer
+            };
+
+            // Finds the end of a delimited part of the message, which may
+            // start in the previous pieces. Returns true and points
+            // partBegin and partEnd (past the delimiter) at the whole part
+            // once the delimiter is found
+            template <std::size_t delimiterSize>
+            bool takePart(const std::uint8_t*& i, const std::uint8_t* const end,
+                          const std::array<std::uint8_t, delimiterSize>& delimiter,
+                          const std::uint8_t*& partBegin, const std::uint8_t*& partEnd)
+            {
+                const auto previousSize = pending.size();
+                if (previousSize == 0)
+                {
+                    const auto found = scan::findDelimiter(i, end, delimiter);
+                    if (found != end)
+                    {
+                        partBegin = i;
+                        partEnd = i = found + delimiterSize;
+                        return true;
+                    }
+
+                    keepPending(i, end);
+                    i = end;
+                    return false;
+                }
+
+                // only the received data and the tail of the data before it
+                // which may hold the beginning of the delimiter are scanned
+                const auto scanOffset = previousSize >= delimiterSize ? previousSize - (delimiterSize - 1) : 0U;
+                keepPending(i, end);
+
+                const auto pendingEnd = pending.data() + pending.size();
+                const auto found = scan::findDelimiter(pending.data() + scanOffset, pendingEnd, delimiter);
+                if (found == pendingEnd)
+                {
+                    i = end;
+                    return false;
+                }
+
+                const auto partSize = static_cast<std::size_t>(found - pending.data()) + delimiterSize;
+                i += partSize - previousSize;
+                pending.resize(partSize);
+                partBegin = pending.data();
+                partEnd = pending.data() + partSize;
+                return true;
+            }
+
+            void keepPending(const std::uint8_t* const begin, const std::uint8_t* const end)
+            {
+                if (pending.size() + static_cast<std::size_t>(end - begin) > maxPendingSize)
+                    throw ResponseError{"Response header is too large"};
+
+                pending.insert(pending.end(), begin, end);
+            }
+
+            const std::uint8_t* parseHeaderSection(const std::uint8_t* i, const std::uint8_t* const end)
+            {
+                // RFC 7230, 3. Message Format
+                // Empty line indicates the end of the header section (RFC 7230, 2.1. Client/Server Messaging)
+                const std::uint8_t* headerBegin;
+                const std::uint8_t* headerEnd;
+                if (!takePart(i, end, headerSectionEnd, headerBegin, headerEnd))
+                    return i;
+
+                parseHeader(headerBegin, headerEnd - 2);
+                pending.clear();
+                return i;
+            }
+
+            const std::uint8_t* parseBody(const std::uint8_t* i, const std::uint8_t* const end)
+            {
+                const auto toWrite = (std::min)(contentLength - bodySize, static_cast<std::size_t>(end - i));
+                writeBody(i, toWrite);
+
+                // got the whole content
+                if (bodySize >= contentLength)
+                    complete = true;
+
+                return i + toWrite;
+            }
+
+            const std::uint8_t* parseBodyUntilClose(const std::uint8_t* i, const std::uint8_t* const end)
+            {
+                // RFC 7230, 3.3.3. Message Body Length, body lasts until the connection is closed
+                writeBody(i, static_cast<std::size_t>(end - i));
+                return end;
+            }
+
+            // RFC 7230, 4.1. Chunked Transfer Coding
+            const std::uint8_t* parseChunkSize(const std::uint8_t* i, const std::uint8_t* const end)
+            {
+                const std::uint8_t* lineBegin;
+                const std::uint8_t* lineEnd;
+                if (!takePart(i, end, crlf, lineBegin, lineEnd))
+                    return i;
+
+                // chunk extensions are ignored (RFC 7230, 4.1.1. Chunk Extensions)
+                const auto sizeEnd = scan::findByte(lineBegin, lineEnd - 2, ';');
+                expectedChunkSize = detail::hexStringToUint<std::size_t>(lineBegin, sizeEnd);
+                pending.clear();
+
+                state = (expectedChunkSize == 0) ? State::trailer : State::chunkData;
+                return i;
+            }
+
+            const std::uint8_t* parseChunkData(const std::uint8_t* i, const std::uint8_t* const end)
+            {
+                const auto toWrite = (std::min)(expectedChunkSize, static_cast<std::size_t>(end - i));
+                writeBody(i, toWrite);
+                expectedChunkSize -= toWrite;
+
+                if (expectedChunkSize == 0)
+                {
+                    state = State::chunkDataEnd;
+                    chunkDataEndSize = 0;
+                }
+
+                return i + toWrite;
+            }
+
+            const std::uint8_t* parseChunkDataEnd(const std::uint8_t* i, const std::uint8_t* const end)
+            {
+                // the CRLF after the chunk data may be split between two pieces
+                for (; i != end && chunkDataEndSize < crlf.size(); ++i, ++chunkDataEndSize)
+                    if (*i != crlf[chunkDataEndSize])
+                        throw ResponseError{"Invalid chunk"};
+
+                if (chunkDataEndSize == crlf.size())
+                    state = State::chunkSize;
+
+                return i;
+            }
+
+            // RFC 7230, 4.1.2. Chunked Trailer Part, ends with an empty line
+            const std::uint8_t* parseTrailer(const std::uint8_t* i, const std::uint8_t* const end)
+            {
+                const std::uint8_t* lineBegin;
+                const std::uint8_t* lineEnd;
+                if (!takePart(i, end, crlf, lineBegin, lineEnd))
+                    return i;
+
+                if (lineEnd - lineBegin == 2)
+                    complete = true;
+
+                pending.clear();
+                return i;
+            }
+
+            void parseHeader(const std::uint8_t* const begin, const std::uint8_t* const end)
+            {
+                auto statusLineResult = parseStatusLine(begin, end);
+                auto i = statusLineResult.first;
+
+                response.status = std::move(statusLineResult.second);
+                response.headerFields.clear();
+                contentLengthReceived = false;
+                chunkedResponse = false;
+
+                while (i != end)
+                {
+                    auto headerFieldResult = parseHeaderField(i, end);
+                    i = headerFieldResult.first;
+
+                    auto fieldName = std::move(headerFieldResult.second.first);
+                    scan::toLower(fieldName);
+
+                    auto fieldValue = std::move(headerFieldResult.second.second);
+
+                    if (fieldName == "transfer-encoding")
+                    {
+                        // RFC 7230, 3.3.1. Transfer-Encoding
+                        if (fieldValue == "chunked")
+                            chunkedResponse = true;
+                        else
+                            throw ResponseError{"Unsupported transfer encoding: " + fieldValue};
+                    }
+                    else if (fieldName == "content-length")
+                    {
+                        // RFC 7230, 3.3.2. Content-Length
+                        contentLength = stringToUint<std::size_t>(fieldValue.cbegin(), fieldValue.cend());
+                        contentLengthReceived = true;
+                        if (!bodySink) response.body.reserve(contentLength);
+                    }
+                    else if (fieldName == "connection")
+                    {
+                        // RFC 7230, 6.1. Connection
+                        std::string options = fieldValue;
+                        scan::toLower(options);
+                        connectionClose = hasToken(options, "close");
+                        connectionKeepAlive = hasToken(options, "keep-alive");
+                    }
+
+                    response.headerFields.push_back({std::move(fieldName), std::move(fieldValue)});
+                }
+
+                // RFC 7231, 6.2. Informational 1xx, the final response follows
+                if (response.status.code >= 100 && response.status.code < 200)
+                    return;
+
+                if (headerHandler) headerHandler(response);
+
+                // RFC 7230, 3.3.3. Message Body Length
+                // Content-Length must be ignored if Transfer-Encoding is received (RFC 7230, 3.2. Content-Length)
+                if (response.status.code == Status::NoContent ||
+                    response.status.code == Status::NotModified)
+                    complete = true;
+                else if (chunkedResponse)
+                    state = State::chunkSize;
+                else if (contentLengthReceived)
+                {
+                    state = State::body;
+                    complete = contentLength == 0;
+                }
+                else
+                    state = State::bodyUntilClose;
+            }
+
+            void writeBody(const std::uint8_t* data, const std::size_t size)
+            {
+                if (size == 0) return;
+
+                if (bodySink)
+                    bodySink(data, size);
+                else
+                    response.body.insert(response.body.end(), data, data + size);
+
+                bodySize += size;
+            }
+
+            // RFC 7230, 7. ABNF List Extension: #rule
+            static bool hasToken(const std::string& list, const std::string& token)
+            {
+                std::size_t position = 0;
+                while (position <= list.size())
+                {
+                    auto end = list.find(',', position);
+                    if (end == std::string::npos) end = list.size();
+
+                    auto first = position;
+                    auto last = end;
+                    while (first < last && isWhiteSpaceChar(list[first])) ++first;
+                    while (last > first && isWhiteSpaceChar(list[last - 1])) --last;
+
+                    if (list.compare(first, last - first, token) == 0)
+                        return true;
+
+                    position = end + 1;
+                }
+
+                return false;
+            }
+
+            static constexpr std::array<std::uint8_t, 2> crlf = {'\r', '\n'};
+            static constexpr std::array<std::uint8_t, 4> headerSectionEnd = {'\r', '\n', '\r', '\n'};
+
+            // limit for a header section or a chunk line which isn't received at once
+            static constexpr std::size_t maxPendingSize = 1024U * 1024U;
+
+            Response& response;
+            BodySink bodySink;
+            HeaderHandler headerHandler;
+            State state = State::header;
+            std::vector<std::uint8_t> pending;
+            std::size_t parsedSize = 0U;
+            bool contentLengthReceived = false;
+            std::size_t contentLength = 0U;
+            bool chunkedResponse = false;
+            std::size_t expectedChunkSize = 0U;
+            std::size_t chunkDataEndSize = 0U;
+            bool connectionClose = false;
+            bool connectionKeepAlive = false;
+            std::size_t bodySize = 0U;
+            bool complete = false;
+            bool closeDelimited = false;
+        };
     }
 
     class Request final
@@ -1046,6 +1750,15 @@ namespace http
                       const std::vector<uint8_t>& body,
                       const HeaderFields& headerFields = {},
                       const std::chrono::milliseconds timeout = std::chrono::milliseconds{-1})
+        {
+            return send(method, body, headerFields, BodySink{}, timeout);
+        }
+
+        Response send(const std::string& method,
+                      const std::vector<uint8_t>& body,
+                      const HeaderFields& headerFields,
+                      const BodySink& bodySink,
+                      const std::chrono::milliseconds timeout = std::chrono::milliseconds{-1})
         {
             const auto stopTime = std::chrono::steady_clock::now() + timeout;
 
@@ -1090,17 +1803,9 @@ namespace http
                 sendData += size;
             }
 
-            std::array<std::uint8_t, 4096> tempBuffer;
-            constexpr std::array<std::uint8_t, 2> crlf = {'\r', '\n'};
-            constexpr std::array<std::uint8_t, 4> headerEnd = {'\r', '\n', '\r', '\n'};
+            std::array<std::uint8_t, 65536> tempBuffer;
             Response response;
-            std::vector<std::uint8_t> responseData;
-            bool parsingBody = false;
-            bool contentLengthReceived = false;
-            std::size_t contentLength = 0U;
-            bool chunkedResponse = false;
-            std::size_t expectedChunkSize = 0U;
-            bool removeCrlfAfterChunk = false;
+            ResponseParser parser{response, bodySink};
 
             // read the response
             for (;;)
@@ -1108,124 +1813,14 @@ namespace http
                 const auto size = socket.recv(tempBuffer.data(), tempBuffer.size(),
                                               (timeout.count() >= 0) ? getRemainingMilliseconds(stopTime) : -1);
                 if (size == 0) // disconnected
-                    return response;
-
-                responseData.insert(responseData.end(), tempBuffer.begin(), tempBuffer.begin() + size);
-
-                if (!parsingBody)
                 {
-                    // RFC 7230, 3. Message Format
-                    // Empty line indicates the end of the header section (RFC 7230, 2.1. Client/Server Messaging)
-                    const auto endIterator = std::search(responseData.cbegin(), responseData.cend(),
-                                                         headerEnd.cbegin(), headerEnd.cend());
-                    if (endIterator == responseData.cend()) break; // two consecutive CRLFs not found
-
-                    const auto headerBeginIterator = responseData.cbegin();
-                    const auto headerEndIterator = endIterator + 2;
-
-                    auto statusLineResult = parseStatusLine(headerBeginIterator, headerEndIterator);
-                    auto i = statusLineResult.first;
-
-                    response.status = std::move(statusLineResult.second);
-
-                    for (;;)
-                    {
-                        auto headerFieldResult = parseHeaderField(i, headerEndIterator);
-                        i = headerFieldResult.first;
-
-                        auto fieldName = std::move(headerFieldResult.second.first);
-                        const auto toLower = [](const char c) noexcept {
-                            return (c >= 'A' && c <= 'Z') ? c - ('A' - 'a') : c;
-                        };
-                        std::transform(fieldName.begin(), fieldName.end(), fieldName.begin(), toLower);
-
-                        auto fieldValue = std::move(headerFieldResult.second.second);
-
-                        if (fieldName == "transfer-encoding")
-                        {
-                            // RFC 7230, 3.3.1. Transfer-Encoding
-                            if (fieldValue == "chunked")
-                                chunkedResponse = true;
-                            else
-                                throw ResponseError{"Unsupported transfer encoding: " + fieldValue};
-                        }
-                        else if (fieldName == "content-length")
-                        {
-                            // RFC 7230, 3.3.2. Content-Length
-                            contentLength = stringToUint<std::size_t>(fieldValue.cbegin(), fieldValue.cend());
-                            contentLengthReceived = true;
-                            response.body.reserve(contentLength);
-                        }
-
-                        response.headerFields.push_back({std::move(fieldName), std::move(fieldValue)});
-
-                        if (i == headerEndIterator)
-                            break;
-                    }
-
-                    responseData.erase(responseData.cbegin(), headerEndIterator + 2);
-                    parsingBody = true;
+                    parser.finish();
+                    return response;
                 }
 
-                if (parsingBody)
-                {
-                    // Content-Length must be ignored if Transfer-Encoding is received (RFC 7230, 3.2. Content-Length)
-                    if (chunkedResponse)
-                    {
-                        // RFC 7230, 4.1. Chunked Transfer Coding
-                        for (;;)
-                        {
-                            if (expectedChunkSize > 0)
-                            {
-                                const auto toWrite = (std::min)(expectedChunkSize, responseData.size());
-                                response.body.insert(response.body.end(), responseData.begin(),
-                                                     responseData.begin() + static_cast<std::ptrdiff_t>(toWrite));
-                                responseData.erase(responseData.begin(),
-                                                   responseData.begin() + static_cast<std::ptrdiff_t>(toWrite));
-                                expectedChunkSize -= toWrite;
-
-                                if (expectedChunkSize == 0) removeCrlfAfterChunk = true;
-                                if (responseData.empty()) break;
-                            }
-                            else
-                            {
-                                if (removeCrlfAfterChunk)
-                                {
-                                    if (responseData.size() < 2) break;
-
-                                    if (!std::equal(crlf.begin(), crlf.end(), responseData.begin()))
-                                        throw ResponseError{"Invalid chunk"};
-
-                                    removeCrlfAfterChunk = false;
-                                    responseData.erase(responseData.begin(), responseData.begin() + 2);
-                                }
-
-                                const auto i = std::search(responseData.begin(), responseData.end(),
-                                                           crlf.begin(), crlf.end());
-
-                                if (i == responseData.end()) break;
-
-                                expectedChunkSize = detail::hexStringToUint<std::size_t>(responseData.begin(), i);
-                                responseData.erase(responseData.begin(), i + 2);
-
-                                if (expectedChunkSize == 0)
-                                    return response;
-                            }
-                        }
-                    }
-                    else
-                    {
-                        response.body.insert(response.body.end(), responseData.begin(), responseData.end());
-                        responseData.clear();
-
-                        // got the whole content
-                        if (contentLengthReceived && response.body.size() >= contentLength)
-                            return response;
-                    }
-                }
+                if (parser.parse(tempBuffer.data(), size))
+                    return response;
             }
-
-            return response;
         }
 
     private:
@@ -1,11 +1,20 @@
 #ifndef ACTION_HPP_
 #define ACTION_HPP_
 
+// NOTE: What an action mostly waits for. Actions of each class run on
+// their own threads, so extracting archives doesn't hold downloads up
+enum class ResourceClass
+{
+    Io,
+    Cpu,
+};
+
 class Action
 {
 public:
     virtual ~Action(void) {}
     virtual void Execute(void) const = 0;
+    virtual ResourceClass GetResourceClass(void) const = 0;
 };
 
 #endif // ACTION_HPP_
@@ -0,0 +1,105 @@
+#ifndef BANDWIDTHSCHEDULER_HPP_
+#define BANDWIDTHSCHEDULER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Token buckets for the whole process and for every host. Connections ask
+// for tokens before each read and leave data in the socket when there are
+// none, which lets TCP flow control slow the server down.
+//
+// Tokens are shared by start-time fair queueing: every flow has a virtual
+// finish tag advanced by `bytes / weight`, and a flow can't take tokens
+// while a flow with a smaller tag is waiting for the same bucket
+class BandwidthScheduler
+{
+    struct Bucket;
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // NOTE: One download, destroyed with it
+    class Flow
+    {
+    public:
+        Flow(BandwidthScheduler &scheduler, std::string host);
+        ~Flow();
+
+        Flow(const Flow &) = delete;
+        Flow &operator=(const Flow &) = delete;
+
+        // NOTE: Share of the bandwidth relative to other flows
+        void SetWeight(double weight);
+
+    private:
+        friend class BandwidthScheduler;
+
+        using WaitKey = std::pair<double, uint64_t>;
+
+        BandwidthScheduler &m_Scheduler;
+        const std::string m_Host;
+        Bucket *m_Bucket;
+        double m_Weight;
+        double m_FinishTag;
+        bool m_Waiting;
+        WaitKey m_WaitKey;
+    };
+
+    // NOTE: Rates are in bytes per second, zero means unlimited
+    void SetLimits(uint64_t maxRate, uint64_t maxHostRate);
+
+    // NOTE: Returns how many of `size` bytes the flow may read now, zero
+    // means it has to wait until `retryAt`
+    std::size_t Acquire(Flow &flow, std::size_t size,
+                        Clock::time_point &retryAt);
+    // NOTE: Gives back tokens acquired for a read that returned less
+    void Refund(Flow &flow, std::size_t size);
+
+    static BandwidthScheduler &Get(void);
+
+private:
+    struct Bucket
+    {
+        uint64_t rate = 0;
+        double tokens = 0;
+        double capacity = 0;
+        Clock::time_point refilled;
+    };
+
+    BandwidthScheduler(void);
+
+    static void Reset(Bucket &bucket, uint64_t rate);
+    static void Refill(Bucket &bucket, Clock::time_point now);
+
+    Bucket &GetBucket(Flow &flow);
+    // NOTE: Waiting flow blocks others only if its own host would let it
+    // read, otherwise tokens of the shared bucket would go unused
+    bool IsBlockedBy(const Flow &flow, Flow &waiter, Clock::time_point now);
+    void StopWaiting(Flow &flow);
+
+    std::atomic<bool> m_Limited;
+    std::mutex m_Mutex;
+    Bucket m_Global;
+    uint64_t m_MaxHostRate;
+    // NOTE: Nodes never move, so flows keep pointers to their buckets
+    std::unordered_map<std::string, Bucket> m_Hosts;
+
+    double m_VirtualTime;
+    uint64_t m_WaitSequence;
+    std::map<Flow::WaitKey, Flow *> m_Waiting;
+
+    // NOTE: Smallest grant while limited, smaller ones cost more system
+    // calls than they save in smoothness
+    inline static constexpr std::size_t s_Quantum = 16 * 1024;
+    // NOTE: Bucket holds at most this much time worth of tokens
+    inline static constexpr double s_BurstSeconds = 0.05;
+    inline static constexpr double s_MinWaitSeconds = 0.001;
+};
+
+#endif // BANDWIDTHSCHEDULER_HPP_
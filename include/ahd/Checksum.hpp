@@ -0,0 +1,50 @@
+#ifndef CHECKSUM_HPP_
+#define CHECKSUM_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <string>
+
+// Digest computed incrementally over the bytes of a file, so a download can
+// be verified while it's written instead of reading the file once more.
+// SHA-256 comes from OpenSSL, which uses SHA-NI where the CPU has it, CRC32C
+// uses the SSE4.2 instruction and xxHash needs libxxhash
+class Checksum
+{
+public:
+    virtual ~Checksum(void) {}
+
+    virtual void Update(const uint8_t *data, std::size_t size) = 0;
+
+    // NOTE: Lower case hex digest, CRC32C and xxHash values are written most
+    // significant byte first, the way their tools print them
+    virtual std::string Finish(void) = 0;
+
+    // NOTE: Hashes the file from the start, up to `size` bytes
+    void UpdateFromFile(const std::filesystem::path &path,
+                        uint64_t size = std::numeric_limits<uint64_t>::max());
+
+    // NOTE: Throws for algorithms which aren't supported
+    static std::unique_ptr<Checksum> Create(const std::string &algorithm);
+
+    // NOTE: `value` is `<algorithm>:<hex digest>`. Returns `false` if it's
+    // malformed or the algorithm isn't supported, the digest is returned in
+    // lower case
+    static bool Parse(const std::string &value, std::string &algorithm,
+                      std::string &digest);
+    // NOTE: Names of the supported algorithms, separated by commas
+    static const char *GetAlgorithms(void);
+
+    inline static const char *s_Sha256 = "sha256";
+    inline static const char *s_Crc32c = "crc32c";
+    inline static const char *s_Xxh64 = "xxh64";
+    inline static const char *s_Xxh3 = "xxh3";
+
+private:
+    inline static constexpr std::size_t s_FileBufferSize = 1024 * 1024;
+};
+
+#endif // CHECKSUM_HPP_
@@ -0,0 +1,66 @@
+#ifndef CONCURRENCYLIMITER_HPP_
+#define CONCURRENCYLIMITER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+
+// Limit of concurrent connections to one host, adjusted the way TCP adjusts
+// its window. While the limit is in full use the throughput is sampled, and
+// the limit grows by one for as long as that keeps making the host faster.
+// Timeouts, resets and 429/503 responses halve it
+class ConcurrencyLimiter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ConcurrencyLimiter(std::string host, std::size_t maxLimit);
+
+    ConcurrencyLimiter(const ConcurrencyLimiter &) = delete;
+    ConcurrencyLimiter &operator=(const ConcurrencyLimiter &) = delete;
+
+    std::size_t GetLimit(void) const;
+    void SetMaxLimit(std::size_t maxLimit);
+
+    // NOTE: Called for every read, so it only counts
+    void OnReceived(std::size_t size);
+    // NOTE: `saturated` means downloads are waiting because of the limit.
+    // Throughput is evaluated once a sampling window has passed
+    void Update(bool saturated);
+    void OnCongestion(const std::string &reason);
+
+    // NOTE: Prints every change of the limit to stderr
+    static void SetLogging(bool logging);
+
+    // NOTE: Errors, which usually mean the host is overloaded
+    static bool IsCongestion(std::exception_ptr error, std::string &reason);
+
+private:
+    void SetLimit(double limit, const std::string &reason);
+
+    const std::string m_Host;
+    mutable std::mutex m_Mutex;
+    double m_Limit;
+    std::size_t m_MaxLimit;
+
+    std::atomic<uint64_t> m_ReceivedSize;
+    Clock::time_point m_WindowStart;
+    bool m_Saturated;
+    // NOTE: Best throughput seen with the current limit, bytes per second
+    double m_Throughput;
+    Clock::time_point m_LastDecrease;
+
+    inline static std::atomic<bool> s_Logging = false;
+
+    inline static constexpr std::size_t s_InitialLimit = 6;
+    inline static constexpr std::chrono::milliseconds s_Window{500};
+    // NOTE: Smaller improvements are lost in the noise
+    inline static constexpr double s_MinGain = 1.05;
+    inline static constexpr double s_DecreaseFactor = 0.5;
+};
+
+#endif // CONCURRENCYLIMITER_HPP_
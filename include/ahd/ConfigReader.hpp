@@ -1,13 +1,15 @@
 #ifndef CONFIGREADER_HPP_
 #define CONFIGREADER_HPP_
 
+#include "ahd/DownloadOptions.hpp"
 #include "ahd/Task.hpp"
 #include <filesystem>
 
 class ConfigReader
 {
 public:
-    ConfigReader()
+    explicit ConfigReader(const DownloadOptions &downloadOptions = {})
+        : m_DownloadOptions(downloadOptions)
     {
     }
 
@@ -18,9 +20,13 @@ public:
     virtual TaskMap Read(const std::filesystem::path &configPath) = 0;
 
 protected:
+    // NOTE: Defaults given on the command line
+    const DownloadOptions m_DownloadOptions;
+
     inline static const char *s_ConfigHostField = "host";
     inline static const char *s_ConfigTargetField = "target";
     inline static const char *s_ConfigFilesField = "files";
+    inline static const char *s_ConfigCompressionField = "compression";
     inline static const std::vector<const char *> s_RequiredConfigFields = {
         s_ConfigHostField, s_ConfigTargetField, s_ConfigFilesField};
 
@@ -28,6 +34,17 @@ protected:
     inline static const char *s_FileFileField = "file";
     inline static const char *s_FileActionsField = "actions";
     inline static const char *s_FileDependenciesField = "dependencies";
+    inline static const char *s_FileSegmentsField = "segments";
+    inline static const char *s_FileMinSegmentSizeField = "min_segment_size";
+    inline static const char *s_FileCompressionField = "compression";
+    inline static const char *s_FileWeightField = "weight";
+    inline static const char *s_FileChecksumField = "checksum";
+
+    // NOTE: Accepted at the top level and for a single file
+    inline static const char *s_ConnectTimeoutField = "connect_timeout";
+    inline static const char *s_FirstByteTimeoutField = "first_byte_timeout";
+    inline static const char *s_IdleTimeoutField = "idle_timeout";
+    inline static const char *s_HedgePercentileField = "hedge_percentile";
     inline static const std::vector<const char *> s_RequiredFileFields = {
         s_FileNameField, s_FileFileField, s_FileActionsField};
 };
@@ -0,0 +1,173 @@
+#ifndef CONNECTIONPOOL_HPP_
+#define CONNECTIONPOOL_HPP_
+
+#include "ahd/ConcurrencyLimiter.hpp"
+#include "ahd/EventLoop.hpp"
+#include "ahd/LatencyTracker.hpp"
+#include "ahd/Transport.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class HttpDownload;
+class Http2Connection;
+
+enum class Http2Mode
+{
+    // NOTE: Every host is served over HTTP/1.1
+    Off,
+    // NOTE: HTTPS hosts are offered h2 during the TLS handshake
+    Alpn,
+    // NOTE: Plain HTTP hosts are also assumed to speak h2c (RFC 9113, 3.3.
+    // Starting HTTP/2 with Prior Knowledge)
+    PriorKnowledge,
+};
+
+struct Http2Settings
+{
+    Http2Mode mode = Http2Mode::Alpn;
+    // NOTE: Requests in flight on the connection, the server's own limit
+    // applies if it's lower
+    std::size_t maxConcurrentStreams = s_DefaultMaxConcurrentStreams;
+    // NOTE: Flow control windows (RFC 9113, 6.9.2. Initial Flow-Control
+    // Window Size) of every stream and of the whole connection. They must
+    // cover the bandwidth-delay product of the link, the server stops
+    // sending once a window is used up until it's updated
+    uint32_t streamWindowSize = s_DefaultStreamWindowSize;
+    uint32_t connectionWindowSize = s_DefaultConnectionWindowSize;
+
+    inline static constexpr std::size_t s_DefaultMaxConcurrentStreams = 100;
+    inline static constexpr uint32_t s_DefaultStreamWindowSize =
+        16 * 1024 * 1024;
+    inline static constexpr uint32_t s_DefaultConnectionWindowSize =
+        64 * 1024 * 1024;
+};
+
+// Per-host queue of downloads served by a limited number of persistent
+// HTTP/1.1 connections. Every open connection, busy or idle, holds one of
+// the host's slots, connections that finish their work are kept for reuse.
+// Number of slots adapts to the host, up to the configured maximum.
+//
+// Hosts which speak HTTP/2 are served by a single connection instead, which
+// takes queued downloads as long as it has free streams. HTTPS hosts are
+// tried with HTTP/2 first and fall back to HTTP/1.1 for good if the server
+// doesn't choose it during the handshake
+class ConnectionPool
+{
+public:
+    using Downloads = std::deque<std::shared_ptr<HttpDownload>>;
+
+    ConnectionPool(EventLoop &eventLoop, std::size_t maxConnectionsPerHost,
+                   std::size_t maxIdleConnectionsPerHost,
+                   std::size_t pipelineDepth);
+
+    ConnectionPool(const ConnectionPool &) = delete;
+    ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+    // NOTE: `first` puts the download in front of the queue, for requests
+    // which are late already
+    void Submit(std::shared_ptr<HttpDownload> download, bool first = false);
+
+    // NOTE: Called by connections to pick up more work, `count` is the
+    // number of requests the connection can still have in flight
+    Downloads Take(const std::string &host, std::size_t count);
+    // NOTE: Puts downloads, whose requests weren't answered, back to the
+    // front of the queue
+    void Requeue(const std::string &host, Downloads downloads);
+    // NOTE: Gives the slot back, `stream` is kept for reuse if given,
+    // `nullptr` means the connection was closed
+    void Release(const std::string &host,
+                 std::unique_ptr<TransportStream> stream);
+
+    // NOTE: HTTP/2 connection of the host has stopped taking downloads, the
+    // queued ones are given to a new connection. Its slot is held until
+    // it's released
+    void DetachHttp2(const std::string &host,
+                     const Http2Connection *connection);
+    // NOTE: Server didn't choose HTTP/2 on the connection, which is handed
+    // over to HTTP/1.1 with its downloads and so is the rest of the host
+    void Downgrade(const std::string &host,
+                   std::unique_ptr<TransportStream> stream,
+                   Downloads downloads);
+
+    // NOTE: Limiters live as long as the pool, connections report
+    // throughput and errors to them directly
+    ConcurrencyLimiter &GetLimiter(const std::string &host);
+    LatencyTracker &GetFirstByteLatency(const std::string &host);
+
+    std::size_t GetPipelineDepth(const std::string &host);
+    // NOTE: Host closed a connection with requests still in flight, it's
+    // served with one request at a time from now on
+    void DisablePipelining(const std::string &host);
+
+    void SetLimits(std::size_t maxConnectionsPerHost,
+                   std::size_t maxIdleConnectionsPerHost);
+    void SetPipelineDepth(std::size_t pipelineDepth);
+    // NOTE: Must be set before the first download is submitted, HTTPS hosts
+    // are offered h2 if the mode allows it
+    void SetHttp2Settings(const Http2Settings &settings);
+
+    // NOTE: Connections are opened with the TCP transport by default. It
+    // must be replaced before the first download is submitted
+    Transport &GetTransport(void);
+    void SetTransport(std::unique_ptr<Transport> transport);
+
+    static ConnectionPool &Get(void);
+
+    inline static constexpr std::size_t s_DefaultMaxConnectionsPerHost = 16;
+    inline static constexpr std::size_t s_DefaultMaxIdleConnectionsPerHost = 2;
+    inline static constexpr std::size_t s_DefaultPipelineDepth = 1;
+
+private:
+    struct IdleConnection
+    {
+        std::unique_ptr<TransportStream> stream;
+        std::chrono::steady_clock::time_point releaseTime;
+    };
+
+    struct HostConnections
+    {
+        std::size_t openCount = 0;
+        std::deque<IdleConnection> idle;
+        Downloads queue;
+        bool pipelining = true;
+        bool http2 = false;
+        std::shared_ptr<Http2Connection> http2Connection;
+        std::unique_ptr<ConcurrencyLimiter> limiter;
+        std::unique_ptr<LatencyTracker> firstByteLatency;
+    };
+
+    // NOTE: Must be called with the lock held
+    HostConnections &GetHost(const std::string &host);
+
+    // NOTE: Starts connections for queued downloads while there are free
+    // slots or idle connections
+    void Dispatch(const std::string &host);
+    // NOTE: Returns `false` if the host isn't served over HTTP/2
+    bool DispatchHttp2(const std::string &host);
+
+    // NOTE: Must be called with the lock held. Drops downloads at the front
+    // of the queue which have lost to their hedges
+    static void DropCancelled(Downloads &queue);
+
+    EventLoop &m_EventLoop;
+    std::unique_ptr<Transport> m_Transport;
+
+    std::mutex m_Mutex;
+    std::unordered_map<std::string, HostConnections> m_Hosts;
+    std::size_t m_MaxConnectionsPerHost;
+    std::size_t m_MaxIdleConnectionsPerHost;
+    std::size_t m_PipelineDepth;
+    Http2Settings m_Http2Settings;
+
+    // NOTE: Servers usually drop idle connections after 5-60 seconds, older
+    // ones aren't worth the risk of a failed request
+    inline static constexpr std::chrono::seconds s_IdleTimeout{15};
+};
+
+#endif // CONNECTIONPOOL_HPP_
@@ -0,0 +1,61 @@
+#ifndef CONNECTOR_HPP_
+#define CONNECTOR_HPP_
+
+#include "ahd/EventLoop.hpp"
+#include "ahd/Resolver.hpp"
+#include <HTTPRequest.hpp>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+
+// Connects to a host over the first of its addresses to answer, as in
+// RFC 8305 (Happy Eyeballs). Attempts are started one after another with a
+// short delay and run concurrently, so a slow or unreachable address doesn't
+// hold the connection up. Address family of the winning attempt is
+// remembered per host and tried first the next time
+class Connector
+{
+public:
+    using ConnectHandler = std::function<void(
+        std::exception_ptr error, std::unique_ptr<http::Socket> socket)>;
+
+    explicit Connector(EventLoop &eventLoop);
+
+    Connector(const Connector &) = delete;
+    Connector &operator=(const Connector &) = delete;
+
+    // NOTE: Handler gets a connected socket or the error of the first failed
+    // attempt once all of them have failed. It's called on an event loop
+    // thread or right away if no attempt could be started. Attempts still
+    // running after `timeout` are given up with `ETIMEDOUT`, zero means no
+    // timeout
+    void Connect(const std::string &host,
+                 const std::vector<SocketAddress> &addresses,
+                 std::chrono::milliseconds timeout, ConnectHandler handler);
+
+    static Connector &Get(void);
+
+private:
+    friend class ConnectRace;
+
+    std::vector<SocketAddress> Order(
+        const std::string &host, const std::vector<SocketAddress> &addresses);
+    void SetPreferredFamily(const std::string &host, sa_family_t family);
+
+    EventLoop &m_EventLoop;
+
+    std::mutex m_Mutex;
+    std::unordered_map<std::string, sa_family_t> m_PreferredFamilies;
+
+    // RFC 8305, 5. Connection Attempt Delay
+    inline static constexpr std::chrono::milliseconds s_AttemptDelay{250};
+};
+
+#endif // CONNECTOR_HPP_
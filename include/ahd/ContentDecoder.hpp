@@ -0,0 +1,32 @@
+#ifndef CONTENTDECODER_HPP_
+#define CONTENTDECODER_HPP_
+
+#include <HTTPRequest.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Streaming decoder of a response body's content coding (RFC 7231,
+// 3.1.2.2. Content-Encoding). Decoded data is handed to the sink as soon as
+// it comes out, the body is never held in memory as a whole
+class ContentDecoder
+{
+public:
+    virtual ~ContentDecoder(void) {}
+
+    virtual void Write(const uint8_t *data, std::size_t size) = 0;
+
+    // NOTE: Throws if the encoded stream ended before its end marker
+    virtual void Finish(void) = 0;
+
+    // NOTE: Returns `nullptr` for the identity coding and throws for
+    // codings which aren't supported
+    static std::unique_ptr<ContentDecoder> Create(
+        const std::string &contentEncoding, http::BodySink sink);
+
+    // NOTE: Value of `Accept-Encoding` listing every supported coding
+    static const char *GetAcceptEncoding(void);
+};
+
+#endif // CONTENTDECODER_HPP_
@@ -2,23 +2,67 @@
 #define DOWNLOADACTION_HPP_
 
 #include "ahd/Action.hpp"
+#include "ahd/DownloadOptions.hpp"
+#include "ahd/FileMetadata.hpp"
+#include "ahd/HttpDownload.hpp"
 #include <HTTPRequest.hpp>
+#include <cstdint>
 #include <filesystem>
+#include <future>
+#include <optional>
 #include <string>
 
 class DownloadAction : public Action
 {
 public:
     DownloadAction(const std::string &requestUrl,
-                   const std::filesystem::path &outputPath);
+                   const std::filesystem::path &outputPath,
+                   const DownloadOptions &options = {});
 
+    // NOTE: Blocks the calling thread until the file is complete, socket
+    // I/O runs on the event loop meanwhile. Number of threads waiting like
+    // this is bounded by the I/O pool of the `TaskRunner`, not the event
+    // loop
     virtual void Execute(void) const override;
+    virtual ResourceClass GetResourceClass(void) const override;
 
 private:
+    void Download(void) const;
+    // NOTE: Looks the URL up in the download cache before downloading it
+    void ExecuteWithCache(void) const;
+    // NOTE: Returns true if the file is still the one `validators` describe
+    bool Revalidate(const FileMetadata::Validators &validators) const;
+
+    void ExecuteWithEventLoop(void) const;
+    // NOTE: Returns false if io_uring isn't available
+    bool ExecuteWithUring(void) const;
+    void ExecuteSegmented(void) const;
+    void FetchSegments(int outputDescriptor, uint64_t size,
+                       const std::string &validator) const;
+
+    // NOTE: Throws if `digest` isn't the expected checksum
+    void Verify(const std::string &digest) const;
+    // NOTE: Checks the file at the output path, which is read back unless
+    // its digest is known. File that doesn't match isn't trusted by the
+    // next run and it's removed if it was `downloaded` by this one
+    void VerifyOutput(bool downloaded,
+                      std::optional<std::string> digest = std::nullopt) const;
+
+    // NOTE: With `fileSink` set, large bodies may bypass `bodySink` and go
+    // straight into the file
+    std::future<void> StartDownload(
+        http::HeaderFields headerFields, http::HeaderHandler headerHandler,
+        http::BodySink bodySink, HttpDownload::FileSink fileSink = {}) const;
+
+    static void WriteAt(int descriptor, const uint8_t *data, std::size_t size,
+                        uint64_t offset);
+
     const std::string m_RequestUrl;
     const std::filesystem::path m_OutputPath;
+    const DownloadOptions m_Options;
 
-    static const char *GET_REQUEST;
+    // NOTE: How much data is received between updates of the saved state
+    inline static constexpr uint64_t s_StateSaveInterval = 4 * 1024 * 1024;
 };
 
 #endif // DOWNLOADACTION_HPP_
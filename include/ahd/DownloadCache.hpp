@@ -0,0 +1,81 @@
+#ifndef DOWNLOADCACHE_HPP_
+#define DOWNLOADCACHE_HPP_
+
+#include "ahd/FileMetadata.hpp"
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+
+// Cache directory shared by all processes on the node:
+//
+//   objects/<xx>/<sha256>  downloaded files, stored by content hash
+//   index/<sha256(url)>    URL, its validators and the object it points to
+//   locks/<sha256(url)>    held while the URL is revalidated or downloaded
+//
+// Objects are placed at the output path with a reflink where the file
+// system supports it, a hardlink otherwise, so a hit costs no copying
+class DownloadCache
+{
+public:
+    struct Entry
+    {
+        FileMetadata::Validators validators;
+        std::string object;
+    };
+
+    // NOTE: Released on destruction. Other processes and threads locking
+    // the same URL wait until then
+    class Lock
+    {
+    public:
+        explicit Lock(const std::filesystem::path &path);
+        ~Lock();
+
+        Lock(const Lock &) = delete;
+        Lock &operator=(const Lock &) = delete;
+
+    private:
+        int m_Descriptor;
+    };
+
+    explicit DownloadCache(const std::filesystem::path &directory);
+
+    std::unique_ptr<Lock> LockUrl(const std::string &url) const;
+
+    // NOTE: Returns entry only if its object is still in place
+    std::optional<Entry> Find(const std::string &url) const;
+
+    // NOTE: Stores the downloaded file at `path` as the entry for
+    // `validators.url`. Files with the same content share one object
+    void Insert(const FileMetadata::Validators &validators,
+                const std::filesystem::path &path) const;
+
+    // NOTE: Replaces the file at `outputPath` with the entry's object
+    void Materialize(const Entry &entry,
+                     const std::filesystem::path &outputPath) const;
+
+private:
+    std::filesystem::path GetObjectPath(const std::string &object) const;
+    std::filesystem::path MakeTemporaryPath(const std::string &name) const;
+
+    // NOTE: Reflink, hardlink and plain copy, whichever works first
+    static void LinkOrCopy(const std::filesystem::path &from,
+                           const std::filesystem::path &to);
+
+    static std::string HashFile(const std::filesystem::path &path);
+    static std::string HashString(const std::string &data);
+
+    const std::filesystem::path m_ObjectsDirectory;
+    const std::filesystem::path m_IndexDirectory;
+    const std::filesystem::path m_LocksDirectory;
+    const std::filesystem::path m_TemporaryDirectory;
+
+    inline static const char *s_UrlField = "url";
+    inline static const char *s_SizeField = "size";
+    inline static const char *s_EntityTagField = "etag";
+    inline static const char *s_LastModifiedField = "last-modified";
+    inline static const char *s_ObjectField = "object";
+};
+
+#endif // DOWNLOADCACHE_HPP_
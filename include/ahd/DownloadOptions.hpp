@@ -0,0 +1,63 @@
+#ifndef DOWNLOADOPTIONS_HPP_
+#define DOWNLOADOPTIONS_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+enum class IoBackend
+{
+    Epoll,
+    Uring,
+};
+
+// NOTE: Zero disables a deadline
+struct Timeouts
+{
+    // NOTE: Until the TCP connection is established
+    std::chrono::milliseconds connect{10000};
+    // NOTE: From sending the request to the first byte of the response
+    std::chrono::milliseconds firstByte{30000};
+    // NOTE: Longest pause between two reads of the response
+    std::chrono::milliseconds idle{30000};
+};
+
+struct DownloadOptions
+{
+    IoBackend ioBackend = IoBackend::Epoll;
+
+    // NOTE: File is split into byte ranges fetched over parallel
+    // connections, but no range is smaller than `minSegmentSize`
+    std::size_t segments = 1;
+    uint64_t minSegmentSize = 1024 * 1024;
+
+    // NOTE: Asks the server for a compressed body, which is decoded on the
+    // fly. Applies to single-stream downloads only
+    bool compression = false;
+
+    // NOTE: Share of the bandwidth relative to other downloads when it's
+    // limited, segments of one file split it between them
+    double weight = 1;
+
+    // NOTE: Deadlines of every request of the download, a request which
+    // misses one fails with `ETIMEDOUT`
+    Timeouts timeouts;
+
+    // NOTE: Request whose response hasn't started by this percentile of
+    // the host's first byte latency is sent once more, the first response
+    // to arrive is used. Zero disables hedging
+    double hedgePercentile = 0;
+
+    // NOTE: Expected digest of the file, as returned by `Checksum::Parse`.
+    // It's computed over the data while it's written, a file which doesn't
+    // match fails the download. Not verified if the algorithm is empty
+    std::string checksumAlgorithm;
+    std::string checksum;
+
+    // NOTE: Shared download cache, disabled if empty
+    std::filesystem::path cacheDirectory;
+};
+
+#endif // DOWNLOADOPTIONS_HPP_
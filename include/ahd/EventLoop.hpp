@@ -0,0 +1,96 @@
+#ifndef EVENTLOOP_HPP_
+#define EVENTLOOP_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class EventHandler
+{
+public:
+    virtual ~EventHandler(void) {}
+
+    // NOTE: Always called on the same reactor thread. Returning `false`
+    // unregisters the handler and releases the loop's reference to it
+    virtual bool OnEvents(uint32_t events) = 0;
+
+    // NOTE: Called on the reactor thread once the descriptor is no longer
+    // watched by epoll, so the handler may reuse or close it
+    virtual void OnRemoved(void) {}
+
+    // NOTE: Called on the same thread as `OnEvents` when the deadline set
+    // with `EventLoop::SetTimer` has passed, return value has the same
+    // meaning
+    virtual bool OnTimer(void) { return true; }
+};
+
+// Edge-triggered epoll reactor with a small fixed number of threads. Every
+// registered descriptor is owned by exactly one reactor thread, so handlers
+// are never called concurrently
+class EventLoop
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit EventLoop(std::size_t threadCount);
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    void Add(int descriptor, uint32_t events,
+             const std::shared_ptr<EventHandler> &handler);
+
+    // NOTE: Registered handler has at most one deadline, setting a new one
+    // replaces the previous and `Clock::time_point::max()` clears it
+    void SetTimer(EventHandler *handler, Clock::time_point deadline);
+
+    static EventLoop &Get(void);
+
+private:
+    struct Registration
+    {
+        int descriptor;
+        std::shared_ptr<EventHandler> handler;
+        Clock::time_point deadline = Clock::time_point::max();
+    };
+
+    // NOTE: Entries aren't removed when a deadline changes, stale ones are
+    // recognized by comparing with the registration's deadline
+    using Timer = std::pair<Clock::time_point, EventHandler *>;
+    using TimerQueue =
+        std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>>;
+
+    struct Reactor
+    {
+        int epollDescriptor = -1;
+        int wakeDescriptor = -1;
+        std::mutex mutex;
+        std::unordered_map<EventHandler *, Registration> registrations;
+        TimerQueue timers;
+        std::thread thread;
+    };
+
+    void Work(Reactor &reactor);
+    int GetTimeout(Reactor &reactor);
+    void RunTimers(Reactor &reactor);
+    void WakeUp(Reactor &reactor);
+    void Remove(Reactor &reactor, EventHandler *handler);
+
+    std::vector<std::unique_ptr<Reactor>> m_Reactors;
+    std::atomic<std::size_t> m_NextReactor;
+    std::atomic<bool> m_Running;
+
+    inline static constexpr std::size_t s_MaxThreadCount = 4;
+    inline static constexpr int s_MaxEvents = 256;
+};
+
+#endif // EVENTLOOP_HPP_
@@ -0,0 +1,39 @@
+#ifndef FILEMETADATA_HPP_
+#define FILEMETADATA_HPP_
+
+#include "ahd/PartialFile.hpp"
+#include <HTTPRequest.hpp>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+// Validators of a finished download are kept in the `<output>.meta` sidecar,
+// so a later run can ask the server whether the file has changed instead of
+// downloading it again
+class FileMetadata
+{
+public:
+    using Validators = PartialFile::State;
+
+    explicit FileMetadata(const std::filesystem::path &outputPath);
+
+    // NOTE: Returns validators only if they belong to `url` and the output
+    // file still has the size it was downloaded with
+    std::optional<Validators> Load(const std::string &url) const;
+    // NOTE: Validators without ETag and Last-Modified are removed instead,
+    // there is nothing to revalidate with
+    void Save(const Validators &validators) const;
+    void Remove(void) const;
+
+    // RFC 7232, 3.2. If-None-Match and 3.3. If-Modified-Since
+    static void AddConditionalFields(const Validators &validators,
+                                     http::HeaderFields &headerFields);
+
+private:
+    const std::filesystem::path m_OutputPath;
+    const std::filesystem::path m_MetadataPath;
+
+    inline static const char *s_MetadataExtension = ".meta";
+};
+
+#endif // FILEMETADATA_HPP_
@@ -0,0 +1,170 @@
+#ifndef HTTP2CONNECTION_HPP_
+#define HTTP2CONNECTION_HPP_
+
+#ifdef AHD_WITH_NGHTTP2
+
+#include "ahd/BandwidthScheduler.hpp"
+#include "ahd/ConcurrencyLimiter.hpp"
+#include "ahd/ConnectionPool.hpp"
+#include "ahd/EventLoop.hpp"
+#include "ahd/HttpDownload.hpp"
+#include "ahd/LatencyTracker.hpp"
+#include "ahd/Transport.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <nghttp2/nghttp2.h>
+
+// HTTP/2 connection (RFC 9113) driven by the `EventLoop`. Downloads of its
+// host are sent as concurrent streams, up to the lower of the configured
+// limit and the server's SETTINGS_MAX_CONCURRENT_STREAMS, and their
+// responses arrive interleaved over the one connection. Frames are handled
+// by nghttp2, every response is handed to its download's parser as the
+// equivalent HTTP/1.1 message.
+//
+// Every stream is watched with the first byte and idle timeouts of its
+// download and reset on its own when it misses one or its hedge has won.
+// Bandwidth is acquired for the connection as a whole, the data of its
+// streams can't be told apart before it's read
+class Http2Connection : public EventHandler,
+                        public std::enable_shared_from_this<Http2Connection>
+{
+public:
+    Http2Connection(ConnectionPool &connectionPool, EventLoop &eventLoop,
+                    std::string host, ConcurrencyLimiter &limiter,
+                    LatencyTracker &firstByteLatency,
+                    const Http2Settings &settings);
+    ~Http2Connection();
+
+    Http2Connection(const Http2Connection &) = delete;
+    Http2Connection &operator=(const Http2Connection &) = delete;
+
+    void Start(ConnectionPool::Downloads downloads);
+    // NOTE: Downloads were queued for the host, may be called on any thread
+    void Wake(void);
+
+    virtual bool OnEvents(uint32_t events) override;
+    virtual void OnRemoved(void) override;
+    virtual bool OnTimer(void) override;
+
+private:
+    enum class State
+    {
+        Connecting,
+        // NOTE: TLS handshake is in progress, the server may not choose h2
+        Negotiating,
+        Open,
+        Closed,
+    };
+
+    using Clock = EventLoop::Clock;
+
+    struct Stream
+    {
+        std::shared_ptr<HttpDownload> download;
+        // NOTE: Status line and fields of the header section being received
+        std::string header;
+        bool headerComplete = false;
+        bool complete = false;
+        // NOTE: RST_STREAM is submitted, frames still in flight are dropped
+        bool reset = false;
+        // NOTE: Request can be sent again if nothing of the response was used
+        bool retryable = false;
+        std::exception_ptr error;
+        Clock::time_point lastActivity;
+    };
+
+    void Connect(const http::Uri &uri, std::chrono::milliseconds timeout);
+    void Register(void);
+    void Open(void);
+    void TakeMore(void);
+    void Submit(ConnectionPool::Downloads downloads);
+    void Send(void);
+    void Receive(void);
+    void ResetStream(int32_t streamId, Stream &stream,
+                     std::exception_ptr error);
+    void ResetCancelled(void);
+    void ReportCongestion(std::exception_ptr error);
+
+    // NOTE: Deadline of the stream's first byte or its next data
+    Clock::time_point GetDeadline(const Stream &stream) const;
+    void ArmTimer(void);
+    void CheckDeadlines(Clock::time_point now);
+    void StartHedges(Clock::time_point now);
+    std::function<void(void)> MakeCancelHandler(void);
+
+    void Close(std::exception_ptr error);
+    void Fail(std::exception_ptr error);
+    void Finalize(void);
+    void FlushRetries(void);
+    void DeliverCompletions(void);
+
+    // NOTE: nghttp2 callbacks, exceptions must not leave them
+    static int OnBeginHeaders(nghttp2_session *session,
+                              const nghttp2_frame *frame, void *userData);
+    static int OnHeader(nghttp2_session *session, const nghttp2_frame *frame,
+                        const uint8_t *name, std::size_t nameSize,
+                        const uint8_t *value, std::size_t valueSize,
+                        uint8_t flags, void *userData);
+    static int OnFrameReceived(nghttp2_session *session,
+                               const nghttp2_frame *frame, void *userData);
+    static int OnDataReceived(nghttp2_session *session, uint8_t flags,
+                              int32_t streamId, const uint8_t *data,
+                              std::size_t size, void *userData);
+    static int OnStreamClosed(nghttp2_session *session, int32_t streamId,
+                              uint32_t errorCode, void *userData);
+
+    ConnectionPool &m_ConnectionPool;
+    EventLoop &m_EventLoop;
+    const std::string m_Host;
+    ConcurrencyLimiter &m_Limiter;
+    LatencyTracker &m_FirstByteLatency;
+    const Http2Settings m_Settings;
+
+    State m_State;
+    std::unique_ptr<TransportStream> m_Stream;
+    nghttp2_session *m_Session;
+    bool m_Secure;
+    bool m_Downgraded;
+    bool m_GoingAway;
+    bool m_Detached;
+    std::atomic<bool> m_Woken;
+
+    // NOTE: Downloads waiting for the connection to open
+    ConnectionPool::Downloads m_Pending;
+    // NOTE: Ordered by stream ID, which is the order of the requests
+    std::map<int32_t, Stream> m_Streams;
+    std::vector<uint8_t> m_SendBuffer;
+    std::size_t m_SentSize;
+    BandwidthScheduler::Flow m_Flow;
+
+    Clock::time_point m_LastActivity;
+    Clock::time_point m_IdleSince;
+    Clock::time_point m_RetryAt;
+    Clock::time_point m_TimerAt;
+
+    ConnectionPool::Downloads m_Retry;
+    std::vector<std::pair<std::shared_ptr<HttpDownload>, std::exception_ptr>>
+        m_Finished;
+
+    // NOTE: Frames are gathered up to this size before they're sent, so a
+    // burst of requests goes out with one system call
+    inline static constexpr std::size_t s_SendBatchSize = 64 * 1024;
+    // NOTE: Connection without streams is closed after the same time as an
+    // idle HTTP/1.1 connection in the pool would be dropped
+    inline static constexpr std::chrono::seconds s_IdleTimeout{15};
+
+    inline static const char *s_Protocol = "h2";
+};
+
+#endif // AHD_WITH_NGHTTP2
+
+#endif // HTTP2CONNECTION_HPP_
@@ -0,0 +1,107 @@
+#ifndef HTTPCONNECTION_HPP_
+#define HTTPCONNECTION_HPP_
+
+#include "ahd/ConnectionPool.hpp"
+#include "ahd/EventLoop.hpp"
+#include "ahd/HttpDownload.hpp"
+#include "ahd/Transport.hpp"
+#include <HTTPRequest.hpp>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// HTTP/1.1 connection driven by the `EventLoop`. Requests of its downloads
+// are written back to back and the responses are handed to the downloads in
+// the same order (RFC 7230, 6.3.2. Pipelining). Once the first response
+// shows that the connection is persistent it keeps taking queued downloads
+// of its host, up to the pipeline depth in flight.
+//
+// Response at the front is watched with the first byte and idle timeouts of
+// its download, requests late for their first byte are hedged
+class HttpConnection : public EventHandler,
+                       public std::enable_shared_from_this<HttpConnection>
+{
+public:
+    // NOTE: `stream` is an idle connection from the pool, an open one
+    // which has fallen back from HTTP/2 or `nullptr` for a new one
+    HttpConnection(ConnectionPool &connectionPool, EventLoop &eventLoop,
+                   std::string host, std::unique_ptr<TransportStream> stream);
+
+    void Start(ConnectionPool::Downloads downloads);
+
+    virtual bool OnEvents(uint32_t events) override;
+    virtual void OnRemoved(void) override;
+    virtual bool OnTimer(void) override;
+
+private:
+    enum class State
+    {
+        Connecting,
+        Open,
+        Closed,
+    };
+
+    using Clock = EventLoop::Clock;
+
+    void Connect(const http::Uri &uri, std::chrono::milliseconds timeout);
+    void Register(void);
+    void Enqueue(ConnectionPool::Downloads downloads);
+    void TakeMore(void);
+    void Send(void);
+    void OnRequestsSent(void);
+    void Receive(void);
+    std::size_t Splice(const std::shared_ptr<HttpDownload> &download,
+                       std::size_t size);
+    void Feed(const uint8_t *data, std::size_t size);
+    // NOTE: Returns `false` if the response belongs to a cancelled hedge
+    bool StartResponse(const std::shared_ptr<HttpDownload> &download);
+    bool OnResponseComplete(const std::shared_ptr<HttpDownload> &download,
+                            bool moreData);
+    void ReportCongestion(std::exception_ptr error);
+
+    // NOTE: Deadline of the front response. Timer is armed for the earliest
+    // of the deadline, hedges and bandwidth, but only moved earlier: reads
+    // push the deadline further away far more often than it ever expires
+    Clock::time_point GetDeadline(void) const;
+    void ArmTimer(void);
+    void StartHedges(Clock::time_point now);
+    std::function<void(void)> MakeCancelHandler(void);
+    bool IsFrontCancelled(void) const;
+
+    void Close(std::exception_ptr error);
+    void Fail(std::exception_ptr error);
+    void Finalize(void);
+    void DeliverCompletions(void);
+
+    ConnectionPool &m_ConnectionPool;
+    EventLoop &m_EventLoop;
+    const std::string m_Host;
+    ConcurrencyLimiter &m_Limiter;
+    LatencyTracker &m_FirstByteLatency;
+
+    State m_State;
+    std::unique_ptr<TransportStream> m_Stream;
+    bool m_Persistent;
+    bool m_KeepAlive;
+
+    ConnectionPool::Downloads m_InFlight;
+    // NOTE: Number of downloads at the front of `m_InFlight` whose requests
+    // are sent completely
+    std::size_t m_SentCount;
+    std::vector<uint8_t> m_SendBuffer;
+    std::size_t m_SentSize;
+
+    Clock::time_point m_LastActivity;
+    Clock::time_point m_RetryAt;
+    Clock::time_point m_TimerAt;
+
+    ConnectionPool::Downloads m_Retry;
+    std::vector<std::pair<std::shared_ptr<HttpDownload>, std::exception_ptr>>
+        m_Finished;
+};
+
+#endif // HTTPCONNECTION_HPP_
@@ -0,0 +1,166 @@
+#ifndef HTTPDOWNLOAD_HPP_
+#define HTTPDOWNLOAD_HPP_
+
+#include "ahd/BandwidthScheduler.hpp"
+#include "ahd/DownloadOptions.hpp"
+#include <HTTPRequest.hpp>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ConnectionPool;
+
+// Single GET request. It's queued in the `ConnectionPool` and sent by the
+// `HttpConnection` it's assigned to, possibly pipelined with other requests
+// to the same host, or as a stream of the host's `Http2Connection`. The
+// download itself only parses its own response.
+//
+// Download can be hedged: its request is sent once more over another
+// connection and the first of the two to receive a response wins. Only the
+// winner reaches the handlers, the other one is cancelled
+class HttpDownload : public std::enable_shared_from_this<HttpDownload>
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using CompletionHandler = std::function<void(std::exception_ptr error)>;
+
+    // NOTE: File the body is written to, it lets the connection move the body
+    // from the socket straight into the file. `getOffset` returns the offset
+    // of the next byte and `onWritten` accounts for bytes written there, the
+    // body sink must write to the same place
+    struct FileSink
+    {
+        int descriptor = -1;
+        std::function<uint64_t(void)> getOffset;
+        std::function<void(std::size_t size)> onWritten;
+    };
+
+    HttpDownload(const std::string &requestUrl, http::BodySink bodySink,
+                 CompletionHandler onComplete);
+    HttpDownload(const std::string &requestUrl,
+                 http::HeaderFields headerFields,
+                 http::HeaderHandler headerHandler, http::BodySink bodySink,
+                 CompletionHandler onComplete);
+
+    void SetFileSink(FileSink fileSink);
+    // NOTE: Share of the bandwidth relative to other downloads, matters
+    // only when the bandwidth is limited
+    void SetWeight(double weight);
+    void SetTimeouts(const Timeouts &timeouts);
+    // NOTE: Percentile of the host's first byte latency after which the
+    // request is hedged, zero disables hedging
+    void SetHedgePercentile(double percentile);
+
+    // NOTE: Throws if the request can't be started, otherwise the outcome
+    // is reported only through the completion handler
+    void Start(ConnectionPool &connectionPool);
+
+    const http::Uri &GetUri(void) const;
+    const std::string &GetPoolKey(void) const;
+    const std::vector<uint8_t> &GetRequestData(void) const;
+    // NOTE: Fields given to the request, without the ones every request
+    // gets when it's encoded
+    const http::HeaderFields &GetHeaderFields(void) const;
+    BandwidthScheduler::Flow &GetFlow(void);
+    const Timeouts &GetTimeouts(void) const;
+
+    // NOTE: Zero if the download can't be hedged (anymore)
+    double GetHedgePercentile(void) const;
+    // NOTE: `hedgeTime` is when the request should be hedged if its
+    // response hasn't started by then
+    void OnRequestSent(Clock::time_point time, Clock::time_point hedgeTime);
+    Clock::time_point GetRequestTime(void) const;
+    Clock::time_point GetHedgeTime(void) const;
+    // NOTE: Returns the duplicate to submit. `onCancelled` is called on any
+    // thread if the duplicate wins while this download is still in flight
+    std::shared_ptr<HttpDownload> Hedge(
+        std::function<void(void)> onCancelled);
+    // NOTE: Connection which takes over a hedged download must replace the
+    // handler of the previous one
+    void SetCancelHandler(std::function<void(void)> onCancelled);
+    bool IsCancelled(void) const;
+
+    // NOTE: Must be called on the first byte of the response, returns
+    // `false` if the other request of the hedge has already won
+    bool StartResponse(void);
+    bool IsResponseStarted(void) const;
+
+    // NOTE: Returns `true` once the whole response is parsed
+    bool Parse(const uint8_t *data, std::size_t size);
+    // NOTE: Throws if the response can't end with the connection
+    void OnConnectionClosed(void);
+    bool IsKeepAlive(void) const;
+    int GetStatusCode(void) const;
+    // NOTE: Part of the data given to the last `Parse` which belongs to
+    // this response
+    std::size_t GetParsedSize(void) const;
+
+    // NOTE: Rest of a successful response's body, whose length is known, can
+    // be spliced into the file sink, but no more than the returned size
+    std::size_t GetSpliceSize(void) const;
+    const FileSink &GetFileSink(void) const;
+    // NOTE: Returns `true` once the whole response is received
+    bool OnSpliced(std::size_t size);
+    void DisableSplice(void);
+
+    // NOTE: Request is safe to send again only if nothing of its response
+    // has arrived, the number of attempts is limited
+    bool PrepareRetry(void);
+
+    void Finish(std::exception_ptr error);
+
+private:
+    // NOTE: Shared by a download and its duplicate, members are indexed by
+    // `m_HedgeIndex`
+    struct HedgeState
+    {
+        std::mutex mutex;
+        int winner = -1;
+        std::size_t pending = 2;
+        CompletionHandler onComplete;
+        std::function<void(void)> onCancelled[2];
+    };
+
+    // NOTE: Duplicate of `original`
+    HttpDownload(const HttpDownload &original,
+                 std::shared_ptr<HedgeState> hedge);
+
+    const http::Uri m_Uri;
+    const std::string m_PoolKey;
+    const http::HeaderFields m_HeaderFields;
+    const std::vector<uint8_t> m_RequestData;
+    // NOTE: Kept for the duplicate, the parser has its own copies
+    const http::HeaderHandler m_HeaderHandler;
+    const http::BodySink m_BodySink;
+    http::Response m_Response;
+    http::ResponseParser m_Parser;
+    CompletionHandler m_OnComplete;
+    FileSink m_FileSink;
+    BandwidthScheduler::Flow m_Flow;
+    double m_Weight;
+    Timeouts m_Timeouts;
+
+    double m_HedgePercentile;
+    std::shared_ptr<HedgeState> m_Hedge;
+    int m_HedgeIndex;
+    Clock::time_point m_RequestTime;
+    Clock::time_point m_HedgeTime;
+    bool m_SpliceEnabled;
+    bool m_Spliced;
+
+    bool m_ResponseStarted;
+    std::size_t m_Retries;
+
+    inline static constexpr std::size_t s_MaxRetries = 3;
+
+    // NOTE: Small bodies aren't worth the extra system calls
+    inline static constexpr std::size_t s_MinSpliceSize = 64 * 1024;
+
+    static const char *GET_REQUEST;
+};
+
+#endif // HTTPDOWNLOAD_HPP_
@@ -0,0 +1,38 @@
+#ifndef LATENCYTRACKER_HPP_
+#define LATENCYTRACKER_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// Latencies of the most recent requests to one host, so a slow request can
+// be told from the usual ones
+class LatencyTracker
+{
+public:
+    using Duration = std::chrono::steady_clock::duration;
+
+    LatencyTracker(void);
+
+    LatencyTracker(const LatencyTracker &) = delete;
+    LatencyTracker &operator=(const LatencyTracker &) = delete;
+
+    void Add(Duration latency);
+
+    // NOTE: `percentile` is between 0 and 100. Returns nothing until there
+    // are enough samples to tell
+    std::optional<Duration> GetPercentile(double percentile) const;
+
+private:
+    mutable std::mutex m_Mutex;
+    std::vector<Duration> m_Samples;
+    // NOTE: Samples are a ring buffer once it's full
+    std::size_t m_Next;
+
+    inline static constexpr std::size_t s_MaxSamples = 256;
+    inline static constexpr std::size_t s_MinSamples = 16;
+};
+
+#endif // LATENCYTRACKER_HPP_
@@ -0,0 +1,39 @@
+#ifndef LOOPBACKTRANSPORT_HPP_
+#define LOOPBACKTRANSPORT_HPP_
+
+#include "ahd/Transport.hpp"
+#include <cstdint>
+#include <string>
+
+// Transport which never leaves the process: every stream is served by an
+// in-memory HTTP/1.1 server answering GET requests with synthetic bodies.
+// It takes the network and the real server out of the measurement, so the
+// overhead of the parser, the connection pool and the task scheduling can be
+// seen on its own.
+//
+// Size and rate of a response are taken from the query of its request
+// target, `size=<bytes>` and `rate=<bytes/s>`, and default to the options
+// given at creation, `size=<bytes>,rate=<bytes/s>`. Both accept `k`, `m` and
+// `g` suffixes, zero rate means unlimited. Body is the same for the same
+// size, `Range`, `If-Range` and `If-None-Match` work against its entity tag
+class LoopbackTransport : public Transport
+{
+public:
+    // NOTE: Throws for malformed options
+    explicit LoopbackTransport(const std::string &options);
+
+    virtual void Connect(const http::Uri &uri,
+                         std::chrono::milliseconds timeout,
+                         ConnectHandler handler) override;
+
+    // NOTE: Parses `<number>[k|m|g]`, returns `false` if it's malformed
+    static bool ParseSize(const std::string &value, uint64_t &size);
+
+    inline static constexpr uint64_t s_DefaultSize = 1024 * 1024;
+
+private:
+    uint64_t m_Size;
+    uint64_t m_Rate;
+};
+
+#endif // LOOPBACKTRANSPORT_HPP_
@@ -0,0 +1,60 @@
+#ifndef PARTIALFILE_HPP_
+#define PARTIALFILE_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+// Download in progress is written to `<output>.part` and described by the
+// `<output>.part.state` sidecar, so a later run can continue it with a Range
+// request instead of starting over
+class PartialFile
+{
+public:
+    struct State
+    {
+        std::string url;
+        uint64_t size = 0;
+        std::string entityTag;
+        std::string lastModified;
+    };
+
+    explicit PartialFile(const std::filesystem::path &outputPath);
+
+    const std::filesystem::path &GetPath(void) const;
+
+    // NOTE: Returns state only if it belongs to `url`, has a validator to
+    // resume with and its size doesn't exceed the data actually on disk
+    std::optional<State> Load(const std::string &url) const;
+    void Save(const State &state) const;
+    // NOTE: Removes the partial file and its state
+    void Discard(void) const;
+
+    // NOTE: Moves the finished file to the output path
+    void Commit(void) const;
+
+    // RFC 7233, 3.2. If-Range, weak entity tags can't be used
+    static std::string GetValidator(const State &state);
+
+    // NOTE: `<field>: <value>` lines, the same format is used by
+    // `FileMetadata`
+    static std::optional<State> ReadState(const std::filesystem::path &path);
+    static void WriteState(const std::filesystem::path &path,
+                           const State &state);
+
+private:
+    const std::filesystem::path m_OutputPath;
+    const std::filesystem::path m_PartPath;
+    const std::filesystem::path m_StatePath;
+
+    inline static const char *s_PartExtension = ".part";
+    inline static const char *s_StateExtension = ".part.state";
+
+    inline static const char *s_UrlField = "url";
+    inline static const char *s_SizeField = "size";
+    inline static const char *s_EntityTagField = "etag";
+    inline static const char *s_LastModifiedField = "last-modified";
+};
+
+#endif // PARTIALFILE_HPP_
@@ -0,0 +1,101 @@
+#ifndef RESOLVER_HPP_
+#define RESOLVER_HPP_
+
+#include "ahd/EventLoop.hpp"
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+
+struct SocketAddress
+{
+    sockaddr_storage storage;
+    socklen_t size;
+};
+
+// Non-blocking stub resolver with a process-wide cache. Names are looked up
+// in /etc/hosts and then queried over UDP from the servers listed in
+// /etc/resolv.conf, answers are cached for their TTL and concurrent lookups
+// of the same name share one query. `getaddrinfo` on a helper thread is
+// used only when the servers don't give a usable answer
+class Resolver
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // NOTE: Addresses are ordered IPv4 first and carry the requested port
+    using ResolveHandler = std::function<void(
+        std::exception_ptr error, const std::vector<SocketAddress> &addresses)>;
+
+    explicit Resolver(EventLoop &eventLoop);
+
+    Resolver(const Resolver &) = delete;
+    Resolver &operator=(const Resolver &) = delete;
+
+    // NOTE: Handler is called either right away or later on an event loop
+    // thread, never under the resolver's lock
+    void Resolve(const std::string &host, uint16_t port,
+                 ResolveHandler handler);
+
+    static Resolver &Get(void);
+
+private:
+    friend class DnsQuery;
+
+    struct Waiter
+    {
+        uint16_t port;
+        ResolveHandler handler;
+    };
+
+    struct CacheEntry
+    {
+        std::vector<SocketAddress> addresses;
+        Clock::time_point expiry;
+        bool pending = false;
+        std::vector<Waiter> waiters;
+    };
+
+    void ReadHosts(const char *path);
+    void ReadResolvConf(const char *path);
+    std::vector<std::string> GetQueryNames(const std::string &host) const;
+
+    void Lookup(const std::string &host);
+    void LookupWithGetAddrInfo(const std::string &host);
+    void Complete(const std::string &host, std::exception_ptr error,
+                  std::vector<SocketAddress> addresses,
+                  std::chrono::seconds ttl);
+
+    static bool ParseAddress(const std::string &text,
+                             SocketAddress &address);
+    static std::vector<SocketAddress> WithPort(
+        const std::vector<SocketAddress> &addresses, uint16_t port);
+
+    EventLoop &m_EventLoop;
+
+    std::unordered_map<std::string, std::vector<SocketAddress>> m_Hosts;
+    std::vector<SocketAddress> m_NameServers;
+    std::vector<std::string> m_SearchDomains;
+    std::size_t m_Dots;
+    std::chrono::seconds m_Timeout;
+    std::size_t m_Attempts;
+
+    std::mutex m_Mutex;
+    std::unordered_map<std::string, CacheEntry> m_Cache;
+
+    inline static constexpr uint16_t s_NameServerPort = 53;
+    inline static constexpr std::size_t s_MaxNameServers = 3;
+    inline static constexpr std::chrono::seconds s_MinTtl{1};
+    inline static constexpr std::chrono::seconds s_MaxTtl{3600};
+
+    // NOTE: `getaddrinfo` doesn't report TTLs
+    inline static constexpr std::chrono::seconds s_GetAddrInfoTtl{60};
+};
+
+#endif // RESOLVER_HPP_
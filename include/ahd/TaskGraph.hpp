@@ -0,0 +1,55 @@
+#ifndef TASKGRAPH_HPP_
+#define TASKGRAPH_HPP_
+
+#include "ahd/Task.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Dependency graph of the tasks. Tasks are numbered densely, every one
+// counts its dependencies which haven't completed and lists the tasks which
+// depend on it, so a task becomes ready when the last of its dependencies
+// completes and nothing has to poll for it
+class TaskGraph
+{
+public:
+    using Id = uint32_t;
+
+    // NOTE: Throws for a dependency which isn't in the map or which is part
+    // of a cycle
+    explicit TaskGraph(const TaskMap &taskMap);
+
+    TaskGraph(const TaskGraph &) = delete;
+    TaskGraph &operator=(const TaskGraph &) = delete;
+
+    std::size_t GetSize(void) const;
+    const std::string &GetName(Id id) const;
+    const Task &GetTask(Id id) const;
+
+    // NOTE: Tasks without dependencies, the ones to start with
+    const std::vector<Id> &GetRoots(void) const;
+
+    // NOTE: Task has completed, tasks which were waiting only for it are
+    // appended to `ready`. May be called on any thread, once per task
+    void Complete(Id id, std::vector<Id> &ready);
+
+private:
+    void ValidateAcyclic(void) const;
+
+    std::vector<std::string> m_Names;
+    std::vector<std::shared_ptr<Task>> m_Tasks;
+    std::vector<Id> m_Roots;
+
+    // NOTE: Successors of task `i` are `m_Successors[m_SuccessorOffsets[i]]`
+    // up to the offset of `i + 1`, one array for the whole graph keeps them
+    // together in memory however large it grows
+    std::vector<std::size_t> m_SuccessorOffsets;
+    std::vector<Id> m_Successors;
+
+    std::unique_ptr<std::atomic<uint32_t>[]> m_PendingDependencies;
+};
+
+#endif // TASKGRAPH_HPP_
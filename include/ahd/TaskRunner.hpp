@@ -3,20 +3,72 @@
 
 #include "ahd/Action.hpp"
 #include "ahd/Task.hpp"
-#include <future>
-#include <unordered_map>
+#include "ahd/TaskGraph.hpp"
+#include "ahd/ThreadPool.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <vector>
 
+// Runs the actions of every task once its dependencies are complete. Every
+// action runs on the `ThreadPool` of its resource class: downloads on a
+// large I/O pool, since they mostly wait for the network, and extraction
+// on a CPU pool of one worker per core. Task moves between the pools as
+// its actions do, the ones which aren't ready cost nothing until the last
+// of their dependencies completes
 class TaskRunner
 {
 public:
-    TaskRunner(
-        std::unordered_map<std::string, std::shared_ptr<Task>> &fileTasks);
+    // NOTE: Throws for dependencies which can't be satisfied
+    TaskRunner(const TaskMap &fileTasks, std::size_t ioWorkerCount,
+               std::size_t cpuWorkerCount);
 
+    // NOTE: Rethrows the first error of an action, tasks which haven't
+    // started by then are skipped
     void Run();
 
+    // NOTE: Prints queue depth and utilization of both pools while tasks
+    // run and once they're done
+    static void SetStatsLogging(bool logging);
+
+    // NOTE: Download holds its worker until it's done, the connection pool
+    // limits how many of them go to one host at a time
+    inline static constexpr std::size_t s_DefaultIoWorkerCount = 64;
+
 private:
-    std::unordered_map<std::string, std::shared_ptr<Task>> m_FileTasks;
-    std::unordered_map<std::string, bool> m_FileTaskStatuses;
+    // NOTE: Runs the task's actions of the pool's class from the next one
+    // on, then hands the task over to the other pool or completes it
+    void Execute(ResourceClass resourceClass, TaskGraph::Id id);
+    // NOTE: Submits the task to the pool of its next action
+    void Schedule(TaskGraph::Id id);
+    ThreadPool &GetPool(ResourceClass resourceClass);
+
+    void LogStats(void) const;
+
+    TaskGraph m_Graph;
+    const std::size_t m_IoWorkerCount;
+    const std::size_t m_CpuWorkerCount;
+    ThreadPool *m_IoPool;
+    ThreadPool *m_CpuPool;
+
+    // NOTE: Index of every task's next action, touched only by the thread
+    // running the task
+    std::vector<std::size_t> m_NextActions;
+
+    // NOTE: Tasks submitted to the pools which haven't finished yet, none
+    // are left once every task has completed or the first one has failed
+    std::atomic<std::size_t> m_Outstanding;
+    std::atomic<bool> m_Failed;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Finished;
+    std::exception_ptr m_Error;
+
+    inline static std::atomic<bool> s_StatsLogging = false;
+    inline static constexpr std::chrono::seconds s_StatsInterval{1};
 };
 
 #endif // FILETASKRUNNER_HPP_
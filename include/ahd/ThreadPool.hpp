@@ -0,0 +1,144 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Deque of jobs owned by one thread (Chase and Lev). The owner pushes and
+// pops at the bottom, other threads steal from the top, none of them locks.
+// Buffer doubles when it's full, the old ones are kept until destruction
+// since a thief may still be reading them
+class WorkStealingDeque
+{
+public:
+    using Job = uint32_t;
+
+    WorkStealingDeque(void);
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    // NOTE: Owner only
+    void Push(Job job);
+    bool Pop(Job &job);
+
+    // NOTE: Any thread, fails when empty or when another thread has taken
+    // the same job first
+    bool Steal(Job &job);
+
+private:
+    struct Buffer
+    {
+        explicit Buffer(std::size_t capacity);
+
+        const std::size_t mask;
+        std::unique_ptr<std::atomic<Job>[]> slots;
+    };
+
+    Buffer *Grow(Buffer *buffer, int64_t top, int64_t bottom);
+
+    // NOTE: Owner and thieves change different ends, they're kept on
+    // separate cache lines
+    alignas(64) std::atomic<int64_t> m_Top;
+    alignas(64) std::atomic<int64_t> m_Bottom;
+    std::atomic<Buffer *> m_Buffer;
+    std::vector<std::unique_ptr<Buffer>> m_Buffers;
+
+    inline static constexpr std::size_t s_InitialCapacity = 256;
+};
+
+// Fixed set of threads running jobs by passing them to the handler. Jobs
+// submitted by a worker go to its own deque and the last one is run next,
+// so a task and the ones it makes ready run on the same thread while their
+// data is still in its cache. Worker with nothing to do steals from the
+// others or takes jobs submitted from outside the pool, and sleeps when
+// there are none
+class ThreadPool
+{
+public:
+    using Job = WorkStealingDeque::Job;
+    // NOTE: Handler must not throw
+    using Handler = std::function<void(Job job)>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats
+    {
+        std::size_t size = 0;
+        // NOTE: Jobs waiting for a worker, now and at most so far
+        std::size_t queued = 0;
+        std::size_t peakQueued = 0;
+        // NOTE: Workers running a job right now
+        std::size_t busy = 0;
+        uint64_t completed = 0;
+        // NOTE: Share of the workers' time spent on finished jobs since the
+        // pool was started, between 0 and 1
+        double utilization = 0.0;
+    };
+
+    ThreadPool(std::size_t size, Handler handler);
+    // NOTE: Waits for the running jobs, the queued ones are dropped
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // NOTE: May be called on any thread
+    void Submit(Job job);
+
+    std::size_t GetSize(void) const;
+    // NOTE: May be called on any thread while jobs run
+    Stats GetStats(void) const;
+
+    // NOTE: Number of hardware threads, at least one
+    static std::size_t GetDefaultSize(void);
+
+private:
+    struct Worker
+    {
+        WorkStealingDeque deque;
+        std::thread thread;
+        // NOTE: State of the generator picking the workers to steal from
+        uint32_t seed = 0;
+    };
+
+    void Run(std::size_t index);
+    bool TryTake(std::size_t index, Job &job);
+    bool TrySteal(std::size_t index, Job &job);
+
+    const Handler m_Handler;
+    std::vector<std::unique_ptr<Worker>> m_Workers;
+
+    // NOTE: Jobs submitted from outside the pool
+    std::mutex m_InjectedMutex;
+    std::deque<Job> m_Injected;
+    std::atomic<std::size_t> m_InjectedCount;
+
+    // NOTE: Jobs queued anywhere in the pool. It's counted before the job
+    // is queued, so a worker which sees zero may sleep
+    std::atomic<std::size_t> m_Queued;
+    std::atomic<std::size_t> m_Sleeping;
+    std::mutex m_Mutex;
+    std::condition_variable m_WorkAvailable;
+    bool m_Stopping;
+
+    const Clock::time_point m_Started;
+    std::atomic<std::size_t> m_PeakQueued;
+    std::atomic<std::size_t> m_Busy;
+    std::atomic<uint64_t> m_Completed;
+    std::atomic<Clock::rep> m_BusyTime;
+
+    // NOTE: Pool and index of the worker running on this thread
+    inline static thread_local ThreadPool *s_CurrentPool = nullptr;
+    inline static thread_local std::size_t s_CurrentIndex = 0;
+};
+
+#endif // THREADPOOL_HPP_
@@ -0,0 +1,66 @@
+#ifndef TLSCONTEXT_HPP_
+#define TLSCONTEXT_HPP_
+
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+// Client side of TLS shared by every HTTPS connection. Peers are verified
+// against the system's trusted certificates, or the given CA file, and their
+// host name.
+//
+// Sessions and tickets received from a host are cached under its key, so
+// the following connections resume them with an abbreviated handshake
+// (RFC 8446, 2.2. Resumption and Pre-Shared Key) instead of paying for the
+// certificate exchange again
+class TlsContext
+{
+public:
+    ~TlsContext();
+
+    TlsContext(const TlsContext &) = delete;
+    TlsContext &operator=(const TlsContext &) = delete;
+
+    // NOTE: Connection to `host` which resumes a cached session of
+    // `sessionKey` if there is one. Sessions it receives are cached under
+    // the key, which must outlive the connection
+    SSL *CreateConnection(const std::string &host,
+                          const std::string &sessionKey);
+
+    // NOTE: Throws if the file can't be loaded
+    void SetCaFile(const std::filesystem::path &path);
+
+    // NOTE: Application protocols offered to servers in the order of
+    // preference (RFC 7301), none by default. Must be set before the first
+    // connection is created
+    void SetProtocols(const std::vector<std::string> &protocols);
+
+    // NOTE: Reason of the earliest error queued by OpenSSL on this thread,
+    // the queue is cleared
+    static std::string TakeError(void);
+
+    static TlsContext &Get(void);
+
+private:
+    TlsContext(void);
+
+    static int OnNewSession(SSL *ssl, SSL_SESSION *session);
+
+    SSL_CTX *m_Context;
+
+    std::mutex m_Mutex;
+    std::unordered_map<std::string, std::deque<SSL_SESSION *>> m_Sessions;
+
+    // NOTE: TLS 1.3 tickets are meant to be used once, servers usually send
+    // two per connection. The last one is reused rather than falling back
+    // to a full handshake
+    inline static constexpr std::size_t s_MaxSessionsPerHost = 8;
+};
+
+#endif // TLSCONTEXT_HPP_
@@ -0,0 +1,86 @@
+#ifndef TRANSPORT_HPP_
+#define TRANSPORT_HPP_
+
+#include <HTTPRequest.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Byte stream of one connection. Streams never block, the `EventLoop`
+// watches their descriptor, which is reported (edge-triggered) whenever the
+// stream may be able to make progress. Stream is closed on destruction
+class TransportStream
+{
+public:
+    virtual ~TransportStream(void) {}
+
+    virtual int GetDescriptor(void) const = 0;
+
+    // NOTE: Both return `s_WouldBlock` when nothing can be done until the
+    // descriptor is reported again. Receiving zero bytes means the peer
+    // has closed the stream
+    virtual std::size_t TrySend(const uint8_t *data, std::size_t size) = 0;
+    virtual std::size_t TryReceive(uint8_t *data, std::size_t size) = 0;
+
+    // NOTE: Idle stream must have nothing to receive, data or the end of
+    // the stream mean it can't be reused
+    virtual bool IsAlive(void) const = 0;
+
+    // NOTE: Data can be moved from the descriptor with `splice`
+    virtual bool CanSplice(void) const
+    {
+        return false;
+    }
+
+    // NOTE: Drives the handshake of a secure stream, returns `false` while
+    // it waits for the descriptor. Sends and receives drive it as well
+    virtual bool Handshake(void)
+    {
+        return true;
+    }
+
+    // NOTE: Application protocol the peer has agreed on during the
+    // handshake (RFC 7301), empty if there was none
+    virtual std::string GetProtocol(void) const
+    {
+        return std::string();
+    }
+
+    inline static constexpr std::size_t s_WouldBlock =
+        http::Socket::wouldBlock;
+};
+
+// Opens streams to hosts. Everything above it, from the connection pool to
+// the response parser, is the same whichever transport is used, so
+// transports can be compared under the same workload
+class Transport
+{
+public:
+    using ConnectHandler = std::function<void(
+        std::exception_ptr error, std::unique_ptr<TransportStream> stream)>;
+
+    virtual ~Transport(void) {}
+
+    // NOTE: Handler gets an open stream or the error. It's called on an
+    // event loop thread or right away, `timeout` of zero means none
+    virtual void Connect(const http::Uri &uri,
+                         std::chrono::milliseconds timeout,
+                         ConnectHandler handler) = 0;
+
+    // NOTE: `specification` is the transport's name optionally followed by
+    // `:` and its options. Throws for transports which aren't supported or
+    // malformed options
+    static std::unique_ptr<Transport> Create(
+        const std::string &specification);
+    // NOTE: Names of the supported transports, separated by commas
+    static const char *GetTransports(void);
+
+    inline static const char *s_Tcp = "tcp";
+    inline static const char *s_Loopback = "loopback";
+};
+
+#endif // TRANSPORT_HPP_
@@ -13,6 +13,7 @@ public:
                  const std::filesystem::path &destanationPath);
 
     virtual void Execute(void) const override;
+    virtual ResourceClass GetResourceClass(void) const override;
 
 private:
     const std::filesystem::path m_ArchivePath;
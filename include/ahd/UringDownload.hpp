@@ -0,0 +1,86 @@
+#ifndef URINGDOWNLOAD_HPP_
+#define URINGDOWNLOAD_HPP_
+
+#ifdef AHD_WITH_IO_URING
+
+#include "ahd/ConcurrencyLimiter.hpp"
+#include "ahd/Resolver.hpp"
+#include "ahd/UringLoop.hpp"
+#include <HTTPRequest.hpp>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+// GET request into a file executed entirely through `UringLoop`: connect and
+// request are linked in one submission, the body is received with multishot
+// recv into provided buffers and written to the file with async writes
+class UringDownload : public std::enable_shared_from_this<UringDownload>
+{
+public:
+    using CompletionHandler = std::function<void(std::exception_ptr error)>;
+
+    // NOTE: Header handler may throw to reject the response, before any of
+    // its body reaches the file
+    UringDownload(const std::string &requestUrl, int outputDescriptor,
+                  http::HeaderHandler headerHandler,
+                  CompletionHandler onComplete);
+
+    // NOTE: Throws if the request can't be started, otherwise the outcome
+    // is reported only through the completion handler
+    void Start(UringLoop &uringLoop);
+
+private:
+    void OnHeader(const http::Response &response);
+    void Open(const SocketAddress &address);
+    void Connect(void);
+    void Send(std::size_t offset);
+    void Receive(void);
+    void OnReceived(int32_t result, uint32_t flags);
+    void StopReceiving(void);
+    void Stage(const uint8_t *data, std::size_t size);
+    void FlushStaging(void);
+    void Write(std::shared_ptr<std::vector<uint8_t>> block, std::size_t offset,
+               uint64_t fileOffset);
+    void Fail(std::exception_ptr error);
+    void TryFinish(void);
+
+    const http::Uri m_Uri;
+    const int m_OutputDescriptor;
+    http::Response m_Response;
+    const http::HeaderHandler m_HeaderHandler;
+    http::ResponseParser m_Parser;
+    CompletionHandler m_OnComplete;
+
+    UringLoop *m_UringLoop;
+    // NOTE: Limiter of the host in the connection pool, which gets to know
+    // about congestion seen by this backend too
+    ConcurrencyLimiter *m_Limiter;
+    std::unique_ptr<http::Socket> m_Socket;
+    sockaddr_storage m_Address;
+    socklen_t m_AddressSize;
+    std::vector<uint8_t> m_RequestData;
+
+    bool m_Receiving;
+    bool m_ReceiveCancelled;
+    bool m_ReceivePaused;
+    bool m_Done;
+    uint64_t m_ReceiveOperation;
+    std::exception_ptr m_Error;
+
+    std::vector<uint8_t> m_Staging;
+    uint64_t m_FileOffset;
+    std::size_t m_InFlightWrites;
+
+    inline static constexpr std::size_t s_WriteBlockSize = 256 * 1024;
+    inline static constexpr std::size_t s_MaxInFlightWrites = 8;
+
+    static const char *GET_REQUEST;
+};
+
+#endif // AHD_WITH_IO_URING
+
+#endif // URINGDOWNLOAD_HPP_
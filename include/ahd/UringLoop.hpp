@@ -0,0 +1,107 @@
+#ifndef URINGLOOP_HPP_
+#define URINGLOOP_HPP_
+
+#ifdef AHD_WITH_IO_URING
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <linux/io_uring.h>
+
+// Single thread driving one io_uring instance. Everything prepared on the
+// loop thread between two waits goes to the kernel in one `io_uring_enter`
+// call, and receives are served from a group of kernel provided buffers
+class UringLoop
+{
+public:
+    using Completion = std::function<void(int32_t result, uint32_t flags)>;
+
+    UringLoop(unsigned entries, uint16_t bufferCount, uint32_t bufferSize);
+    ~UringLoop();
+
+    UringLoop(const UringLoop &) = delete;
+    UringLoop &operator=(const UringLoop &) = delete;
+
+    // NOTE: Thread-safe, task is executed on the loop thread
+    void Post(std::function<void()> task);
+
+    // NOTE: Must be called on the loop thread. Returned entry is zeroed and
+    // has `user_data` set, which also identifies the operation for `Cancel`
+    io_uring_sqe &Prepare(Completion completion);
+    void Cancel(uint64_t operation);
+
+    uint16_t GetBufferGroup(void) const;
+    const uint8_t *GetBuffer(uint16_t id) const;
+    void RecycleBuffer(uint16_t id);
+
+    // Returns `nullptr` if kernel doesn't support io_uring or the operations
+    // it's used for
+    static UringLoop *Get(void);
+
+private:
+    // NOTE: Throws `std::system_error` if the kernel lacks an operation the
+    // downloads rely on
+    void Initialize(const io_uring_params &params, uint16_t bufferCount);
+    void CheckOperations(void);
+    void CheckMultishotReceive(void);
+    void Release(void);
+
+    void Work(void);
+    void ArmWakeUp(void);
+    void ProvideBuffers(uint16_t firstId, uint16_t count);
+    void SubmitAndWait(unsigned waitCount);
+    void ReapCompletions(void);
+    void RunPostedTasks(void);
+
+    int m_RingDescriptor;
+    int m_WakeDescriptor;
+    uint64_t m_WakeValue;
+
+    void *m_RingMemory;
+    std::size_t m_RingMemorySize;
+    void *m_CompletionRingMemory;
+    std::size_t m_CompletionRingMemorySize;
+    io_uring_sqe *m_Entries;
+    std::size_t m_EntriesSize;
+
+    unsigned *m_SubmissionHead;
+    unsigned *m_SubmissionTail;
+    unsigned *m_SubmissionArray;
+    unsigned m_SubmissionMask;
+    unsigned m_SubmissionEntries;
+    unsigned m_LocalTail;
+    unsigned m_SubmittedTail;
+
+    unsigned *m_CompletionHead;
+    unsigned *m_CompletionTail;
+    unsigned m_CompletionMask;
+    io_uring_cqe *m_Completions;
+
+    std::unique_ptr<uint8_t[]> m_Buffers;
+    uint32_t m_BufferSize;
+
+    uint64_t m_NextOperation;
+    std::unordered_map<uint64_t, std::unique_ptr<Completion>> m_Operations;
+
+    std::mutex m_PostedTasksMutex;
+    std::vector<std::function<void()>> m_PostedTasks;
+
+    std::atomic<bool> m_Running;
+    std::thread m_Thread;
+
+    inline static constexpr unsigned s_EntryCount = 1024;
+    inline static constexpr uint16_t s_BufferCount = 256;
+    inline static constexpr uint32_t s_BufferSize = 32 * 1024;
+    inline static constexpr uint16_t s_BufferGroup = 0;
+    inline static constexpr uint64_t s_UntrackedOperation = 0;
+};
+
+#endif // AHD_WITH_IO_URING
+
+#endif // URINGLOOP_HPP_
@@ -1,6 +1,7 @@
 #ifndef YAMLCONFIGREADER_HPP_
 #define YAMLCONFIGREADER_HPP_
 
+#include <chrono>
 #include <memory>
 
 #include <yaml-cpp/yaml.h>
@@ -13,10 +14,13 @@
 class YamlConfigReader : public ConfigReader
 {
 public:
+    using ConfigReader::ConfigReader;
+
     TaskMap Read(const std::filesystem::path &configPath) override;
 
 private:
     TaskMap MakeTaskMap(const std::string &host, const std::string &target,
+                        const DownloadOptions &downloadOptions,
                         const YAML::Node &filesYaml);
 
     const std::vector<const char *> FindMissingFields(
@@ -29,12 +33,29 @@ private:
     void ValidateConfigYaml(const YAML::Node &configYaml);
     void ValidateFileYaml(uint64_t index, const YAML::Node &fileYaml);
 
+    DownloadOptions DispatchDownloadOptionsYaml(
+        const DownloadOptions &defaultOptions, const YAML::Node &configYaml);
+    DownloadOptions DispatchDownloadOptionsYaml(
+        uint64_t index, const DownloadOptions &defaultOptions,
+        const YAML::Node &fileYaml);
+    // NOTE: Timeouts and hedging, `location` is added to error messages
+    void DispatchDeadlinesYaml(const std::string &location,
+                               const YAML::Node &yaml,
+                               DownloadOptions &downloadOptions);
+    std::chrono::milliseconds DispatchTimeoutYaml(const std::string &location,
+                                                  const YAML::Node &yaml,
+                                                  const char *field);
+
     std::vector<std::shared_ptr<Action>> DispatchActionsYaml(
         uint64_t index, const std::string &host, const std::string &target,
-        std::shared_ptr<Task> &task, const YAML::Node &actionsYaml);
+        std::shared_ptr<Task> &task, const DownloadOptions &downloadOptions,
+        const YAML::Node &actionsYaml);
 
     std::vector<std::string> DispatchDependenciesYaml(
         const YAML::Node &dependenciesYaml);
+
+    // NOTE: Longer timeouts are as good as none
+    inline static constexpr double s_MaxTimeoutSeconds = 24 * 60 * 60;
 };
 
 #endif // YAMLCONFIGREADER_HPP_
@@ -0,0 +1,247 @@
+#include "ahd/BandwidthScheduler.hpp"
+#include <algorithm>
+#include <limits>
+
+BandwidthScheduler::Flow::Flow(BandwidthScheduler &scheduler,
+                               std::string host)
+    : m_Scheduler(scheduler), m_Host(std::move(host)), m_Bucket(nullptr),
+      m_Weight(1), m_FinishTag(0), m_Waiting(false), m_WaitKey()
+{
+}
+
+BandwidthScheduler::Flow::~Flow()
+{
+    if (m_Scheduler.m_Limited)
+    {
+        std::lock_guard<std::mutex> lock(m_Scheduler.m_Mutex);
+        m_Scheduler.StopWaiting(*this);
+    }
+}
+
+void BandwidthScheduler::Flow::SetWeight(double weight)
+{
+    m_Weight = weight;
+}
+
+BandwidthScheduler::BandwidthScheduler(void)
+    : m_Limited(false), m_Mutex(), m_Global(), m_MaxHostRate(0), m_Hosts(),
+      m_VirtualTime(0), m_WaitSequence(0), m_Waiting()
+{
+}
+
+void BandwidthScheduler::SetLimits(uint64_t maxRate, uint64_t maxHostRate)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    Reset(m_Global, maxRate);
+    m_MaxHostRate = maxHostRate;
+    for (auto &[host, bucket] : m_Hosts)
+    {
+        Reset(bucket, maxHostRate);
+    }
+
+    m_Limited = maxRate > 0 || maxHostRate > 0;
+}
+
+std::size_t BandwidthScheduler::Acquire(Flow &flow, std::size_t size,
+                                        Clock::time_point &retryAt)
+{
+    // NOTE: Without limits reads cost a single atomic load
+    if (!m_Limited.load(std::memory_order_relaxed))
+    {
+        return size;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const auto now = Clock::now();
+
+    Bucket &host = GetBucket(flow);
+    Refill(m_Global, now);
+    Refill(host, now);
+
+    // NOTE: Flow that has been idle gets no credit for the time it didn't
+    // use, its tag catches up with the flows being served
+    if (!flow.m_Waiting)
+    {
+        flow.m_FinishTag = std::max(flow.m_FinishTag, m_VirtualTime);
+    }
+
+    const Flow::WaitKey key =
+        flow.m_Waiting ? flow.m_WaitKey
+                       : Flow::WaitKey(flow.m_FinishTag,
+                                       std::numeric_limits<uint64_t>::max());
+    bool blocked = false;
+    for (const auto &[waiterKey, waiter] : m_Waiting)
+    {
+        if (!(waiterKey < key))
+        {
+            break;
+        }
+
+        if (IsBlockedBy(flow, *waiter, now))
+        {
+            blocked = true;
+            break;
+        }
+    }
+
+    const double needed =
+        static_cast<double>(std::min(size, s_Quantum));
+    double available = static_cast<double>(size);
+    if (m_Global.rate > 0)
+    {
+        available = std::min(available, m_Global.tokens);
+    }
+    if (host.rate > 0)
+    {
+        available = std::min(available, host.tokens);
+    }
+
+    if (blocked || available < needed)
+    {
+        if (!flow.m_Waiting)
+        {
+            flow.m_WaitKey = {flow.m_FinishTag, m_WaitSequence++};
+            flow.m_Waiting = true;
+            m_Waiting.emplace(flow.m_WaitKey, &flow);
+        }
+
+        // NOTE: Flow retries once the buckets have a quantum again, or
+        // after the flow ahead of it has had its turn
+        double wait = 0;
+        if (m_Global.rate > 0)
+        {
+            wait = std::max(wait, (needed - m_Global.tokens) /
+                                      static_cast<double>(m_Global.rate));
+        }
+        if (host.rate > 0)
+        {
+            wait = std::max(wait, (needed - host.tokens) /
+                                      static_cast<double>(host.rate));
+        }
+        if (blocked)
+        {
+            const uint64_t rate = m_Global.rate > 0 ? m_Global.rate
+                                                    : host.rate;
+            wait = std::max(wait, needed / static_cast<double>(rate));
+        }
+
+        retryAt = now + std::chrono::duration_cast<Clock::duration>(
+                            std::chrono::duration<double>(
+                                std::max(wait, s_MinWaitSeconds)));
+        return 0;
+    }
+
+    const std::size_t granted = static_cast<std::size_t>(available);
+    if (m_Global.rate > 0)
+    {
+        m_Global.tokens -= static_cast<double>(granted);
+    }
+    if (host.rate > 0)
+    {
+        host.tokens -= static_cast<double>(granted);
+    }
+
+    // NOTE: Virtual time is the start tag of the flow served last
+    StopWaiting(flow);
+    m_VirtualTime = std::max(m_VirtualTime, flow.m_FinishTag);
+    flow.m_FinishTag += static_cast<double>(granted) / flow.m_Weight;
+    return granted;
+}
+
+void BandwidthScheduler::Refund(Flow &flow, std::size_t size)
+{
+    if (!m_Limited.load(std::memory_order_relaxed) || size == 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    Bucket &host = GetBucket(flow);
+    for (Bucket *bucket : {&m_Global, &host})
+    {
+        if (bucket->rate > 0)
+        {
+            bucket->tokens = std::min(
+                bucket->capacity, bucket->tokens + static_cast<double>(size));
+        }
+    }
+
+    flow.m_FinishTag -= static_cast<double>(size) / flow.m_Weight;
+}
+
+BandwidthScheduler &BandwidthScheduler::Get(void)
+{
+    static BandwidthScheduler bandwidthScheduler;
+    return bandwidthScheduler;
+}
+
+void BandwidthScheduler::Reset(Bucket &bucket, uint64_t rate)
+{
+    bucket.rate = rate;
+    bucket.capacity = std::max(static_cast<double>(rate) * s_BurstSeconds,
+                               static_cast<double>(s_Quantum));
+    bucket.tokens = bucket.capacity;
+    bucket.refilled = Clock::now();
+}
+
+void BandwidthScheduler::Refill(Bucket &bucket, Clock::time_point now)
+{
+    if (bucket.rate == 0 || now <= bucket.refilled)
+    {
+        return;
+    }
+
+    const double elapsed =
+        std::chrono::duration<double>(now - bucket.refilled).count();
+    bucket.tokens =
+        std::min(bucket.capacity,
+                 bucket.tokens + elapsed * static_cast<double>(bucket.rate));
+    bucket.refilled = now;
+}
+
+BandwidthScheduler::Bucket &BandwidthScheduler::GetBucket(Flow &flow)
+{
+    if (flow.m_Bucket == nullptr)
+    {
+        const auto [bucket, inserted] = m_Hosts.try_emplace(flow.m_Host);
+        if (inserted)
+        {
+            Reset(bucket->second, m_MaxHostRate);
+        }
+
+        flow.m_Bucket = &bucket->second;
+    }
+
+    return *flow.m_Bucket;
+}
+
+bool BandwidthScheduler::IsBlockedBy(const Flow &flow, Flow &waiter,
+                                     Clock::time_point now)
+{
+    if (&waiter == &flow)
+    {
+        return false;
+    }
+
+    // NOTE: Flows of different hosts compete only for the global bucket
+    if (m_Global.rate == 0 && waiter.m_Bucket != flow.m_Bucket)
+    {
+        return false;
+    }
+
+    Bucket &bucket = GetBucket(waiter);
+    Refill(bucket, now);
+    return bucket.rate == 0 ||
+           bucket.tokens >= static_cast<double>(s_Quantum);
+}
+
+void BandwidthScheduler::StopWaiting(Flow &flow)
+{
+    if (flow.m_Waiting)
+    {
+        m_Waiting.erase(flow.m_WaitKey);
+        flow.m_Waiting = false;
+    }
+}
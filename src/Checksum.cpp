@@ -0,0 +1,366 @@
+#include "ahd/Checksum.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif // defined(__x86_64__)
+
+#ifdef AHD_WITH_XXHASH
+#include <xxhash.h>
+#endif // AHD_WITH_XXHASH
+
+namespace
+{
+std::string FormatHex(const uint8_t *data, std::size_t size)
+{
+    static const char *digits = "0123456789abcdef";
+    std::string result;
+    result.reserve(size * 2);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        result.push_back(digits[data[i] >> 4]);
+        result.push_back(digits[data[i] & 0xF]);
+    }
+
+    return result;
+}
+
+std::string FormatHex(uint64_t value, std::size_t size)
+{
+    uint8_t bytes[sizeof(value)];
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        bytes[i] = static_cast<uint8_t>(value >> (8 * (size - 1 - i)));
+    }
+
+    return FormatHex(bytes, size);
+}
+
+class Sha256Checksum : public Checksum
+{
+public:
+    Sha256Checksum(void) : m_Context(EVP_MD_CTX_new())
+    {
+        if (m_Context == nullptr ||
+            EVP_DigestInit_ex(m_Context, EVP_sha256(), nullptr) != 1)
+        {
+            EVP_MD_CTX_free(m_Context);
+            throw std::runtime_error("Failed to initialize SHA-256");
+        }
+    }
+
+    virtual ~Sha256Checksum(void)
+    {
+        EVP_MD_CTX_free(m_Context);
+    }
+
+    virtual void Update(const uint8_t *data, std::size_t size) override
+    {
+        if (EVP_DigestUpdate(m_Context, data, size) != 1)
+        {
+            throw std::runtime_error("Failed to compute SHA-256");
+        }
+    }
+
+    virtual std::string Finish(void) override
+    {
+        unsigned char hash[EVP_MAX_MD_SIZE];
+        unsigned int hashSize = 0;
+        if (EVP_DigestFinal_ex(m_Context, hash, &hashSize) != 1)
+        {
+            throw std::runtime_error("Failed to compute SHA-256");
+        }
+
+        return FormatHex(hash, hashSize);
+    }
+
+private:
+    EVP_MD_CTX *m_Context;
+};
+
+// RFC 3720, B.4. CRC Examples, Castagnoli polynomial in reflected form
+constexpr uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+constexpr std::array<uint32_t, 256> MakeCrc32cTable(void)
+{
+    std::array<uint32_t, 256> table = {};
+    for (uint32_t i = 0; i < table.size(); ++i)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+        table[i] = crc;
+    }
+
+    return table;
+}
+
+uint32_t UpdateCrc32cTable(uint32_t crc, const uint8_t *data,
+                           std::size_t size)
+{
+    static constexpr std::array<uint32_t, 256> table = MakeCrc32cTable();
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) uint32_t UpdateCrc32cSse42(
+    uint32_t crc, const uint8_t *data, std::size_t size)
+{
+    uint64_t crc64 = crc;
+    while (size >= sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += sizeof(word);
+        size -= sizeof(word);
+    }
+
+    crc = static_cast<uint32_t>(crc64);
+    while (size > 0)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+        --size;
+    }
+
+    return crc;
+}
+#endif // defined(__x86_64__)
+
+class Crc32cChecksum : public Checksum
+{
+public:
+    using UpdateFunction = uint32_t (*)(uint32_t crc, const uint8_t *data,
+                                        std::size_t size);
+
+    Crc32cChecksum(void) : m_Crc(0xFFFFFFFF)
+    {
+    }
+
+    virtual void Update(const uint8_t *data, std::size_t size) override
+    {
+        static const UpdateFunction update = SelectUpdate();
+        m_Crc = update(m_Crc, data, size);
+    }
+
+    virtual std::string Finish(void) override
+    {
+        return FormatHex(m_Crc ^ 0xFFFFFFFF, sizeof(m_Crc));
+    }
+
+private:
+    static UpdateFunction SelectUpdate(void)
+    {
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("sse4.2"))
+        {
+            return UpdateCrc32cSse42;
+        }
+#endif // defined(__x86_64__)
+
+        return UpdateCrc32cTable;
+    }
+
+    uint32_t m_Crc;
+};
+
+#ifdef AHD_WITH_XXHASH
+// NOTE: libxxhash picks the widest SIMD instructions the CPU has for XXH3
+class XxhChecksum : public Checksum
+{
+public:
+    explicit XxhChecksum(bool xxh3)
+        : m_Xxh3(xxh3), m_State64(nullptr), m_State3(nullptr)
+    {
+        bool initialized = false;
+        if (xxh3)
+        {
+            m_State3 = XXH3_createState();
+            initialized = m_State3 != nullptr &&
+                          XXH3_64bits_reset(m_State3) == XXH_OK;
+        }
+        else
+        {
+            m_State64 = XXH64_createState();
+            initialized = m_State64 != nullptr &&
+                          XXH64_reset(m_State64, 0) == XXH_OK;
+        }
+
+        if (!initialized)
+        {
+            XXH3_freeState(m_State3);
+            XXH64_freeState(m_State64);
+            throw std::runtime_error("Failed to initialize xxHash");
+        }
+    }
+
+    virtual ~XxhChecksum(void)
+    {
+        XXH3_freeState(m_State3);
+        XXH64_freeState(m_State64);
+    }
+
+    virtual void Update(const uint8_t *data, std::size_t size) override
+    {
+        const XXH_errorcode result =
+            m_Xxh3 ? XXH3_64bits_update(m_State3, data, size)
+                   : XXH64_update(m_State64, data, size);
+        if (result != XXH_OK)
+        {
+            throw std::runtime_error("Failed to compute xxHash");
+        }
+    }
+
+    virtual std::string Finish(void) override
+    {
+        const uint64_t hash = m_Xxh3 ? XXH3_64bits_digest(m_State3)
+                                     : XXH64_digest(m_State64);
+        return FormatHex(hash, sizeof(hash));
+    }
+
+private:
+    const bool m_Xxh3;
+    XXH64_state_t *m_State64;
+    XXH3_state_t *m_State3;
+};
+#endif // AHD_WITH_XXHASH
+
+// NOTE: Digest size in bytes, zero for algorithms which aren't supported
+std::size_t GetDigestSize(const std::string &algorithm)
+{
+    if (algorithm == Checksum::s_Sha256)
+    {
+        return 32;
+    }
+
+    if (algorithm == Checksum::s_Crc32c)
+    {
+        return 4;
+    }
+
+#ifdef AHD_WITH_XXHASH
+    if (algorithm == Checksum::s_Xxh64 || algorithm == Checksum::s_Xxh3)
+    {
+        return 8;
+    }
+#endif // AHD_WITH_XXHASH
+
+    return 0;
+}
+} // namespace
+
+void Checksum::UpdateFromFile(const std::filesystem::path &path,
+                              uint64_t size)
+{
+    const int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Can't open '" + path.string() + "'");
+    }
+
+    posix_fadvise(descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::vector<uint8_t> buffer(
+        static_cast<std::size_t>(std::min<uint64_t>(s_FileBufferSize, size)));
+    while (size > 0)
+    {
+        const ssize_t readSize = read(
+            descriptor, buffer.data(),
+            static_cast<std::size_t>(std::min<uint64_t>(buffer.size(), size)));
+        if (readSize == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (readSize == -1)
+        {
+            const int error = errno;
+            close(descriptor);
+            throw std::system_error(error, std::system_category(),
+                                    "Failed to read '" + path.string() + "'");
+        }
+
+        if (readSize == 0)
+        {
+            break;
+        }
+
+        Update(buffer.data(), static_cast<std::size_t>(readSize));
+        size -= static_cast<uint64_t>(readSize);
+    }
+
+    close(descriptor);
+}
+
+std::unique_ptr<Checksum> Checksum::Create(const std::string &algorithm)
+{
+    if (algorithm == s_Sha256)
+    {
+        return std::make_unique<Sha256Checksum>();
+    }
+
+    if (algorithm == s_Crc32c)
+    {
+        return std::make_unique<Crc32cChecksum>();
+    }
+
+#ifdef AHD_WITH_XXHASH
+    if (algorithm == s_Xxh64 || algorithm == s_Xxh3)
+    {
+        return std::make_unique<XxhChecksum>(algorithm == s_Xxh3);
+    }
+#endif // AHD_WITH_XXHASH
+
+    throw std::invalid_argument("Unsupported checksum algorithm: " +
+                                algorithm);
+}
+
+const char *Checksum::GetAlgorithms(void)
+{
+#ifdef AHD_WITH_XXHASH
+    return "sha256, crc32c, xxh64, xxh3";
+#else
+    return "sha256, crc32c";
+#endif // AHD_WITH_XXHASH
+}
+
+bool Checksum::Parse(const std::string &value, std::string &algorithm,
+                     std::string &digest)
+{
+    const auto separator = value.find(':');
+    if (separator == std::string::npos)
+    {
+        return false;
+    }
+
+    algorithm = value.substr(0, separator);
+    digest = value.substr(separator + 1);
+    std::transform(algorithm.begin(), algorithm.end(), algorithm.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    std::transform(digest.begin(), digest.end(), digest.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    const std::size_t digestSize = GetDigestSize(algorithm);
+    return digestSize > 0 && digest.size() == digestSize * 2 &&
+           std::all_of(digest.begin(), digest.end(),
+                       [](unsigned char c) { return std::isxdigit(c); });
+}
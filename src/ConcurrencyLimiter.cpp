@@ -0,0 +1,153 @@
+#include "ahd/ConcurrencyLimiter.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <system_error>
+
+ConcurrencyLimiter::ConcurrencyLimiter(std::string host,
+                                       std::size_t maxLimit)
+    : m_Host(std::move(host)), m_Mutex(),
+      m_Limit(static_cast<double>(std::min(s_InitialLimit, maxLimit))),
+      m_MaxLimit(maxLimit), m_ReceivedSize(0), m_WindowStart(Clock::now()),
+      m_Saturated(false), m_Throughput(0), m_LastDecrease()
+{
+}
+
+std::size_t ConcurrencyLimiter::GetLimit(void) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return static_cast<std::size_t>(m_Limit);
+}
+
+void ConcurrencyLimiter::SetMaxLimit(std::size_t maxLimit)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_MaxLimit = maxLimit;
+    SetLimit(m_Limit, "maximum changed");
+}
+
+void ConcurrencyLimiter::OnReceived(std::size_t size)
+{
+    m_ReceivedSize.fetch_add(size, std::memory_order_relaxed);
+}
+
+void ConcurrencyLimiter::Update(bool saturated)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const auto now = Clock::now();
+
+    m_Saturated = m_Saturated || saturated;
+    if (now - m_WindowStart < s_Window)
+    {
+        return;
+    }
+
+    const double elapsed =
+        std::chrono::duration<double>(now - m_WindowStart).count();
+    const double throughput =
+        static_cast<double>(m_ReceivedSize.exchange(0)) / elapsed;
+    const bool wasSaturated = m_Saturated;
+    m_WindowStart = now;
+    m_Saturated = false;
+
+    // NOTE: Limit that isn't reached says nothing about the host
+    if (!wasSaturated || m_Limit >= static_cast<double>(m_MaxLimit))
+    {
+        return;
+    }
+
+    // NOTE: Baseline is the throughput measured before the last increase,
+    // any window with the new limit may beat it. Once none does, the host
+    // is at its capacity and the limit stays
+    if (throughput > m_Throughput * s_MinGain)
+    {
+        char reason[64];
+        std::snprintf(reason, sizeof(reason), "throughput %.1f MB/s",
+                      throughput / 1e6);
+
+        m_Throughput = throughput;
+        SetLimit(m_Limit + 1, reason);
+    }
+}
+
+void ConcurrencyLimiter::OnCongestion(const std::string &reason)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const auto now = Clock::now();
+
+    // NOTE: Errors usually come in bursts, one of them is enough to react
+    // to, the same way TCP halves its window once per round trip
+    if (now - m_LastDecrease < s_Window)
+    {
+        return;
+    }
+
+    m_LastDecrease = now;
+    m_Throughput = 0;
+    m_WindowStart = now;
+    m_Saturated = false;
+    m_ReceivedSize = 0;
+    SetLimit(m_Limit * s_DecreaseFactor, reason);
+}
+
+void ConcurrencyLimiter::SetLogging(bool logging)
+{
+    s_Logging = logging;
+}
+
+bool ConcurrencyLimiter::IsCongestion(std::exception_ptr error,
+                                      std::string &reason)
+{
+    if (!error)
+    {
+        return false;
+    }
+
+    try
+    {
+        std::rethrow_exception(error);
+    }
+    catch (const std::system_error &e)
+    {
+        if (e.code().category() != std::system_category())
+        {
+            return false;
+        }
+
+        switch (e.code().value())
+        {
+        case ECONNRESET:
+        case ECONNABORTED:
+        case ECONNREFUSED:
+        case EPIPE:
+        case ETIMEDOUT:
+            reason = e.code().message();
+            return true;
+        default:
+            return false;
+        }
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+void ConcurrencyLimiter::SetLimit(double limit, const std::string &reason)
+{
+    const std::size_t previous = static_cast<std::size_t>(m_Limit);
+    m_Limit = std::clamp(limit, 1.0, static_cast<double>(m_MaxLimit));
+
+    const std::size_t current = static_cast<std::size_t>(m_Limit);
+    if (current == previous)
+    {
+        return;
+    }
+
+    if (s_Logging)
+    {
+        std::fprintf(stderr, "%s: concurrency %zu -> %zu (%s)\n",
+                     m_Host.c_str(), previous, current, reason.c_str());
+    }
+}
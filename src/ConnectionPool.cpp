@@ -0,0 +1,409 @@
+#include "ahd/ConnectionPool.hpp"
+#include "ahd/Http2Connection.hpp"
+#include "ahd/HttpConnection.hpp"
+#include "ahd/HttpDownload.hpp"
+#include "ahd/TlsContext.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+ConnectionPool::ConnectionPool(EventLoop &eventLoop,
+                               std::size_t maxConnectionsPerHost,
+                               std::size_t maxIdleConnectionsPerHost,
+                               std::size_t pipelineDepth)
+    : m_EventLoop(eventLoop), m_Transport(Transport::Create(Transport::s_Tcp)),
+      m_Mutex(), m_Hosts(),
+      m_MaxConnectionsPerHost(0), m_MaxIdleConnectionsPerHost(0),
+      m_PipelineDepth(0), m_Http2Settings()
+{
+    SetLimits(maxConnectionsPerHost, maxIdleConnectionsPerHost);
+    SetPipelineDepth(pipelineDepth);
+}
+
+void ConnectionPool::Submit(std::shared_ptr<HttpDownload> download,
+                            bool first)
+{
+    const std::string host = download->GetPoolKey();
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        Downloads &queue = GetHost(host).queue;
+        if (first)
+        {
+            queue.emplace_front(std::move(download));
+        }
+        else
+        {
+            queue.emplace_back(std::move(download));
+        }
+    }
+
+    Dispatch(host);
+}
+
+ConnectionPool::Downloads ConnectionPool::Take(const std::string &host,
+                                               std::size_t count)
+{
+    Downloads downloads;
+    bool grown = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        HostConnections &connections = GetHost(host);
+        Downloads &queue = connections.queue;
+        DropCancelled(queue);
+        while (!queue.empty() && downloads.size() < count)
+        {
+            downloads.emplace_back(std::move(queue.front()));
+            queue.pop_front();
+            DropCancelled(queue);
+        }
+
+        // NOTE: Busy persistent connections take their work right here, the
+        // limiter is updated so it keeps learning while nothing is released
+        connections.limiter->Update(!queue.empty());
+        grown = !queue.empty() &&
+                connections.openCount < connections.limiter->GetLimit();
+    }
+
+    if (grown)
+    {
+        Dispatch(host);
+    }
+
+    return downloads;
+}
+
+void ConnectionPool::Requeue(const std::string &host, Downloads downloads)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Downloads &queue = GetHost(host).queue;
+    queue.insert(queue.begin(), std::make_move_iterator(downloads.begin()),
+                 std::make_move_iterator(downloads.end()));
+}
+
+void ConnectionPool::Release(const std::string &host,
+                             std::unique_ptr<TransportStream> stream)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        HostConnections &connections = GetHost(host);
+
+        if (stream &&
+            connections.idle.size() < m_MaxIdleConnectionsPerHost &&
+            connections.openCount <= connections.limiter->GetLimit())
+        {
+            connections.idle.push_back(
+                {std::move(stream), std::chrono::steady_clock::now()});
+        }
+        else
+        {
+            --connections.openCount;
+        }
+    }
+
+    // NOTE: Stream which isn't kept is closed outside of the lock, the
+    // freed slot or the idle connection may be taken by a queued download
+    stream.reset();
+    Dispatch(host);
+}
+
+void ConnectionPool::DetachHttp2(const std::string &host,
+                                 const Http2Connection *connection)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        HostConnections &connections = GetHost(host);
+        if (connections.http2Connection.get() != connection)
+        {
+            return;
+        }
+
+        connections.http2Connection.reset();
+    }
+
+    Dispatch(host);
+}
+
+void ConnectionPool::Downgrade(const std::string &host,
+                               std::unique_ptr<TransportStream> stream,
+                               Downloads downloads)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        HostConnections &connections = GetHost(host);
+        connections.http2 = false;
+        connections.http2Connection.reset();
+    }
+
+    if (downloads.empty())
+    {
+        Release(host, std::move(stream));
+        return;
+    }
+
+    // NOTE: Connection keeps its slot, the rest of the queue gets more
+    const auto connection = std::make_shared<HttpConnection>(
+        *this, m_EventLoop, host, std::move(stream));
+    connection->Start(std::move(downloads));
+    Dispatch(host);
+}
+
+ConcurrencyLimiter &ConnectionPool::GetLimiter(const std::string &host)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return *GetHost(host).limiter;
+}
+
+LatencyTracker &ConnectionPool::GetFirstByteLatency(const std::string &host)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return *GetHost(host).firstByteLatency;
+}
+
+std::size_t ConnectionPool::GetPipelineDepth(const std::string &host)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return GetHost(host).pipelining ? m_PipelineDepth : 1;
+}
+
+void ConnectionPool::DisablePipelining(const std::string &host)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    GetHost(host).pipelining = false;
+}
+
+void ConnectionPool::SetLimits(std::size_t maxConnectionsPerHost,
+                               std::size_t maxIdleConnectionsPerHost)
+{
+    if (maxConnectionsPerHost == 0)
+    {
+        throw std::invalid_argument(
+            "Connection pool needs at least one connection per host");
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_MaxConnectionsPerHost = maxConnectionsPerHost;
+    m_MaxIdleConnectionsPerHost =
+        std::min(maxIdleConnectionsPerHost, maxConnectionsPerHost);
+
+    for (auto &[host, connections] : m_Hosts)
+    {
+        connections.limiter->SetMaxLimit(maxConnectionsPerHost);
+    }
+}
+
+void ConnectionPool::SetPipelineDepth(std::size_t pipelineDepth)
+{
+    if (pipelineDepth == 0)
+    {
+        throw std::invalid_argument("Pipeline depth must be at least 1");
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_PipelineDepth = pipelineDepth;
+}
+
+void ConnectionPool::SetHttp2Settings(const Http2Settings &settings)
+{
+    if (settings.maxConcurrentStreams == 0)
+    {
+        throw std::invalid_argument(
+            "HTTP/2 connection needs at least one concurrent stream");
+    }
+
+    // RFC 9113, 6.5.2. Defined Settings
+    constexpr uint32_t minWindowSize = 65535;
+    constexpr uint32_t maxWindowSize = 2147483647;
+    if (settings.streamWindowSize < minWindowSize ||
+        settings.streamWindowSize > maxWindowSize ||
+        settings.connectionWindowSize < minWindowSize ||
+        settings.connectionWindowSize > maxWindowSize)
+    {
+        throw std::invalid_argument(
+            "HTTP/2 window size must be between 64 KiB and 2 GiB");
+    }
+
+#ifdef AHD_WITH_NGHTTP2
+    if (settings.mode != Http2Mode::Off)
+    {
+        TlsContext::Get().SetProtocols({"h2", "http/1.1"});
+    }
+#endif // AHD_WITH_NGHTTP2
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Http2Settings = settings;
+}
+
+Transport &ConnectionPool::GetTransport(void)
+{
+    return *m_Transport;
+}
+
+void ConnectionPool::SetTransport(std::unique_ptr<Transport> transport)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Transport = std::move(transport);
+}
+
+ConnectionPool &ConnectionPool::Get(void)
+{
+    static ConnectionPool connectionPool(
+        EventLoop::Get(), s_DefaultMaxConnectionsPerHost,
+        s_DefaultMaxIdleConnectionsPerHost, s_DefaultPipelineDepth);
+    return connectionPool;
+}
+
+void ConnectionPool::Dispatch(const std::string &host)
+{
+    if (DispatchHttp2(host))
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        std::unique_ptr<TransportStream> stream;
+        std::deque<IdleConnection> expired;
+        Downloads downloads;
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            HostConnections &connections = GetHost(host);
+            DropCancelled(connections.queue);
+            if (connections.queue.empty())
+            {
+                connections.limiter->Update(false);
+                return;
+            }
+
+            // NOTE: Most recently used connection is the least likely to be
+            // already closed by the server
+            const auto now = std::chrono::steady_clock::now();
+            while (!connections.idle.empty() && !stream)
+            {
+                IdleConnection connection = std::move(connections.idle.back());
+                connections.idle.pop_back();
+
+                if (now - connection.releaseTime < s_IdleTimeout &&
+                    connection.stream->IsAlive())
+                {
+                    stream = std::move(connection.stream);
+                }
+                else
+                {
+                    --connections.openCount;
+                    expired.emplace_back(std::move(connection));
+                }
+            }
+
+            if (!stream)
+            {
+                // NOTE: Downloads waiting for a slot are what lets the
+                // limiter learn whether a larger limit would help
+                ConcurrencyLimiter &limiter = *connections.limiter;
+                if (connections.openCount >= limiter.GetLimit())
+                {
+                    limiter.Update(true);
+                }
+
+                if (connections.openCount >= limiter.GetLimit())
+                {
+                    return;
+                }
+
+                ++connections.openCount;
+            }
+
+            // NOTE: Connection takes more work itself once it's known to be
+            // persistent
+            downloads.emplace_back(std::move(connections.queue.front()));
+            connections.queue.pop_front();
+        }
+
+        const auto connection = std::make_shared<HttpConnection>(
+            *this, m_EventLoop, host, std::move(stream));
+        connection->Start(std::move(downloads));
+    }
+}
+
+bool ConnectionPool::DispatchHttp2(const std::string &host)
+{
+#ifdef AHD_WITH_NGHTTP2
+    std::shared_ptr<Http2Connection> connection;
+    Downloads downloads;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        HostConnections &connections = GetHost(host);
+        if (!connections.http2)
+        {
+            return false;
+        }
+
+        DropCancelled(connections.queue);
+        if (connections.queue.empty())
+        {
+            return true;
+        }
+
+        connection = connections.http2Connection;
+        if (!connection)
+        {
+            // NOTE: Streams take the place of connections, so the limiter
+            // isn't asked. Connection which is going away holds its slot
+            // until its last streams are done
+            ++connections.openCount;
+            downloads.emplace_back(std::move(connections.queue.front()));
+            connections.queue.pop_front();
+
+            connection = std::make_shared<Http2Connection>(
+                *this, m_EventLoop, host, *connections.limiter,
+                *connections.firstByteLatency, m_Http2Settings);
+            connections.http2Connection = connection;
+        }
+    }
+
+    if (downloads.empty())
+    {
+        connection->Wake();
+    }
+    else
+    {
+        connection->Start(std::move(downloads));
+    }
+
+    return true;
+#else
+    (void)host;
+    return false;
+#endif // AHD_WITH_NGHTTP2
+}
+
+ConnectionPool::HostConnections &ConnectionPool::GetHost(
+    const std::string &host)
+{
+    HostConnections &connections = m_Hosts[host];
+    if (!connections.limiter)
+    {
+        connections.limiter = std::make_unique<ConcurrencyLimiter>(
+            host, m_MaxConnectionsPerHost);
+        connections.firstByteLatency = std::make_unique<LatencyTracker>();
+
+        // NOTE: Keys start with the scheme, only HTTPS can negotiate
+        const bool secure = host.rfind("https://", 0) == 0;
+        connections.http2 =
+            m_Http2Settings.mode == Http2Mode::PriorKnowledge ||
+            (m_Http2Settings.mode == Http2Mode::Alpn && secure);
+    }
+
+    return connections;
+}
+
+void ConnectionPool::DropCancelled(Downloads &queue)
+{
+    // NOTE: Winner has completed the request, so nothing waits for these
+    while (!queue.empty() && queue.front()->IsCancelled())
+    {
+        queue.pop_front();
+    }
+}
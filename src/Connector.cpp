@@ -0,0 +1,359 @@
+#include "ahd/Connector.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/epoll.h>
+
+class ConnectRace;
+
+namespace
+{
+// Connection attempt to one address, registered until the socket connects,
+// fails or the race is over
+class ConnectAttempt : public EventHandler
+{
+public:
+    ConnectAttempt(std::shared_ptr<ConnectRace> race,
+                   std::unique_ptr<http::Socket> socket)
+        : m_Race(std::move(race)), m_Socket(std::move(socket)),
+          m_Connected(false), m_Error()
+    {
+    }
+
+    int GetDescriptor(void) const
+    {
+        return m_Socket->getHandle();
+    }
+
+    virtual bool OnEvents(uint32_t events) override;
+    virtual bool OnTimer(void) override;
+    virtual void OnRemoved(void) override;
+
+private:
+    std::shared_ptr<ConnectRace> m_Race;
+    std::unique_ptr<http::Socket> m_Socket;
+    bool m_Connected;
+    std::exception_ptr m_Error;
+};
+} // namespace
+
+// Attempts of one connection. Attempts run on any of the reactor threads,
+// so the state is shared under a lock
+class ConnectRace : public std::enable_shared_from_this<ConnectRace>
+{
+public:
+    ConnectRace(Connector &connector, std::string host,
+                std::vector<SocketAddress> addresses,
+                std::chrono::milliseconds timeout,
+                Connector::ConnectHandler handler)
+        : m_Connector(connector), m_Host(std::move(host)),
+          m_Addresses(std::move(addresses)), m_NextAddress(0),
+          m_Deadline(timeout.count() > 0 ? EventLoop::Clock::now() + timeout
+                                         : EventLoop::Clock::time_point::max()),
+          m_Attempts(), m_Done(false), m_TimedOut(false), m_Error(),
+          m_Handler(std::move(handler))
+    {
+    }
+
+    void Start(void)
+    {
+        Connector::ConnectHandler handler;
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            StartNext();
+            handler = TakeFailureHandler();
+        }
+
+        if (handler)
+        {
+            handler(m_Error, nullptr);
+        }
+    }
+
+    // NOTE: Next attempt is started when the current one takes longer than
+    // the attempt delay, the current one keeps running until the deadline
+    bool OnAttemptDelay(ConnectAttempt *attempt)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Done || m_TimedOut)
+        {
+            return false;
+        }
+
+        const auto now = EventLoop::Clock::now();
+        if (now >= m_Deadline)
+        {
+            // NOTE: Other attempts are cancelled through their timers, the
+            // last one to go reports the timeout
+            m_TimedOut = true;
+            m_NextAddress = m_Addresses.size();
+            m_Error = std::make_exception_ptr(
+                std::system_error(ETIMEDOUT, std::system_category(),
+                                  "Failed to connect to '" + m_Host + "'"));
+            for (ConnectAttempt *other : m_Attempts)
+            {
+                if (other != attempt)
+                {
+                    m_Connector.m_EventLoop.SetTimer(other, now);
+                }
+            }
+            return false;
+        }
+
+        StartNext();
+        if (m_Deadline != EventLoop::Clock::time_point::max())
+        {
+            m_Connector.m_EventLoop.SetTimer(attempt, m_Deadline);
+        }
+        return true;
+    }
+
+    void OnAttemptFinished(ConnectAttempt *attempt,
+                           std::unique_ptr<http::Socket> socket,
+                           std::exception_ptr error)
+    {
+        Connector::ConnectHandler handler;
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Attempts.erase(
+                std::remove(m_Attempts.begin(), m_Attempts.end(), attempt),
+                m_Attempts.end());
+
+            if (m_Done)
+            {
+                // NOTE: Socket of an attempt which lost the race is closed
+                return;
+            }
+
+            if (socket)
+            {
+                m_Done = true;
+                handler = std::move(m_Handler);
+
+                // NOTE: Attempts still connecting are cancelled through their
+                // timers, which makes them unregister themselves
+                const auto now = EventLoop::Clock::now();
+                for (ConnectAttempt *other : m_Attempts)
+                {
+                    m_Connector.m_EventLoop.SetTimer(other, now);
+                }
+
+                sockaddr_storage address = {};
+                socklen_t size = sizeof(address);
+                if (getpeername(socket->getHandle(),
+                                reinterpret_cast<sockaddr *>(&address),
+                                &size) == 0)
+                {
+                    m_Connector.SetPreferredFamily(m_Host, address.ss_family);
+                }
+            }
+            else
+            {
+                // RFC 8305, 5. Failed attempt doesn't wait for the delay
+                if (!m_Error)
+                {
+                    m_Error = error;
+                }
+
+                StartNext();
+                handler = TakeFailureHandler();
+            }
+        }
+
+        if (handler)
+        {
+            const std::exception_ptr result = socket ? nullptr : m_Error;
+            handler(result, std::move(socket));
+        }
+    }
+
+private:
+    // NOTE: Must be called under the lock
+    void StartNext(void)
+    {
+        while (m_NextAddress < m_Addresses.size())
+        {
+            const SocketAddress &address = m_Addresses[m_NextAddress++];
+
+            try
+            {
+                auto socket = std::make_unique<http::Socket>(
+                    address.storage.ss_family == AF_INET6
+                        ? http::InternetProtocol::v6
+                        : http::InternetProtocol::v4);
+
+                // NOTE: Socket connected right away is reported by epoll as
+                // writable, so both cases are handled the same way
+                (void)socket->startConnect(
+                    reinterpret_cast<const sockaddr *>(&address.storage),
+                    address.size);
+
+                const auto attempt = std::make_shared<ConnectAttempt>(
+                    shared_from_this(), std::move(socket));
+                m_Connector.m_EventLoop.Add(attempt->GetDescriptor(),
+                                            EPOLLOUT, attempt);
+                m_Attempts.push_back(attempt.get());
+                m_Connector.m_EventLoop.SetTimer(
+                    attempt.get(),
+                    std::min(EventLoop::Clock::now() +
+                                 Connector::s_AttemptDelay,
+                             m_Deadline));
+                return;
+            }
+            catch (...)
+            {
+                if (!m_Error)
+                {
+                    m_Error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    // NOTE: Must be called under the lock, returns the handler once every
+    // address has failed
+    Connector::ConnectHandler TakeFailureHandler(void)
+    {
+        if (m_Done || !m_Attempts.empty() ||
+            m_NextAddress < m_Addresses.size())
+        {
+            return nullptr;
+        }
+
+        m_Done = true;
+        if (!m_Error)
+        {
+            m_Error = std::make_exception_ptr(
+                std::runtime_error("No addresses to connect to"));
+        }
+
+        return std::move(m_Handler);
+    }
+
+    Connector &m_Connector;
+    const std::string m_Host;
+    const std::vector<SocketAddress> m_Addresses;
+    std::size_t m_NextAddress;
+    const EventLoop::Clock::time_point m_Deadline;
+
+    std::mutex m_Mutex;
+    std::vector<ConnectAttempt *> m_Attempts;
+    bool m_Done;
+    bool m_TimedOut;
+    std::exception_ptr m_Error;
+    Connector::ConnectHandler m_Handler;
+};
+
+bool ConnectAttempt::OnEvents(uint32_t events)
+{
+    if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+    {
+        return true;
+    }
+
+    try
+    {
+        const int socketError = m_Socket->getSocketError();
+        if (socketError != 0)
+        {
+            throw std::system_error(socketError, std::system_category(),
+                                    "Failed to connect");
+        }
+
+        m_Connected = true;
+    }
+    catch (...)
+    {
+        m_Error = std::current_exception();
+    }
+
+    return false;
+}
+
+bool ConnectAttempt::OnTimer(void)
+{
+    return m_Race->OnAttemptDelay(this);
+}
+
+void ConnectAttempt::OnRemoved(void)
+{
+    // NOTE: Attempt cancelled by the timer has neither a socket nor an
+    // error for the race
+    m_Race->OnAttemptFinished(
+        this, m_Connected ? std::move(m_Socket) : nullptr, m_Error);
+}
+
+Connector::Connector(EventLoop &eventLoop)
+    : m_EventLoop(eventLoop), m_Mutex(), m_PreferredFamilies()
+{
+}
+
+void Connector::Connect(const std::string &host,
+                        const std::vector<SocketAddress> &addresses,
+                        std::chrono::milliseconds timeout,
+                        ConnectHandler handler)
+{
+    std::make_shared<ConnectRace>(*this, host, Order(host, addresses),
+                                  timeout, std::move(handler))
+        ->Start();
+}
+
+Connector &Connector::Get(void)
+{
+    static Connector connector(EventLoop::Get());
+    return connector;
+}
+
+std::vector<SocketAddress> Connector::Order(
+    const std::string &host, const std::vector<SocketAddress> &addresses)
+{
+    // RFC 8305, 4. Sorting Addresses, IPv6 goes first unless the other
+    // family has won for this host before
+    sa_family_t preferred = AF_INET6;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        const auto family = m_PreferredFamilies.find(host);
+        if (family != m_PreferredFamilies.end())
+        {
+            preferred = family->second;
+        }
+    }
+
+    std::vector<SocketAddress> first;
+    std::vector<SocketAddress> second;
+    for (const SocketAddress &address : addresses)
+    {
+        (address.storage.ss_family == preferred ? first : second)
+            .push_back(address);
+    }
+
+    // NOTE: Families are interleaved, so a broken one costs at most one
+    // attempt delay
+    std::vector<SocketAddress> result;
+    result.reserve(addresses.size());
+    for (std::size_t i = 0; i < std::max(first.size(), second.size()); ++i)
+    {
+        if (i < first.size())
+        {
+            result.push_back(first[i]);
+        }
+
+        if (i < second.size())
+        {
+            result.push_back(second[i]);
+        }
+    }
+
+    return result;
+}
+
+void Connector::SetPreferredFamily(const std::string &host,
+                                   sa_family_t family)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_PreferredFamilies[host] = family;
+}
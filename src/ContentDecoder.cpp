@@ -0,0 +1,256 @@
+#include "ahd/ContentDecoder.hpp"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <vector>
+
+#include <zlib.h>
+
+#ifdef AHD_WITH_ZSTD
+#include <zstd.h>
+#endif // AHD_WITH_ZSTD
+
+namespace
+{
+// NOTE: Size of the buffer decoded data goes through on its way to the sink
+constexpr std::size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+// RFC 1952 (gzip) and RFC 1950 (zlib, named "deflate" in HTTP)
+class ZlibDecoder : public ContentDecoder
+{
+public:
+    ZlibDecoder(bool gzip, http::BodySink sink)
+        : m_Gzip(gzip), m_Sink(std::move(sink)), m_Stream(),
+          m_Initialized(false), m_StreamEnded(false),
+          m_Output(OUTPUT_BUFFER_SIZE)
+    {
+    }
+
+    virtual ~ZlibDecoder(void)
+    {
+        if (m_Initialized)
+        {
+            inflateEnd(&m_Stream);
+        }
+    }
+
+    virtual void Write(const uint8_t *data, std::size_t size) override
+    {
+        if (size == 0)
+        {
+            return;
+        }
+
+        if (!m_Initialized)
+        {
+            Initialize(data, size);
+        }
+
+        m_Stream.next_in = const_cast<Bytef *>(data);
+        m_Stream.avail_in = static_cast<uInt>(size);
+
+        // NOTE: Output buffer filled up means that zlib may hold more
+        // decoded data even if the input is consumed
+        for (;;)
+        {
+            if (m_StreamEnded)
+            {
+                if (m_Stream.avail_in == 0)
+                {
+                    break;
+                }
+
+                // NOTE: gzip body may be a series of members (RFC 1952,
+                // 2.2. File format), anything after a zlib stream is junk
+                if (!m_Gzip)
+                {
+                    throw std::runtime_error(
+                        "Unexpected data after the deflate stream");
+                }
+
+                inflateReset(&m_Stream);
+            }
+
+            m_Stream.next_out = m_Output.data();
+            m_Stream.avail_out = static_cast<uInt>(m_Output.size());
+
+            const int result = inflate(&m_Stream, Z_NO_FLUSH);
+            if (result != Z_OK && result != Z_STREAM_END &&
+                result != Z_BUF_ERROR)
+            {
+                throw std::runtime_error(
+                    std::string("Failed to decode response body: ") +
+                    (m_Stream.msg != nullptr ? m_Stream.msg : "zlib error"));
+            }
+
+            const std::size_t decoded = m_Output.size() - m_Stream.avail_out;
+            if (decoded > 0)
+            {
+                m_Sink(m_Output.data(), decoded);
+            }
+
+            m_StreamEnded = result == Z_STREAM_END;
+            if (!m_StreamEnded && m_Stream.avail_out > 0)
+            {
+                break;
+            }
+        }
+    }
+
+    virtual void Finish(void) override
+    {
+        if (m_Initialized && !m_StreamEnded)
+        {
+            throw std::runtime_error("Compressed response body is truncated");
+        }
+    }
+
+private:
+    void Initialize(const uint8_t *data, std::size_t size)
+    {
+        // NOTE: Some servers send raw deflate data without the zlib
+        // wrapper, it's recognized by the header check (RFC 1950, 2.2.)
+        int windowBits = MAX_WBITS + 16;
+        if (!m_Gzip)
+        {
+            const bool zlibHeader =
+                size >= 2 && (data[0] & 0x0F) == Z_DEFLATED &&
+                ((data[0] << 8) | data[1]) % 31 == 0;
+            windowBits = zlibHeader ? MAX_WBITS : -MAX_WBITS;
+        }
+
+        if (inflateInit2(&m_Stream, windowBits) != Z_OK)
+        {
+            throw std::runtime_error("Failed to initialize zlib");
+        }
+
+        m_Initialized = true;
+    }
+
+    const bool m_Gzip;
+    http::BodySink m_Sink;
+    z_stream m_Stream;
+    bool m_Initialized;
+    bool m_StreamEnded;
+    std::vector<uint8_t> m_Output;
+};
+
+#ifdef AHD_WITH_ZSTD
+// RFC 8878, Zstandard compression
+class ZstdDecoder : public ContentDecoder
+{
+public:
+    explicit ZstdDecoder(http::BodySink sink)
+        : m_Sink(std::move(sink)), m_Stream(ZSTD_createDStream()),
+          m_FrameEnded(true), m_Output(ZSTD_DStreamOutSize())
+    {
+        if (m_Stream == nullptr)
+        {
+            throw std::runtime_error("Failed to initialize zstd");
+        }
+
+        ZSTD_initDStream(m_Stream);
+    }
+
+    virtual ~ZstdDecoder(void)
+    {
+        ZSTD_freeDStream(m_Stream);
+    }
+
+    virtual void Write(const uint8_t *data, std::size_t size) override
+    {
+        ZSTD_inBuffer input = {data, size, 0};
+        bool outputFull = false;
+
+        // NOTE: Output buffer filled up means that zstd may hold more
+        // decoded data even if the input is consumed
+        while (input.pos < input.size || outputFull)
+        {
+            ZSTD_outBuffer output = {m_Output.data(), m_Output.size(), 0};
+
+            const std::size_t result =
+                ZSTD_decompressStream(m_Stream, &output, &input);
+            if (ZSTD_isError(result))
+            {
+                throw std::runtime_error(
+                    std::string("Failed to decode response body: ") +
+                    ZSTD_getErrorName(result));
+            }
+
+            if (output.pos > 0)
+            {
+                m_Sink(m_Output.data(), output.pos);
+            }
+
+            outputFull = output.pos == output.size;
+
+            // NOTE: Zero means that a frame is complete, another one may
+            // follow
+            m_FrameEnded = result == 0;
+        }
+    }
+
+    virtual void Finish(void) override
+    {
+        if (!m_FrameEnded)
+        {
+            throw std::runtime_error("Compressed response body is truncated");
+        }
+    }
+
+private:
+    http::BodySink m_Sink;
+    ZSTD_DStream *m_Stream;
+    bool m_FrameEnded;
+    std::vector<uint8_t> m_Output;
+};
+#endif // AHD_WITH_ZSTD
+} // namespace
+
+std::unique_ptr<ContentDecoder> ContentDecoder::Create(
+    const std::string &contentEncoding, http::BodySink sink)
+{
+    // RFC 7231, 3.1.2.1. Content Codings, names are case-insensitive
+    std::string coding = contentEncoding;
+    coding.erase(
+        std::remove_if(coding.begin(), coding.end(),
+                       [](unsigned char c) { return std::isspace(c); }),
+        coding.end());
+    std::transform(coding.begin(), coding.end(), coding.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    if (coding.empty() || coding == "identity")
+    {
+        return nullptr;
+    }
+
+    // RFC 7230, 4.2.3. Gzip Coding, "x-gzip" is its alias
+    if (coding == "gzip" || coding == "x-gzip")
+    {
+        return std::make_unique<ZlibDecoder>(true, std::move(sink));
+    }
+
+    if (coding == "deflate")
+    {
+        return std::make_unique<ZlibDecoder>(false, std::move(sink));
+    }
+
+#ifdef AHD_WITH_ZSTD
+    if (coding == "zstd")
+    {
+        return std::make_unique<ZstdDecoder>(std::move(sink));
+    }
+#endif // AHD_WITH_ZSTD
+
+    throw std::runtime_error("Unsupported content encoding: " +
+                             contentEncoding);
+}
+
+const char *ContentDecoder::GetAcceptEncoding(void)
+{
+#ifdef AHD_WITH_ZSTD
+    return "zstd, gzip, deflate";
+#else
+    return "gzip, deflate";
+#endif // AHD_WITH_ZSTD
+}
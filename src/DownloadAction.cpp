@@ -1,21 +1,148 @@
 #include "ahd/DownloadAction.hpp"
-#include <fstream>
+#include "ahd/Checksum.hpp"
+#include "ahd/ConnectionPool.hpp"
+#include "ahd/ContentDecoder.hpp"
+#include "ahd/DownloadCache.hpp"
+#include "ahd/FileMetadata.hpp"
+#include "ahd/HttpDownload.hpp"
+#include "ahd/PartialFile.hpp"
+#include "ahd/UringDownload.hpp"
+#include "ahd/UringLoop.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
 #include <iostream>
+#include <optional>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+struct Segment
+{
+    uint64_t offset;
+    uint64_t end;
+};
+
+const std::string *FindHeaderField(const http::Response &response,
+                                   const std::string &name)
+{
+    // NOTE: Parser stores field names in lower case
+    for (const auto &[fieldName, fieldValue] : response.headerFields)
+    {
+        if (fieldName == name)
+        {
+            return &fieldValue;
+        }
+    }
+
+    return nullptr;
+}
+
+// RFC 7233, 4.2. Content-Range, for example "bytes 0-0/1234"
+bool ParseContentRange(const std::string &value, uint64_t &first,
+                       uint64_t &last, uint64_t &total)
+{
+    unsigned long long parsedFirst, parsedLast, parsedTotal;
+    if (std::sscanf(value.c_str(), "bytes %llu-%llu/%llu", &parsedFirst,
+                    &parsedLast, &parsedTotal) != 3 ||
+        parsedFirst > parsedLast || parsedLast >= parsedTotal)
+    {
+        return false;
+    }
+
+    first = parsedFirst;
+    last = parsedLast;
+    total = parsedTotal;
+    return true;
+}
+
+std::string FormatRange(uint64_t first, uint64_t last)
+{
+    return "bytes=" + std::to_string(first) + "-" + std::to_string(last);
+}
+
+bool HaveSameValidators(const FileMetadata::Validators &left,
+                        const FileMetadata::Validators &right)
+{
+    return left.size == right.size && left.entityTag == right.entityTag &&
+           left.lastModified == right.lastModified;
+}
+
+// NOTE: Thrown by a header handler to drop a response whose body isn't
+// needed, along with its connection
+struct ResponseAbandoned final
+{
+};
+
+// NOTE: Body of such response is an error page rather than the file. It's
+// still read to the end, so the connection is kept and the concurrency
+// limiter sees statuses like 429 and 503
+[[noreturn]] void ThrowStatusError(const http::Status &status,
+                                   const std::string &url)
+{
+    throw http::ResponseError("Server responded with " +
+                              std::to_string(status.code) + " " +
+                              status.reason + " for '" + url + "'");
+}
+
+// NOTE: Output may be hardlinked to a download cache object, writing
+// through the link would change the cached copy too. Such output is
+// replaced by a new file behind the same descriptor
+void DetachOutput(int descriptor, const std::filesystem::path &outputPath)
+{
+    struct stat status;
+    if (fstat(descriptor, &status) == -1 || status.st_nlink <= 1)
+    {
+        return;
+    }
+
+    if (unlink(outputPath.c_str()) == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Can't replace output file '" +
+                                    outputPath.string() + "'");
+    }
+
+    const int detached = open(outputPath.c_str(),
+                              O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (detached == -1 || dup3(detached, descriptor, O_CLOEXEC) == -1)
+    {
+        const int error = errno;
+        if (detached != -1)
+        {
+            close(detached);
+        }
+        throw std::system_error(error, std::system_category(),
+                                "Can't replace output file '" +
+                                    outputPath.string() + "'");
+    }
+
+    close(detached);
+}
+} // namespace
 
 DownloadAction::DownloadAction(const std::string &requestUrl,
-                               const std::filesystem::path &outputPath)
-    : m_RequestUrl(requestUrl), m_OutputPath(outputPath)
+                               const std::filesystem::path &outputPath,
+                               const DownloadOptions &options)
+    : m_RequestUrl(requestUrl), m_OutputPath(outputPath), m_Options(options)
 {
 }
 
 void DownloadAction::Execute(void) const
 {
-    http::Response response;
-
     try
     {
-        http::Request request{m_RequestUrl};
-        response = request.send(GET_REQUEST);
+        if (!m_Options.cacheDirectory.empty())
+        {
+            ExecuteWithCache();
+            return;
+        }
+
+        Download();
     }
     catch (const std::exception &e)
     {
@@ -23,12 +150,878 @@ void DownloadAction::Execute(void) const
         std::cerr << "Error: " << e.what() << '\n';
         std::exit(EXIT_FAILURE);
     }
+}
+
+ResourceClass DownloadAction::GetResourceClass(void) const
+{
+    return ResourceClass::Io;
+}
+
+void DownloadAction::Download(void) const
+{
+    // NOTE: Segments are fetched through the connection pool, which is
+    // used by the epoll backend only
+    if (m_Options.segments > 1)
+    {
+        ExecuteSegmented();
+        return;
+    }
+
+    if (m_Options.ioBackend == IoBackend::Uring && ExecuteWithUring())
+    {
+        return;
+    }
+
+    ExecuteWithEventLoop();
+}
+
+void DownloadAction::ExecuteWithCache(void) const
+{
+    const DownloadCache cache(m_Options.cacheDirectory);
+    const FileMetadata metadata(m_OutputPath);
+
+    // NOTE: Processes sharing the cache download the URL one at a time, so
+    // the ones waiting find it in the cache once they get the lock
+    const auto lock = cache.LockUrl(m_RequestUrl);
+
+    const std::optional<DownloadCache::Entry> entry = cache.Find(m_RequestUrl);
+    std::optional<FileMetadata::Validators> validators =
+        metadata.Load(m_RequestUrl);
+
+    // NOTE: Output that is already the cached file is revalidated by the
+    // download itself
+    const bool outputCached =
+        entry && validators &&
+        HaveSameValidators(entry->validators, *validators);
+    if (entry && !outputCached && Revalidate(entry->validators))
+    {
+        cache.Materialize(*entry, m_OutputPath);
+        metadata.Save(entry->validators);
+
+        // NOTE: Objects are named by their SHA-256, which spares reading
+        // the file back
+        if (!m_Options.checksumAlgorithm.empty())
+        {
+            VerifyOutput(true, m_Options.checksumAlgorithm == Checksum::s_Sha256
+                                   ? std::optional<std::string>(entry->object)
+                                   : std::nullopt);
+        }
+        return;
+    }
+
+    Download();
+
+    // NOTE: Validators are saved only once the download has succeeded and
+    // its checksum, if any, has matched. File of another size is some
+    // other one that has replaced it
+    validators = metadata.Load(m_RequestUrl);
+    std::error_code error;
+    const std::uintmax_t size = std::filesystem::file_size(m_OutputPath,
+                                                           error);
+    if (!validators || error || validators->size != size ||
+        (entry && HaveSameValidators(entry->validators, *validators)))
+    {
+        return;
+    }
+
+    cache.Insert(*validators, m_OutputPath);
+}
+
+bool DownloadAction::Revalidate(
+    const FileMetadata::Validators &validators) const
+{
+    // NOTE: Changed file comes back as a single byte, its download starts
+    // over with the usual request
+    http::HeaderFields headerFields = {{"Range", FormatRange(0, 0)}};
+    FileMetadata::AddConditionalFields(validators, headerFields);
+
+    bool notModified = false;
+    try
+    {
+        StartDownload(
+            std::move(headerFields),
+            [&notModified](const http::Response &response) {
+                notModified =
+                    response.status.code == http::Status::NotModified;
+
+                // NOTE: Server without range support sends the whole file,
+                // which isn't read since the download asks for it again
+                if (response.status.code == http::Status::Ok)
+                {
+                    throw ResponseAbandoned();
+                }
+            },
+            [](const uint8_t *, std::size_t) {})
+            .get();
+    }
+    catch (const ResponseAbandoned &)
+    {
+        return false;
+    }
+
+    return notModified;
+}
+
+void DownloadAction::ExecuteWithEventLoop(void) const
+{
+    const PartialFile partialFile(m_OutputPath);
+    const std::optional<PartialFile::State> savedState =
+        partialFile.Load(m_RequestUrl);
+    const FileMetadata metadata(m_OutputPath);
+    const std::optional<FileMetadata::Validators> savedValidators =
+        savedState ? std::nullopt : metadata.Load(m_RequestUrl);
+
+    const int outputDescriptor = open(partialFile.GetPath().c_str(),
+                                      O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (outputDescriptor == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Can't open output file '" +
+                                    partialFile.GetPath().string() + "'");
+    }
+
+    PartialFile::State state;
+    state.url = m_RequestUrl;
+    uint64_t savedSize = 0;
+    FileMetadata::Validators validators;
+    validators.url = m_RequestUrl;
+    bool notModified = false;
+    std::optional<http::Status> errorStatus;
+    std::unique_ptr<Checksum> checksum;
+
+    try
+    {
+        if (!m_Options.checksumAlgorithm.empty())
+        {
+            checksum = Checksum::Create(m_Options.checksumAlgorithm);
+        }
+
+        // RFC 7233, 3.1. Range and 3.2. If-Range, server sends the rest of
+        // the file only if it's still the same, otherwise the whole file
+        http::HeaderFields headerFields;
+        uint64_t resumeOffset = 0;
+        bool encodingAccepted = false;
+        if (savedState && savedState->size > 0)
+        {
+            resumeOffset = savedState->size;
+            headerFields.push_back(
+                {"Range", "bytes=" + std::to_string(resumeOffset) + "-"});
+            headerFields.push_back(
+                {"If-Range", PartialFile::GetValidator(*savedState)});
+        }
+        else if (m_Options.compression)
+        {
+            // NOTE: Ranges of an encoded body can't be decoded on their
+            // own, so resumed downloads continue uncompressed
+            headerFields.push_back(
+                {"Accept-Encoding", ContentDecoder::GetAcceptEncoding()});
+            encodingAccepted = true;
+        }
+
+        // NOTE: Finished file is only revalidated, the body is sent again
+        // only if it has changed on the server
+        if (savedValidators)
+        {
+            FileMetadata::AddConditionalFields(*savedValidators,
+                                               headerFields);
+        }
+
+        bool alreadyComplete = false;
+        std::unique_ptr<ContentDecoder> decoder;
+        const auto onWritten = [&](std::size_t size) {
+            state.size += size;
+
+            if (state.size - savedSize >= s_StateSaveInterval)
+            {
+                savedSize = state.size;
+                partialFile.Save(state);
+            }
+        };
+        const auto write = [&](const uint8_t *data, std::size_t size) {
+            WriteAt(outputDescriptor, data, size, state.size);
+            if (checksum)
+            {
+                checksum->Update(data, size);
+            }
+            onWritten(size);
+        };
+
+        // NOTE: Spliced data never passes through the program, so it can't
+        // be hashed on the way
+        HttpDownload::FileSink fileSink;
+        if (!checksum)
+        {
+            fileSink = {outputDescriptor, [&state]() { return state.size; },
+                        onWritten};
+        }
+
+        // NOTE: Body is written as it arrives, so memory usage doesn't
+        // depend on file size. Saved state lags behind the data on disk
+        StartDownload(
+            std::move(headerFields),
+            [&](const http::Response &response) {
+                if (savedValidators &&
+                    response.status.code == http::Status::NotModified)
+                {
+                    notModified = true;
+                    return;
+                }
+
+                const std::string *contentRange =
+                    FindHeaderField(response, "content-range");
+
+                uint64_t first, last, total;
+                if (resumeOffset > 0 &&
+                    response.status.code ==
+                        http::Status::RangeNotSatisfiable &&
+                    contentRange != nullptr &&
+                    std::sscanf(contentRange->c_str(), "bytes */%" SCNu64,
+                                &total) == 1 &&
+                    total == resumeOffset)
+                {
+                    alreadyComplete = true;
+                    state.size = resumeOffset;
+                    validators.entityTag = savedState->entityTag;
+                    validators.lastModified = savedState->lastModified;
+                    if (checksum)
+                    {
+                        checksum->UpdateFromFile(partialFile.GetPath(),
+                                                 resumeOffset);
+                    }
+                    return;
+                }
+
+                if (resumeOffset > 0 &&
+                    response.status.code == http::Status::PartialContent)
+                {
+                    if (contentRange == nullptr ||
+                        !ParseContentRange(*contentRange, first, last,
+                                           total) ||
+                        first != resumeOffset)
+                    {
+                        throw std::runtime_error(
+                            "Server resumed the download at wrong offset");
+                    }
+
+                    state = *savedState;
+                    validators.entityTag = state.entityTag;
+                    validators.lastModified = state.lastModified;
+
+                    // NOTE: Data of the previous run is hashed once, the
+                    // rest is hashed as it arrives
+                    if (checksum)
+                    {
+                        checksum->UpdateFromFile(partialFile.GetPath(),
+                                                 resumeOffset);
+                    }
+                }
+                else if (response.status.code != http::Status::Ok)
+                {
+                    // NOTE: Partial file and its state are left as they
+                    // are for the next run
+                    errorStatus = response.status;
+                    return;
+                }
+                else
+                {
+                    // NOTE: File has changed or ranges aren't supported,
+                    // so it's downloaded from the start. Validators are
+                    // taken from this 200 response only, the 206 above
+                    // keeps the ones the partial file was started with
+                    if (ftruncate(outputDescriptor, 0) == -1)
+                    {
+                        throw std::system_error(errno, std::system_category(),
+                                                "Failed to truncate file");
+                    }
+
+                    const std::string *entityTag =
+                        FindHeaderField(response, "etag");
+                    const std::string *lastModified =
+                        FindHeaderField(response, "last-modified");
+                    state.size = 0;
+                    state.entityTag = entityTag ? *entityTag : "";
+                    state.lastModified = lastModified ? *lastModified : "";
+                    validators.entityTag = state.entityTag;
+                    validators.lastModified = state.lastModified;
+
+                    // NOTE: Encoding that wasn't asked for is part of the
+                    // file itself, like the gzip of a .tar.gz served with
+                    // Content-Encoding, so it's stored as it is
+                    const std::string *contentEncoding =
+                        FindHeaderField(response, "content-encoding");
+                    if (encodingAccepted && contentEncoding != nullptr)
+                    {
+                        decoder = ContentDecoder::Create(*contentEncoding,
+                                                         write);
+                    }
+
+                    // NOTE: Decoded data has no offsets in the encoded
+                    // body, state without validators isn't resumed
+                    if (decoder)
+                    {
+                        state.entityTag.clear();
+                        state.lastModified.clear();
+                    }
+                }
+
+                savedSize = state.size;
+                partialFile.Save(state);
+            },
+            [&](const uint8_t *data, std::size_t size) {
+                if (alreadyComplete || notModified || errorStatus)
+                {
+                    return;
+                }
+
+                if (decoder)
+                {
+                    decoder->Write(data, size);
+                    return;
+                }
+
+                write(data, size);
+            },
+            std::move(fileSink))
+            .get();
+
+        if (errorStatus)
+        {
+            ThrowStatusError(*errorStatus, m_RequestUrl);
+        }
+
+        if (decoder)
+        {
+            decoder->Finish();
+        }
+
+        if (ftruncate(outputDescriptor, static_cast<off_t>(state.size)) == -1)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to truncate file");
+        }
+    }
+    catch (...)
+    {
+        // NOTE: Progress is kept for the next run, as long as the server
+        // gave a validator to resume with
+        close(outputDescriptor);
+        if (state.size > savedSize)
+        {
+            try
+            {
+                partialFile.Save(state);
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+        throw;
+    }
+
+    close(outputDescriptor);
+
+    if (notModified)
+    {
+        partialFile.Discard();
+        if (checksum)
+        {
+            VerifyOutput(false);
+        }
+        return;
+    }
+
+    if (checksum)
+    {
+        try
+        {
+            Verify(checksum->Finish());
+        }
+        catch (...)
+        {
+            // NOTE: Data that doesn't match isn't worth resuming
+            partialFile.Discard();
+            throw;
+        }
+    }
+
+    partialFile.Commit();
+
+    // NOTE: Failing to save validators only costs a full download next time
+    validators.size = state.size;
+    try
+    {
+        metadata.Save(validators);
+    }
+    catch (const std::exception &)
+    {
+        metadata.Remove();
+    }
+}
+
+void DownloadAction::ExecuteSegmented(void) const
+{
+    const FileMetadata metadata(m_OutputPath);
+    const std::optional<FileMetadata::Validators> savedValidators =
+        metadata.Load(m_RequestUrl);
+
+    // NOTE: File is truncated once the server confirms it has changed
+    const int outputDescriptor =
+        open(m_OutputPath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (outputDescriptor == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Can't open output file '" +
+                                    m_OutputPath.string() + "'");
+    }
+
+    bool rangeNotSatisfiable = false;
+    bool notModified = false;
+    std::optional<http::Status> errorStatus;
+    FileMetadata::Validators validators;
+    validators.url = m_RequestUrl;
+
+    try
+    {
+        // NOTE: Probe asks for the first byte only. Server without range
+        // support answers with the whole file which is then simply written
+        // out, so falling back to one stream costs no extra request
+        std::optional<uint64_t> totalSize;
+        std::string validator;
+        uint64_t probeOffset = 0;
+
+        http::HeaderFields probeFields = {{"Range", FormatRange(0, 0)}};
+        if (savedValidators)
+        {
+            FileMetadata::AddConditionalFields(*savedValidators,
+                                               probeFields);
+        }
+
+        StartDownload(
+            std::move(probeFields),
+            [&](const http::Response &response) {
+                if (savedValidators &&
+                    response.status.code == http::Status::NotModified)
+                {
+                    notModified = true;
+                    return;
+                }
+
+                // NOTE: Output is left as it is unless the response carries
+                // the file or tells it's empty
+                if (response.status.code != http::Status::PartialContent &&
+                    response.status.code != http::Status::Ok &&
+                    response.status.code !=
+                        http::Status::RangeNotSatisfiable)
+                {
+                    errorStatus = response.status;
+                    return;
+                }
+
+                DetachOutput(outputDescriptor, m_OutputPath);
+                if (ftruncate(outputDescriptor, 0) == -1)
+                {
+                    throw std::system_error(errno, std::system_category(),
+                                            "Failed to truncate file");
+                }
+
+                // NOTE: Empty file has no first byte
+                if (response.status.code ==
+                    http::Status::RangeNotSatisfiable)
+                {
+                    rangeNotSatisfiable = true;
+                    return;
+                }
+
+                // NOTE: Only a response carrying the file describes it
+                const std::string *entityTag =
+                    FindHeaderField(response, "etag");
+                const std::string *lastModified =
+                    FindHeaderField(response, "last-modified");
+                validators.entityTag = entityTag ? *entityTag : "";
+                validators.lastModified = lastModified ? *lastModified : "";
+
+                const std::string *contentRange =
+                    FindHeaderField(response, "content-range");
+
+                uint64_t first, last, total;
+                if (response.status.code != http::Status::PartialContent ||
+                    contentRange == nullptr ||
+                    !ParseContentRange(*contentRange, first, last, total))
+                {
+                    return;
+                }
+
+                totalSize = total;
+
+                // RFC 7233, 3.2. If-Range, weak entity tags can't be used
+                validator = PartialFile::GetValidator(validators);
+            },
+            [outputDescriptor, &probeOffset, &rangeNotSatisfiable,
+             &notModified, &errorStatus](const uint8_t *data,
+                                         std::size_t size) {
+                if (rangeNotSatisfiable || notModified || errorStatus)
+                {
+                    return;
+                }
+
+                WriteAt(outputDescriptor, data, size, probeOffset);
+                probeOffset += size;
+            })
+            .get();
+
+        if (errorStatus)
+        {
+            ThrowStatusError(*errorStatus, m_RequestUrl);
+        }
+
+        validators.size = probeOffset;
+        if (!rangeNotSatisfiable && totalSize && *totalSize > 1)
+        {
+            FetchSegments(outputDescriptor, *totalSize, validator);
+            validators.size = *totalSize;
+        }
+    }
+    catch (...)
+    {
+        close(outputDescriptor);
+        if (!notModified && !errorStatus)
+        {
+            metadata.Remove();
+        }
+        throw;
+    }
+
+    close(outputDescriptor);
+
+    // NOTE: Ranges arrive out of order, so the file is hashed once it's
+    // complete, while it's still in the page cache
+    if (notModified)
+    {
+        if (!m_Options.checksumAlgorithm.empty())
+        {
+            VerifyOutput(false);
+        }
+        return;
+    }
+
+    if (rangeNotSatisfiable)
+    {
+        ExecuteWithEventLoop();
+        return;
+    }
+
+    if (!m_Options.checksumAlgorithm.empty())
+    {
+        VerifyOutput(true);
+    }
+
+    try
+    {
+        metadata.Save(validators);
+    }
+    catch (const std::exception &)
+    {
+        metadata.Remove();
+    }
+}
+
+void DownloadAction::FetchSegments(int outputDescriptor, uint64_t size,
+                                   const std::string &validator) const
+{
+    const uint64_t count = std::clamp<uint64_t>(
+        size / std::max<uint64_t>(m_Options.minSegmentSize, 1), 1,
+        m_Options.segments);
+
+    // NOTE: Space is reserved up front, so ranges written out of order
+    // don't leave the file fragmented and running out of disk space is
+    // detected before anything is downloaded
+    const int error = posix_fallocate(outputDescriptor, 0,
+                                      static_cast<off_t>(size));
+    if (error != 0 && error != EOPNOTSUPP && error != EINVAL)
+    {
+        throw std::system_error(error, std::system_category(),
+                                "Failed to allocate output file");
+    }
+
+    if (error != 0 &&
+        ftruncate(outputDescriptor, static_cast<off_t>(size)) == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to resize output file");
+    }
+
+    std::vector<Segment> segments;
+    segments.reserve(count);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        segments.push_back({size * i / count, size * (i + 1) / count});
+    }
+
+    std::vector<std::future<void>> downloads;
+    downloads.reserve(segments.size());
+    for (Segment &segment : segments)
+    {
+        http::HeaderFields headerFields = {
+            {"Range", FormatRange(segment.offset, segment.end - 1)}};
+        if (!validator.empty())
+        {
+            headerFields.push_back({"If-Range", validator});
+        }
+
+        const uint64_t first = segment.offset;
+        downloads.emplace_back(StartDownload(
+            std::move(headerFields),
+            [first, size](const http::Response &response) {
+                const std::string *contentRange =
+                    FindHeaderField(response, "content-range");
+
+                uint64_t rangeFirst, rangeLast, rangeTotal;
+                if (response.status.code !=
+                        http::Status::PartialContent ||
+                    contentRange == nullptr ||
+                    !ParseContentRange(*contentRange, rangeFirst,
+                                       rangeLast, rangeTotal) ||
+                    rangeFirst != first || rangeTotal != size)
+                {
+                    throw std::runtime_error(
+                        "File has changed on the server during download");
+                }
+            },
+            [outputDescriptor, &segment](const uint8_t *data,
+                                         std::size_t dataSize) {
+                if (dataSize > segment.end - segment.offset)
+                {
+                    throw std::runtime_error(
+                        "Server sent more data than requested");
+                }
+
+                WriteAt(outputDescriptor, data, dataSize, segment.offset);
+                segment.offset += dataSize;
+            },
+            {outputDescriptor, [&segment]() { return segment.offset; },
+             [&segment](std::size_t dataSize) {
+                 // NOTE: Spliced data has already reached the file, past
+                 // the segment end it may overwrite the next one
+                 if (dataSize > segment.end - segment.offset)
+                 {
+                     throw std::runtime_error(
+                         "Server sent more data than requested");
+                 }
+
+                 segment.offset += dataSize;
+             }}));
+    }
+
+    // NOTE: All segments are awaited before reporting, since they write
+    // into the same file
+    std::exception_ptr firstError;
+    for (auto &download : downloads)
+    {
+        try
+        {
+            download.get();
+        }
+        catch (...)
+        {
+            if (!firstError)
+            {
+                firstError = std::current_exception();
+            }
+        }
+    }
+
+    if (firstError)
+    {
+        std::rethrow_exception(firstError);
+    }
+
+    for (const Segment &segment : segments)
+    {
+        if (segment.offset != segment.end)
+        {
+            throw std::runtime_error(
+                "Connection closed before the range was complete");
+        }
+    }
+}
+
+std::future<void> DownloadAction::StartDownload(
+    http::HeaderFields headerFields, http::HeaderHandler headerHandler,
+    http::BodySink bodySink, HttpDownload::FileSink fileSink) const
+{
+    auto done = std::make_shared<std::promise<void>>();
+    const auto download = std::make_shared<HttpDownload>(
+        m_RequestUrl, std::move(headerFields), std::move(headerHandler),
+        std::move(bodySink), [done](std::exception_ptr error) {
+            if (error)
+            {
+                done->set_exception(error);
+            }
+            else
+            {
+                done->set_value();
+            }
+        });
+
+    download->SetFileSink(std::move(fileSink));
+    download->SetWeight(m_Options.weight /
+                        static_cast<double>(m_Options.segments));
+    download->SetTimeouts(m_Options.timeouts);
+    download->SetHedgePercentile(m_Options.hedgePercentile);
+
+    std::future<void> result = done->get_future();
+    download->Start(ConnectionPool::Get());
+    return result;
+}
+
+void DownloadAction::Verify(const std::string &digest) const
+{
+    if (digest != m_Options.checksum)
+    {
+        throw std::runtime_error(
+            "Checksum mismatch for '" + m_OutputPath.string() +
+            "': expected " + m_Options.checksumAlgorithm + ":" +
+            m_Options.checksum + ", got " + m_Options.checksumAlgorithm +
+            ":" + digest);
+    }
+}
+
+void DownloadAction::VerifyOutput(bool downloaded,
+                                  std::optional<std::string> digest) const
+{
+    if (!digest)
+    {
+        const auto checksum = Checksum::Create(m_Options.checksumAlgorithm);
+        checksum->UpdateFromFile(m_OutputPath);
+        digest = checksum->Finish();
+    }
 
-    std::ofstream outputStream(m_OutputPath);
-    for (const auto c : response.body)
+    try
+    {
+        Verify(*digest);
+    }
+    catch (...)
     {
-        outputStream << c;
+        FileMetadata(m_OutputPath).Remove();
+        if (downloaded)
+        {
+            std::error_code error;
+            std::filesystem::remove(m_OutputPath, error);
+        }
+        throw;
     }
 }
 
-const char *DownloadAction::GET_REQUEST = "GET";
+void DownloadAction::WriteAt(int descriptor, const uint8_t *data,
+                             std::size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        const ssize_t written =
+            pwrite(descriptor, data, size, static_cast<off_t>(offset));
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to write to output file");
+        }
+
+        data += written;
+        size -= static_cast<std::size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+}
+
+bool DownloadAction::ExecuteWithUring(void) const
+{
+#ifdef AHD_WITH_IO_URING
+    // NOTE: TLS is done by the transports of the epoll backend only
+    UringLoop *uringLoop = UringLoop::Get();
+    if (uringLoop == nullptr ||
+        http::parseUri(m_RequestUrl.begin(), m_RequestUrl.end()).scheme !=
+            "http")
+    {
+        return false;
+    }
+
+    // NOTE: Validators aren't kept by this backend, so the file is always
+    // downloaded in full and can't be revalidated later
+    FileMetadata(m_OutputPath).Remove();
+
+    std::error_code existsError;
+    const bool existed = std::filesystem::exists(m_OutputPath, existsError);
+    const int outputDescriptor =
+        open(m_OutputPath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (outputDescriptor == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Can't open output file '" +
+                                    m_OutputPath.string() + "'");
+    }
+
+    // NOTE: Existing file is replaced once the server starts sending the
+    // new one, an error page leaves it as it is. Handler runs on the
+    // io_uring thread, the future orders it before the checks below
+    bool truncated = false;
+    std::promise<void> done;
+    const auto download = std::make_shared<UringDownload>(
+        m_RequestUrl, outputDescriptor,
+        [this, outputDescriptor, &truncated](const http::Response &response) {
+            if (response.status.code != http::Status::Ok)
+            {
+                ThrowStatusError(response.status, m_RequestUrl);
+            }
+
+            DetachOutput(outputDescriptor, m_OutputPath);
+            if (ftruncate(outputDescriptor, 0) == -1)
+            {
+                throw std::system_error(errno, std::system_category(),
+                                        "Failed to truncate file");
+            }
+            truncated = true;
+        },
+        [&done](std::exception_ptr error) {
+            if (error)
+            {
+                done.set_exception(error);
+            }
+            else
+            {
+                done.set_value();
+            }
+        });
+
+    try
+    {
+        download->Start(*uringLoop);
+        done.get_future().get();
+    }
+    catch (...)
+    {
+        // NOTE: File cut short isn't worth keeping, there's no state to
+        // resume it with
+        close(outputDescriptor);
+        if (truncated || !existed)
+        {
+            std::error_code error;
+            std::filesystem::remove(m_OutputPath, error);
+        }
+        throw;
+    }
+
+    close(outputDescriptor);
+
+    // NOTE: Body is written by the kernel, so the file is read back
+    if (!m_Options.checksumAlgorithm.empty())
+    {
+        VerifyOutput(true);
+    }
+    return true;
+#else
+    return false;
+#endif // AHD_WITH_IO_URING
+}
@@ -0,0 +1,258 @@
+#include "ahd/DownloadCache.hpp"
+#include "ahd/Checksum.hpp"
+#include <atomic>
+#include <cerrno>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+DownloadCache::Lock::Lock(const std::filesystem::path &path)
+    : m_Descriptor(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644))
+{
+    if (m_Descriptor == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Can't open cache lock '" + path.string() +
+                                    "'");
+    }
+
+    // NOTE: flock belongs to the open file description, so it also keeps
+    // out other threads of this process which open the file on their own
+    while (flock(m_Descriptor, LOCK_EX) == -1)
+    {
+        if (errno != EINTR)
+        {
+            const int error = errno;
+            close(m_Descriptor);
+            throw std::system_error(error, std::system_category(),
+                                    "Failed to lock '" + path.string() +
+                                        "'");
+        }
+    }
+}
+
+DownloadCache::Lock::~Lock()
+{
+    close(m_Descriptor);
+}
+
+DownloadCache::DownloadCache(const std::filesystem::path &directory)
+    : m_ObjectsDirectory(directory / "objects"),
+      m_IndexDirectory(directory / "index"),
+      m_LocksDirectory(directory / "locks"),
+      m_TemporaryDirectory(directory / "tmp")
+{
+    std::filesystem::create_directories(m_ObjectsDirectory);
+    std::filesystem::create_directories(m_IndexDirectory);
+    std::filesystem::create_directories(m_LocksDirectory);
+    std::filesystem::create_directories(m_TemporaryDirectory);
+}
+
+std::unique_ptr<DownloadCache::Lock> DownloadCache::LockUrl(
+    const std::string &url) const
+{
+    return std::make_unique<Lock>(m_LocksDirectory / HashString(url));
+}
+
+std::optional<DownloadCache::Entry> DownloadCache::Find(
+    const std::string &url) const
+{
+    std::ifstream entryStream(m_IndexDirectory / HashString(url));
+    if (!entryStream)
+    {
+        return std::nullopt;
+    }
+
+    Entry entry;
+    std::string line;
+    while (std::getline(entryStream, line))
+    {
+        const auto separator = line.find(": ");
+        if (separator == std::string::npos)
+        {
+            continue;
+        }
+
+        const std::string field = line.substr(0, separator);
+        const std::string value = line.substr(separator + 2);
+
+        if (field == s_UrlField)
+        {
+            entry.validators.url = value;
+        }
+        else if (field == s_SizeField)
+        {
+            entry.validators.size = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (field == s_EntityTagField)
+        {
+            entry.validators.entityTag = value;
+        }
+        else if (field == s_LastModifiedField)
+        {
+            entry.validators.lastModified = value;
+        }
+        else if (field == s_ObjectField)
+        {
+            entry.object = value;
+        }
+    }
+
+    if (entry.validators.url != url || entry.object.empty() ||
+        (entry.validators.entityTag.empty() &&
+         entry.validators.lastModified.empty()))
+    {
+        return std::nullopt;
+    }
+
+    // NOTE: Object may have been hardlinked to an output that was changed
+    // in place since. Size is the cheap part of checking for that
+    std::error_code error;
+    const auto objectSize =
+        std::filesystem::file_size(GetObjectPath(entry.object), error);
+    if (error || objectSize != entry.validators.size)
+    {
+        return std::nullopt;
+    }
+
+    return entry;
+}
+
+void DownloadCache::Insert(const FileMetadata::Validators &validators,
+                           const std::filesystem::path &path) const
+{
+    const std::string object = HashFile(path);
+    const std::filesystem::path objectPath = GetObjectPath(object);
+
+    if (!std::filesystem::exists(objectPath))
+    {
+        // NOTE: Object appears under its name only once it's complete,
+        // the rename replaces an identical copy if another process won
+        const std::filesystem::path temporaryPath = MakeTemporaryPath(object);
+        std::filesystem::create_directories(objectPath.parent_path());
+        LinkOrCopy(path, temporaryPath);
+        std::filesystem::rename(temporaryPath, objectPath);
+    }
+
+    const std::string urlHash = HashString(validators.url);
+    const std::filesystem::path temporaryPath = MakeTemporaryPath(urlHash);
+
+    {
+        std::ofstream entryStream(temporaryPath, std::ios::trunc);
+        entryStream << s_UrlField << ": " << validators.url << '\n'
+                    << s_SizeField << ": " << validators.size << '\n'
+                    << s_ObjectField << ": " << object << '\n';
+        if (!validators.entityTag.empty())
+        {
+            entryStream << s_EntityTagField << ": " << validators.entityTag
+                        << '\n';
+        }
+        if (!validators.lastModified.empty())
+        {
+            entryStream << s_LastModifiedField << ": "
+                        << validators.lastModified << '\n';
+        }
+
+        if (!entryStream.flush())
+        {
+            throw std::runtime_error("Failed to write '" +
+                                     temporaryPath.string() + "'");
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, m_IndexDirectory / urlHash);
+}
+
+void DownloadCache::Materialize(const Entry &entry,
+                                const std::filesystem::path &outputPath) const
+{
+    const std::filesystem::path objectPath = GetObjectPath(entry.object);
+
+    // NOTE: Output is already this object
+    std::error_code error;
+    if (std::filesystem::equivalent(objectPath, outputPath, error))
+    {
+        return;
+    }
+
+    const std::filesystem::path temporaryPath = outputPath.string() + ".tmp";
+    std::filesystem::remove(temporaryPath, error);
+    LinkOrCopy(objectPath, temporaryPath);
+    std::filesystem::rename(temporaryPath, outputPath);
+}
+
+std::filesystem::path DownloadCache::GetObjectPath(
+    const std::string &object) const
+{
+    return m_ObjectsDirectory / object.substr(0, 2) / object;
+}
+
+std::filesystem::path DownloadCache::MakeTemporaryPath(
+    const std::string &name) const
+{
+    static std::atomic<uint64_t> counter = 0;
+    return m_TemporaryDirectory /
+           (name + "." + std::to_string(getpid()) + "." +
+            std::to_string(counter++));
+}
+
+void DownloadCache::LinkOrCopy(const std::filesystem::path &from,
+                               const std::filesystem::path &to)
+{
+    const int source = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Can't open '" + from.string() + "'");
+    }
+
+    const int destination =
+        open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (destination == -1)
+    {
+        const int error = errno;
+        close(source);
+        throw std::system_error(error, std::system_category(),
+                                "Can't create '" + to.string() + "'");
+    }
+
+    // NOTE: Reflink shares the data but not the inode, so writes to either
+    // file stay private
+    const bool cloned = ioctl(destination, FICLONE, source) == 0;
+    close(destination);
+    close(source);
+
+    if (cloned)
+    {
+        return;
+    }
+
+    std::filesystem::remove(to);
+    if (link(from.c_str(), to.c_str()) == 0)
+    {
+        return;
+    }
+
+    std::filesystem::copy_file(from, to);
+}
+
+std::string DownloadCache::HashFile(const std::filesystem::path &path)
+{
+    const auto checksum = Checksum::Create(Checksum::s_Sha256);
+    checksum->UpdateFromFile(path);
+    return checksum->Finish();
+}
+
+std::string DownloadCache::HashString(const std::string &data)
+{
+    const auto checksum = Checksum::Create(Checksum::s_Sha256);
+    checksum->Update(reinterpret_cast<const uint8_t *>(data.data()),
+                     data.size());
+    return checksum->Finish();
+}
@@ -0,0 +1,263 @@
+#include "ahd/EventLoop.hpp"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+EventLoop::EventLoop(std::size_t threadCount)
+    : m_Reactors(), m_NextReactor(0), m_Running(true)
+{
+    if (threadCount == 0)
+    {
+        throw std::invalid_argument("Event loop needs at least one thread");
+    }
+
+    m_Reactors.reserve(threadCount);
+    for (std::size_t i = 0; i < threadCount; ++i)
+    {
+        auto reactor = std::make_unique<Reactor>();
+
+        reactor->epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+        if (reactor->epollDescriptor == -1)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to create epoll instance");
+        }
+
+        reactor->wakeDescriptor = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (reactor->wakeDescriptor == -1)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to create eventfd");
+        }
+
+        // NOTE: `nullptr` marks the wake up descriptor
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        if (epoll_ctl(reactor->epollDescriptor, EPOLL_CTL_ADD,
+                      reactor->wakeDescriptor, &event) == -1)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to register eventfd");
+        }
+
+        m_Reactors.emplace_back(std::move(reactor));
+    }
+
+    for (const auto &reactor : m_Reactors)
+    {
+        reactor->thread =
+            std::thread(&EventLoop::Work, this, std::ref(*reactor.get()));
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    m_Running = false;
+
+    for (const auto &reactor : m_Reactors)
+    {
+        WakeUp(*reactor);
+    }
+
+    for (const auto &reactor : m_Reactors)
+    {
+        reactor->thread.join();
+        close(reactor->wakeDescriptor);
+        close(reactor->epollDescriptor);
+    }
+}
+
+void EventLoop::Add(int descriptor, uint32_t events,
+                    const std::shared_ptr<EventHandler> &handler)
+{
+    Reactor &reactor = *m_Reactors[m_NextReactor++ % m_Reactors.size()];
+
+    // NOTE: Registration must exist before epoll can report the first event
+    {
+        std::lock_guard<std::mutex> lock(reactor.mutex);
+        reactor.registrations[handler.get()] = {descriptor, handler};
+    }
+
+    epoll_event event = {};
+    event.events = events | EPOLLET;
+    event.data.ptr = handler.get();
+    if (epoll_ctl(reactor.epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) ==
+        -1)
+    {
+        const int error = errno;
+        std::lock_guard<std::mutex> lock(reactor.mutex);
+        reactor.registrations.erase(handler.get());
+        throw std::system_error(error, std::system_category(),
+                                "Failed to register descriptor");
+    }
+}
+
+void EventLoop::SetTimer(EventHandler *handler, Clock::time_point deadline)
+{
+    for (const auto &reactor : m_Reactors)
+    {
+        std::unique_lock<std::mutex> lock(reactor->mutex);
+        const auto registration = reactor->registrations.find(handler);
+        if (registration == reactor->registrations.end())
+        {
+            continue;
+        }
+
+        registration->second.deadline = deadline;
+        if (deadline == Clock::time_point::max())
+        {
+            return;
+        }
+
+        const bool earliest =
+            reactor->timers.empty() || deadline < reactor->timers.top().first;
+        reactor->timers.emplace(deadline, handler);
+        lock.unlock();
+
+        // NOTE: Reactor may already sleep with a later timeout
+        if (earliest && std::this_thread::get_id() != reactor->thread.get_id())
+        {
+            WakeUp(*reactor);
+        }
+        return;
+    }
+}
+
+EventLoop &EventLoop::Get(void)
+{
+    static EventLoop eventLoop(std::clamp<std::size_t>(
+        std::thread::hardware_concurrency(), 1, s_MaxThreadCount));
+    return eventLoop;
+}
+
+void EventLoop::Work(Reactor &reactor)
+{
+    epoll_event events[s_MaxEvents];
+
+    while (m_Running)
+    {
+        const int count = epoll_wait(reactor.epollDescriptor, events,
+                                     s_MaxEvents, GetTimeout(reactor));
+        if (count == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to wait for events");
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            auto *handler = static_cast<EventHandler *>(events[i].data.ptr);
+            if (handler == nullptr)
+            {
+                uint64_t value;
+                (void)read(reactor.wakeDescriptor, &value, sizeof(value));
+                continue;
+            }
+
+            if (!handler->OnEvents(events[i].events))
+            {
+                Remove(reactor, handler);
+            }
+        }
+
+        RunTimers(reactor);
+    }
+}
+
+int EventLoop::GetTimeout(Reactor &reactor)
+{
+    std::lock_guard<std::mutex> lock(reactor.mutex);
+
+    while (!reactor.timers.empty())
+    {
+        const Timer &timer = reactor.timers.top();
+        const auto registration = reactor.registrations.find(timer.second);
+        if (registration != reactor.registrations.end() &&
+            registration->second.deadline == timer.first)
+        {
+            // NOTE: Rounded up, otherwise the loop would spin until the
+            // deadline when less than a millisecond is left
+            const auto timeout =
+                std::chrono::ceil<std::chrono::milliseconds>(timer.first -
+                                                             Clock::now());
+            return static_cast<int>(std::clamp<std::int64_t>(
+                timeout.count(), 0, std::numeric_limits<int>::max()));
+        }
+
+        reactor.timers.pop();
+    }
+
+    return -1;
+}
+
+void EventLoop::RunTimers(Reactor &reactor)
+{
+    std::vector<std::shared_ptr<EventHandler>> expired;
+
+    {
+        std::lock_guard<std::mutex> lock(reactor.mutex);
+        const auto now = Clock::now();
+
+        while (!reactor.timers.empty() && reactor.timers.top().first <= now)
+        {
+            const Timer timer = reactor.timers.top();
+            reactor.timers.pop();
+
+            const auto registration = reactor.registrations.find(timer.second);
+            if (registration != reactor.registrations.end() &&
+                registration->second.deadline == timer.first)
+            {
+                registration->second.deadline = Clock::time_point::max();
+                expired.emplace_back(registration->second.handler);
+            }
+        }
+    }
+
+    for (const auto &handler : expired)
+    {
+        if (!handler->OnTimer())
+        {
+            Remove(reactor, handler.get());
+        }
+    }
+}
+
+void EventLoop::WakeUp(Reactor &reactor)
+{
+    const uint64_t value = 1;
+    (void)write(reactor.wakeDescriptor, &value, sizeof(value));
+}
+
+void EventLoop::Remove(Reactor &reactor, EventHandler *handler)
+{
+    std::shared_ptr<EventHandler> released;
+
+    {
+        std::lock_guard<std::mutex> lock(reactor.mutex);
+        const auto registration = reactor.registrations.find(handler);
+        if (registration == reactor.registrations.end())
+        {
+            return;
+        }
+
+        epoll_ctl(reactor.epollDescriptor, EPOLL_CTL_DEL,
+                  registration->second.descriptor, nullptr);
+        released = std::move(registration->second.handler);
+        reactor.registrations.erase(registration);
+    }
+
+    // NOTE: Handler is notified and destroyed outside of the lock since it
+    // may close descriptors or register new handlers
+    released->OnRemoved();
+}
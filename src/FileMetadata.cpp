@@ -0,0 +1,65 @@
+#include "ahd/FileMetadata.hpp"
+#include <system_error>
+
+FileMetadata::FileMetadata(const std::filesystem::path &outputPath)
+    : m_OutputPath(outputPath),
+      m_MetadataPath(outputPath.string() + s_MetadataExtension)
+{
+}
+
+std::optional<FileMetadata::Validators> FileMetadata::Load(
+    const std::string &url) const
+{
+    const std::optional<Validators> validators =
+        PartialFile::ReadState(m_MetadataPath);
+    if (!validators || validators->url != url ||
+        (validators->entityTag.empty() && validators->lastModified.empty()))
+    {
+        return std::nullopt;
+    }
+
+    // NOTE: File changed or removed locally has to be downloaded again,
+    // whatever the server says about its own copy
+    std::error_code error;
+    const auto outputSize = std::filesystem::file_size(m_OutputPath, error);
+    if (error || outputSize != validators->size)
+    {
+        return std::nullopt;
+    }
+
+    return validators;
+}
+
+void FileMetadata::Save(const Validators &validators) const
+{
+    if (validators.entityTag.empty() && validators.lastModified.empty())
+    {
+        Remove();
+        return;
+    }
+
+    PartialFile::WriteState(m_MetadataPath, validators);
+}
+
+void FileMetadata::Remove(void) const
+{
+    std::error_code error;
+    std::filesystem::remove(m_MetadataPath, error);
+}
+
+void FileMetadata::AddConditionalFields(const Validators &validators,
+                                        http::HeaderFields &headerFields)
+{
+    // NOTE: If-None-Match uses weak comparison, so weak entity tags work
+    // here unlike in If-Range. Server prefers it over If-Modified-Since
+    if (!validators.entityTag.empty())
+    {
+        headerFields.push_back({"If-None-Match", validators.entityTag});
+    }
+
+    if (!validators.lastModified.empty())
+    {
+        headerFields.push_back(
+            {"If-Modified-Since", validators.lastModified});
+    }
+}
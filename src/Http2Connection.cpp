@@ -0,0 +1,985 @@
+#include "ahd/Http2Connection.hpp"
+
+#ifdef AHD_WITH_NGHTTP2
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+#include <sys/epoll.h>
+
+namespace
+{
+// RFC 9113, 8.2.2. Connection-Specific Header Fields
+bool IsConnectionSpecific(const std::string &fieldName)
+{
+    return fieldName == "host" || fieldName == "connection" ||
+           fieldName == "keep-alive" || fieldName == "proxy-connection" ||
+           fieldName == "transfer-encoding" || fieldName == "upgrade" ||
+           fieldName == "content-length";
+}
+
+nghttp2_nv MakeField(const std::string &name, const std::string &value)
+{
+    // NOTE: nghttp2 copies the fields, they aren't modified
+    return {reinterpret_cast<uint8_t *>(const_cast<char *>(name.data())),
+            reinterpret_cast<uint8_t *>(const_cast<char *>(value.data())),
+            name.size(), value.size(), NGHTTP2_NV_FLAG_NONE};
+}
+} // namespace
+
+Http2Connection::Http2Connection(ConnectionPool &connectionPool,
+                                 EventLoop &eventLoop, std::string host,
+                                 ConcurrencyLimiter &limiter,
+                                 LatencyTracker &firstByteLatency,
+                                 const Http2Settings &settings)
+    : m_ConnectionPool(connectionPool), m_EventLoop(eventLoop),
+      m_Host(std::move(host)), m_Limiter(limiter),
+      m_FirstByteLatency(firstByteLatency), m_Settings(settings),
+      m_State(State::Connecting), m_Stream(), m_Session(nullptr),
+      m_Secure(false), m_Downgraded(false), m_GoingAway(false),
+      m_Detached(false), m_Woken(false), m_Pending(), m_Streams(),
+      m_SendBuffer(), m_SentSize(0), m_Flow(BandwidthScheduler::Get(), m_Host),
+      m_LastActivity(), m_IdleSince(), m_RetryAt(Clock::time_point::max()),
+      m_TimerAt(Clock::time_point::max()), m_Retry(), m_Finished()
+{
+    nghttp2_session_callbacks *callbacks = nullptr;
+    if (nghttp2_session_callbacks_new(&callbacks) != 0)
+    {
+        throw std::bad_alloc();
+    }
+
+    nghttp2_session_callbacks_set_on_begin_headers_callback(
+        callbacks, &Http2Connection::OnBeginHeaders);
+    nghttp2_session_callbacks_set_on_header_callback(
+        callbacks, &Http2Connection::OnHeader);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(
+        callbacks, &Http2Connection::OnFrameReceived);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
+        callbacks, &Http2Connection::OnDataReceived);
+    nghttp2_session_callbacks_set_on_stream_close_callback(
+        callbacks, &Http2Connection::OnStreamClosed);
+
+    nghttp2_option *option = nullptr;
+    if (nghttp2_option_new(&option) != 0)
+    {
+        nghttp2_session_callbacks_del(callbacks);
+        throw std::bad_alloc();
+    }
+
+    // NOTE: Requests sent before the server's SETTINGS arrive are limited
+    // the same way as the ones after
+    nghttp2_option_set_peer_max_concurrent_streams(
+        option, static_cast<uint32_t>(std::min<std::size_t>(
+                    m_Settings.maxConcurrentStreams,
+                    std::numeric_limits<uint32_t>::max())));
+
+    const int result =
+        nghttp2_session_client_new2(&m_Session, callbacks, this, option);
+    nghttp2_option_del(option);
+    nghttp2_session_callbacks_del(callbacks);
+
+    if (result != 0)
+    {
+        throw std::runtime_error(std::string("Failed to create HTTP/2 "
+                                             "session: ") +
+                                 nghttp2_strerror(result));
+    }
+}
+
+Http2Connection::~Http2Connection()
+{
+    nghttp2_session_del(m_Session);
+}
+
+void Http2Connection::Start(ConnectionPool::Downloads downloads)
+{
+    const http::Uri uri = downloads.front()->GetUri();
+    const std::chrono::milliseconds connectTimeout =
+        downloads.front()->GetTimeouts().connect;
+
+    m_Secure = uri.scheme == "https";
+    for (auto &download : downloads)
+    {
+        download->SetCancelHandler(MakeCancelHandler());
+    }
+    m_Pending = std::move(downloads);
+
+    Connect(uri, connectTimeout);
+}
+
+void Http2Connection::Wake(void)
+{
+    m_Woken = true;
+    m_EventLoop.SetTimer(this, Clock::now());
+}
+
+void Http2Connection::Connect(const http::Uri &uri,
+                              std::chrono::milliseconds timeout)
+{
+    m_ConnectionPool.GetTransport().Connect(
+        uri, timeout,
+        [self = shared_from_this()](std::exception_ptr error,
+                                    std::unique_ptr<TransportStream> stream) {
+            if (error)
+            {
+                self->Fail(error);
+                return;
+            }
+
+            self->m_Stream = std::move(stream);
+            self->m_State = State::Negotiating;
+            self->Register();
+        });
+}
+
+void Http2Connection::Register(void)
+{
+    // NOTE: Handler may be called before `Add` returns
+    m_LastActivity = Clock::now();
+
+    try
+    {
+        m_EventLoop.Add(m_Stream->GetDescriptor(),
+                        EPOLLIN | EPOLLOUT | EPOLLRDHUP, shared_from_this());
+    }
+    catch (...)
+    {
+        Fail(std::current_exception());
+    }
+}
+
+bool Http2Connection::OnEvents(uint32_t events)
+{
+    (void)events;
+
+    try
+    {
+        if (m_State == State::Negotiating)
+        {
+            if (!m_Stream->Handshake())
+            {
+                ArmTimer();
+                return true;
+            }
+
+            if (m_Secure && m_Stream->GetProtocol() != s_Protocol)
+            {
+                // NOTE: Connection is handed over to HTTP/1.1 once it's no
+                // longer watched
+                m_Downgraded = true;
+                m_State = State::Closed;
+                return false;
+            }
+
+            Open();
+        }
+
+        Receive();
+        ResetCancelled();
+        m_Woken = false;
+        TakeMore();
+
+        if (m_GoingAway && !m_Detached)
+        {
+            // NOTE: Server takes no more streams, the ones in flight are
+            // finished while a new connection takes the queue
+            m_Detached = true;
+            m_ConnectionPool.DetachHttp2(m_Host, this);
+        }
+
+        FlushRetries();
+        Send();
+
+        // NOTE: GOAWAY has been exchanged and the last streams are done
+        if (m_State == State::Open && !nghttp2_session_want_read(m_Session) &&
+            !nghttp2_session_want_write(m_Session))
+        {
+            Close(nullptr);
+        }
+    }
+    catch (...)
+    {
+        Close(std::current_exception());
+    }
+
+    if (m_State == State::Closed)
+    {
+        return false;
+    }
+
+    DeliverCompletions();
+    ArmTimer();
+    return true;
+}
+
+void Http2Connection::OnRemoved(void)
+{
+    Finalize();
+}
+
+bool Http2Connection::OnTimer(void)
+{
+    m_TimerAt = Clock::time_point::max();
+
+    // NOTE: Bandwidth scheduler has tokens again for the data left in the
+    // stream, which epoll won't report a second time
+    const Clock::time_point now = Clock::now();
+    if (m_RetryAt <= now)
+    {
+        m_RetryAt = Clock::time_point::max();
+    }
+
+    if (m_State == State::Negotiating && !m_Pending.empty())
+    {
+        const auto timeout = m_Pending.front()->GetTimeouts().firstByte;
+        if (timeout.count() > 0 && m_LastActivity + timeout <= now)
+        {
+            Close(std::make_exception_ptr(
+                std::system_error(ETIMEDOUT, std::system_category(),
+                                  "No response from '" + m_Host + "'")));
+            return false;
+        }
+    }
+
+    if (m_State == State::Open && m_Streams.empty() && !m_Woken &&
+        m_IdleSince + s_IdleTimeout <= now)
+    {
+        // NOTE: GOAWAY is sent if the socket takes it, the server doesn't
+        // need it to tell that the connection is over
+        m_Detached = true;
+        m_ConnectionPool.DetachHttp2(m_Host, this);
+        (void)nghttp2_session_terminate_session(m_Session, NGHTTP2_NO_ERROR);
+        try
+        {
+            Send();
+        }
+        catch (...)
+        {
+        }
+
+        Close(nullptr);
+        return false;
+    }
+
+    CheckDeadlines(now);
+    StartHedges(now);
+    return OnEvents(0);
+}
+
+void Http2Connection::Open(void)
+{
+    m_State = State::Open;
+
+    // RFC 9113, 6.5.2. Defined Settings, pushed responses are of no use
+    const nghttp2_settings_entry settings[] = {
+        {NGHTTP2_SETTINGS_ENABLE_PUSH, 0},
+        {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, m_Settings.streamWindowSize},
+    };
+
+    int result = nghttp2_submit_settings(m_Session, NGHTTP2_FLAG_NONE,
+                                         settings, std::size(settings));
+    if (result == 0)
+    {
+        // RFC 9113, 6.9.2. Initial Flow-Control Window Size, the window of
+        // the connection is only changed with WINDOW_UPDATE
+        result = nghttp2_session_set_local_window_size(
+            m_Session, NGHTTP2_FLAG_NONE, 0,
+            static_cast<int32_t>(m_Settings.connectionWindowSize));
+    }
+
+    if (result != 0)
+    {
+        throw std::runtime_error(std::string("Failed to set up HTTP/2 "
+                                             "session: ") +
+                                 nghttp2_strerror(result));
+    }
+
+    m_IdleSince = Clock::now();
+    ConnectionPool::Downloads downloads = std::move(m_Pending);
+    m_Pending.clear();
+    Submit(std::move(downloads));
+}
+
+void Http2Connection::TakeMore(void)
+{
+    if (m_State != State::Open || m_Detached ||
+        !nghttp2_session_check_request_allowed(m_Session))
+    {
+        return;
+    }
+
+    const std::size_t limit = std::min<std::size_t>(
+        m_Settings.maxConcurrentStreams,
+        nghttp2_session_get_remote_settings(
+            m_Session, NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS));
+    if (m_Streams.size() < limit)
+    {
+        Submit(m_ConnectionPool.Take(m_Host, limit - m_Streams.size()));
+    }
+}
+
+void Http2Connection::Submit(ConnectionPool::Downloads downloads)
+{
+    const Clock::time_point now = Clock::now();
+
+    for (std::size_t i = 0; i < downloads.size(); ++i)
+    {
+        const std::shared_ptr<HttpDownload> &download = downloads[i];
+        const http::Uri &uri = download->GetUri();
+
+        // RFC 9113, 8.3.1. Request Pseudo-Header Fields
+        http::HeaderFields fields = {
+            {":method", "GET"},
+            {":scheme", uri.scheme},
+            {":authority",
+             uri.port.empty() ? uri.host : uri.host + ":" + uri.port},
+            {":path", (uri.path.empty() ? "/" : uri.path) +
+                          (uri.query.empty() ? "" : "?" + uri.query)},
+        };
+
+        // RFC 9113, 8.2.1. Field Validity, names are lowercase
+        for (const auto &[fieldName, fieldValue] : download->GetHeaderFields())
+        {
+            std::string name = fieldName;
+            std::transform(name.begin(), name.end(), name.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+            if (!IsConnectionSpecific(name))
+            {
+                fields.emplace_back(std::move(name), fieldValue);
+            }
+        }
+
+        // RFC 7617, 2. The 'Basic' Authentication Scheme
+        if (!uri.user.empty() || !uri.password.empty())
+        {
+            const std::string userinfo = uri.user + ':' + uri.password;
+            fields.emplace_back("authorization",
+                                "Basic " + http::detail::encodeBase64(
+                                               userinfo.begin(),
+                                               userinfo.end()));
+        }
+
+        std::vector<nghttp2_nv> nameValues;
+        nameValues.reserve(fields.size());
+        for (const auto &[name, value] : fields)
+        {
+            nameValues.push_back(MakeField(name, value));
+        }
+
+        const int32_t streamId =
+            nghttp2_submit_request(m_Session, nullptr, nameValues.data(),
+                                   nameValues.size(), nullptr, nullptr);
+        if (streamId < 0)
+        {
+            // NOTE: Stream IDs are used up or the session is going away,
+            // downloads which weren't sent go back to the queue
+            m_Retry.insert(m_Retry.end(),
+                           std::make_move_iterator(downloads.begin() + i),
+                           std::make_move_iterator(downloads.end()));
+            m_GoingAway = true;
+            return;
+        }
+
+        Clock::time_point hedgeTime = Clock::time_point::max();
+        const double percentile = download->GetHedgePercentile();
+        if (percentile > 0)
+        {
+            const auto latency = m_FirstByteLatency.GetPercentile(percentile);
+            if (latency)
+            {
+                hedgeTime = now + *latency;
+            }
+        }
+
+        // NOTE: Request goes out with the following `Send`, so the wait for
+        // its response starts right away
+        download->SetCancelHandler(MakeCancelHandler());
+        download->OnRequestSent(now, hedgeTime);
+
+        Stream &stream = m_Streams[streamId];
+        stream.download = download;
+        stream.lastActivity = now;
+    }
+}
+
+void Http2Connection::Send(void)
+{
+    for (;;)
+    {
+        if (m_SentSize == m_SendBuffer.size())
+        {
+            m_SendBuffer.clear();
+            m_SentSize = 0;
+
+            while (m_SendBuffer.size() < s_SendBatchSize)
+            {
+                const uint8_t *data = nullptr;
+                const ssize_t size = nghttp2_session_mem_send(m_Session, &data);
+                if (size < 0)
+                {
+                    throw std::runtime_error(
+                        std::string("Failed to send HTTP/2 frames: ") +
+                        nghttp2_strerror(static_cast<int>(size)));
+                }
+
+                if (size == 0)
+                {
+                    break;
+                }
+
+                m_SendBuffer.insert(m_SendBuffer.end(), data, data + size);
+            }
+
+            if (m_SendBuffer.empty())
+            {
+                return;
+            }
+        }
+
+        const std::size_t size =
+            m_Stream->TrySend(m_SendBuffer.data() + m_SentSize,
+                              m_SendBuffer.size() - m_SentSize);
+        if (size == TransportStream::s_WouldBlock)
+        {
+            return;
+        }
+
+        m_SentSize += size;
+    }
+}
+
+void Http2Connection::Receive(void)
+{
+    // NOTE: Frames are handled before the next read, so one buffer per
+    // reactor thread is enough
+    thread_local std::array<uint8_t, 65536> buffer;
+
+    BandwidthScheduler &scheduler = BandwidthScheduler::Get();
+
+    // NOTE: Edge-triggered mode requires reading until the stream is drained
+    while (m_State == State::Open)
+    {
+        BandwidthScheduler::Clock::time_point retryAt;
+        const std::size_t granted =
+            scheduler.Acquire(m_Flow, buffer.size(), retryAt);
+        if (granted == 0)
+        {
+            // NOTE: Waiting for tokens isn't the server's fault, it doesn't
+            // count towards the timeouts
+            m_RetryAt = retryAt;
+            const Clock::time_point now = Clock::now();
+            for (auto &[streamId, stream] : m_Streams)
+            {
+                stream.lastActivity = now;
+            }
+            return;
+        }
+
+        const std::size_t size = m_Stream->TryReceive(buffer.data(), granted);
+        if (size == TransportStream::s_WouldBlock)
+        {
+            scheduler.Refund(m_Flow, granted);
+            return;
+        }
+
+        scheduler.Refund(m_Flow, granted - size);
+        m_Limiter.OnReceived(size);
+        m_LastActivity = Clock::now();
+
+        if (size == 0)
+        {
+            Close(nullptr);
+            return;
+        }
+
+        const ssize_t result =
+            nghttp2_session_mem_recv(m_Session, buffer.data(), size);
+        if (result < 0)
+        {
+            throw std::runtime_error(
+                "HTTP/2 error on connection to '" + m_Host +
+                "': " + nghttp2_strerror(static_cast<int>(result)));
+        }
+    }
+}
+
+void Http2Connection::ResetStream(int32_t streamId, Stream &stream,
+                                  std::exception_ptr error)
+{
+    stream.reset = true;
+    stream.error = error;
+
+    // NOTE: Stream is closed once RST_STREAM is sent, which reports it to
+    // `OnStreamClosed`
+    (void)nghttp2_submit_rst_stream(m_Session, NGHTTP2_FLAG_NONE, streamId,
+                                    NGHTTP2_CANCEL);
+}
+
+void Http2Connection::ResetCancelled(void)
+{
+    // NOTE: Hedge has won, unlike HTTP/1.1 only the stream goes
+    for (auto &[streamId, stream] : m_Streams)
+    {
+        if (!stream.reset && stream.download->IsCancelled())
+        {
+            ResetStream(streamId, stream, nullptr);
+        }
+    }
+}
+
+void Http2Connection::ReportCongestion(std::exception_ptr error)
+{
+    std::string reason;
+    if (ConcurrencyLimiter::IsCongestion(error, reason))
+    {
+        m_Limiter.OnCongestion(reason);
+    }
+}
+
+Http2Connection::Clock::time_point Http2Connection::GetDeadline(
+    const Stream &stream) const
+{
+    const HttpDownload &download = *stream.download;
+    const Timeouts &timeouts = download.GetTimeouts();
+    if (download.IsResponseStarted())
+    {
+        return timeouts.idle.count() > 0 ? stream.lastActivity + timeouts.idle
+                                         : Clock::time_point::max();
+    }
+
+    return timeouts.firstByte.count() > 0
+               ? std::max(download.GetRequestTime(), stream.lastActivity) +
+                     timeouts.firstByte
+               : Clock::time_point::max();
+}
+
+void Http2Connection::ArmTimer(void)
+{
+    Clock::time_point timerAt = m_RetryAt;
+
+    if (m_State == State::Negotiating && !m_Pending.empty())
+    {
+        const auto timeout = m_Pending.front()->GetTimeouts().firstByte;
+        if (timeout.count() > 0)
+        {
+            timerAt = std::min(timerAt, m_LastActivity + timeout);
+        }
+    }
+
+    bool wake = m_Woken;
+    for (const auto &[streamId, stream] : m_Streams)
+    {
+        if (stream.reset)
+        {
+            continue;
+        }
+
+        timerAt = std::min(
+            {timerAt, GetDeadline(stream), stream.download->GetHedgeTime()});
+        wake = wake || stream.download->IsCancelled();
+    }
+
+    if (m_State == State::Open && m_Streams.empty())
+    {
+        timerAt = std::min(timerAt, m_IdleSince + s_IdleTimeout);
+    }
+
+    if (timerAt < m_TimerAt)
+    {
+        m_TimerAt = timerAt;
+        m_EventLoop.SetTimer(this, timerAt);
+    }
+
+    // NOTE: Wake-ups from other threads go through the timer, which the one
+    // set above may have replaced
+    if (wake)
+    {
+        m_TimerAt = Clock::now();
+        m_EventLoop.SetTimer(this, m_TimerAt);
+    }
+}
+
+void Http2Connection::CheckDeadlines(Clock::time_point now)
+{
+    for (auto &[streamId, stream] : m_Streams)
+    {
+        if (stream.reset || GetDeadline(stream) > now)
+        {
+            continue;
+        }
+
+        const std::string message =
+            stream.download->IsResponseStarted()
+                ? "Response from '" + m_Host + "' stalled"
+                : "No response from '" + m_Host + "'";
+        const std::exception_ptr error = std::make_exception_ptr(
+            std::system_error(ETIMEDOUT, std::system_category(), message));
+
+        ReportCongestion(error);
+        stream.retryable = true;
+        ResetStream(streamId, stream, error);
+    }
+}
+
+void Http2Connection::StartHedges(Clock::time_point now)
+{
+    for (const auto &[streamId, stream] : m_Streams)
+    {
+        if (!stream.reset && stream.download->GetHedgeTime() <= now)
+        {
+            m_ConnectionPool.Submit(
+                stream.download->Hedge(MakeCancelHandler()), true);
+        }
+    }
+}
+
+std::function<void(void)> Http2Connection::MakeCancelHandler(void)
+{
+    return [connection = weak_from_this(), &eventLoop = m_EventLoop]() {
+        if (const auto self = connection.lock())
+        {
+            eventLoop.SetTimer(self.get(), Clock::now());
+        }
+    };
+}
+
+void Http2Connection::Close(std::exception_ptr error)
+{
+    if (m_State == State::Closed)
+    {
+        return;
+    }
+
+    ReportCongestion(error);
+    m_State = State::Closed;
+
+    ConnectionPool::Downloads downloads = std::move(m_Pending);
+    m_Pending.clear();
+    for (auto &[streamId, stream] : m_Streams)
+    {
+        downloads.emplace_back(std::move(stream.download));
+    }
+    m_Streams.clear();
+
+    if (!error)
+    {
+        error = std::make_exception_ptr(http::ResponseError(
+            "Connection closed before the response was complete"));
+    }
+
+    for (auto &download : downloads)
+    {
+        // NOTE: Hedge has won, nothing waits for this download anymore
+        if (download->IsCancelled())
+        {
+            continue;
+        }
+
+        if (download->PrepareRetry())
+        {
+            m_Retry.emplace_back(std::move(download));
+            continue;
+        }
+
+        m_Finished.emplace_back(std::move(download), error);
+    }
+}
+
+void Http2Connection::Fail(std::exception_ptr error)
+{
+    // NOTE: Connection was never registered, so everything that's normally
+    // done when it's removed from the event loop happens right here
+    ReportCongestion(error);
+    m_State = State::Closed;
+    for (auto &download : m_Pending)
+    {
+        m_Finished.emplace_back(std::move(download), error);
+    }
+    m_Pending.clear();
+
+    Finalize();
+}
+
+void Http2Connection::Finalize(void)
+{
+    if (m_Downgraded)
+    {
+        m_ConnectionPool.Downgrade(m_Host, std::move(m_Stream),
+                                   std::move(m_Pending));
+        m_Pending.clear();
+        return;
+    }
+
+    // NOTE: Connection is detached first, so the retries go to a new one
+    m_Detached = true;
+    m_ConnectionPool.DetachHttp2(m_Host, this);
+    FlushRetries();
+
+    m_ConnectionPool.Release(m_Host, nullptr);
+    m_Stream.reset();
+
+    DeliverCompletions();
+}
+
+void Http2Connection::FlushRetries(void)
+{
+    // NOTE: Retries go back to the front of the queue in their order,
+    // whichever connection of the host takes them
+    auto retry = std::move(m_Retry);
+    m_Retry.clear();
+
+    for (auto download = retry.rbegin(); download != retry.rend(); ++download)
+    {
+        m_ConnectionPool.Submit(std::move(*download), true);
+    }
+}
+
+void Http2Connection::DeliverCompletions(void)
+{
+    auto finished = std::move(m_Finished);
+    m_Finished.clear();
+
+    for (auto &[download, error] : finished)
+    {
+        download->Finish(error);
+    }
+}
+
+int Http2Connection::OnBeginHeaders(nghttp2_session *session,
+                                    const nghttp2_frame *frame,
+                                    void *userData)
+{
+    (void)session;
+
+    auto &self = *static_cast<Http2Connection *>(userData);
+    const auto found = self.m_Streams.find(frame->hd.stream_id);
+    if (frame->hd.type != NGHTTP2_HEADERS || found == self.m_Streams.end() ||
+        found->second.reset)
+    {
+        return 0;
+    }
+
+    Stream &stream = found->second;
+    HttpDownload &download = *stream.download;
+    stream.lastActivity = Clock::now();
+    if (download.IsResponseStarted())
+    {
+        return 0;
+    }
+
+    const Clock::time_point requestTime = download.GetRequestTime();
+    if (requestTime != Clock::time_point())
+    {
+        self.m_FirstByteLatency.Add(stream.lastActivity - requestTime);
+    }
+
+    if (!download.StartResponse())
+    {
+        // NOTE: Other request of the hedge has won
+        self.ResetStream(found->first, stream, nullptr);
+    }
+
+    return 0;
+}
+
+int Http2Connection::OnHeader(nghttp2_session *session,
+                              const nghttp2_frame *frame, const uint8_t *name,
+                              std::size_t nameSize, const uint8_t *value,
+                              std::size_t valueSize, uint8_t flags,
+                              void *userData)
+{
+    (void)session;
+    (void)flags;
+
+    auto &self = *static_cast<Http2Connection *>(userData);
+    const auto found = self.m_Streams.find(frame->hd.stream_id);
+    if (frame->hd.type != NGHTTP2_HEADERS || found == self.m_Streams.end() ||
+        found->second.reset || found->second.headerComplete)
+    {
+        return 0;
+    }
+
+    // RFC 9113, 8.3.2. Response Pseudo-Header Fields, `:status` comes
+    // first and becomes the status line
+    std::string &header = found->second.header;
+    const std::string_view fieldName(reinterpret_cast<const char *>(name),
+                                     nameSize);
+    const std::string_view fieldValue(reinterpret_cast<const char *>(value),
+                                      valueSize);
+    if (fieldName == ":status")
+    {
+        header.append("HTTP/2.0 ").append(fieldValue).append(" \r\n");
+    }
+    else if (!fieldName.empty() && fieldName.front() != ':')
+    {
+        header.append(fieldName).append(": ").append(fieldValue).append(
+            "\r\n");
+    }
+
+    return 0;
+}
+
+int Http2Connection::OnFrameReceived(nghttp2_session *session,
+                                     const nghttp2_frame *frame,
+                                     void *userData)
+{
+    (void)session;
+
+    auto &self = *static_cast<Http2Connection *>(userData);
+    if (frame->hd.type == NGHTTP2_GOAWAY)
+    {
+        self.m_GoingAway = true;
+        return 0;
+    }
+
+    // NOTE: Trailers arrive after the header is complete and are dropped
+    const auto found = self.m_Streams.find(frame->hd.stream_id);
+    if (frame->hd.type != NGHTTP2_HEADERS || found == self.m_Streams.end() ||
+        found->second.reset || found->second.headerComplete)
+    {
+        return 0;
+    }
+
+    Stream &stream = found->second;
+    try
+    {
+        const std::string header = std::move(stream.header.append("\r\n"));
+        stream.header.clear();
+
+        HttpDownload &download = *stream.download;
+        stream.complete = download.Parse(
+            reinterpret_cast<const uint8_t *>(header.data()), header.size());
+
+        // RFC 9110, 15.2. Informational 1xx, the final response follows
+        stream.headerComplete = download.GetStatusCode() >= 200;
+    }
+    catch (...)
+    {
+        self.ResetStream(found->first, stream, std::current_exception());
+    }
+
+    return 0;
+}
+
+int Http2Connection::OnDataReceived(nghttp2_session *session, uint8_t flags,
+                                    int32_t streamId, const uint8_t *data,
+                                    std::size_t size, void *userData)
+{
+    (void)session;
+    (void)flags;
+
+    auto &self = *static_cast<Http2Connection *>(userData);
+    const auto found = self.m_Streams.find(streamId);
+    if (found == self.m_Streams.end() || found->second.reset)
+    {
+        return 0;
+    }
+
+    Stream &stream = found->second;
+    stream.lastActivity = Clock::now();
+
+    try
+    {
+        if (!stream.headerComplete || stream.complete)
+        {
+            throw http::ResponseError("Unexpected data after the response");
+        }
+
+        HttpDownload &download = *stream.download;
+        stream.complete = download.Parse(data, size);
+        if (stream.complete && download.GetParsedSize() < size)
+        {
+            throw http::ResponseError("Body is longer than its Content-Length");
+        }
+    }
+    catch (...)
+    {
+        self.ResetStream(streamId, stream, std::current_exception());
+    }
+
+    return 0;
+}
+
+int Http2Connection::OnStreamClosed(nghttp2_session *session,
+                                    int32_t streamId, uint32_t errorCode,
+                                    void *userData)
+{
+    (void)session;
+
+    auto &self = *static_cast<Http2Connection *>(userData);
+    const auto found = self.m_Streams.find(streamId);
+    if (found == self.m_Streams.end())
+    {
+        return 0;
+    }
+
+    Stream stream = std::move(found->second);
+    self.m_Streams.erase(found);
+    if (self.m_Streams.empty())
+    {
+        self.m_IdleSince = Clock::now();
+    }
+
+    const std::shared_ptr<HttpDownload> &download = stream.download;
+
+    // NOTE: Hedge has won, nothing waits for this download anymore
+    if (download->IsCancelled())
+    {
+        return 0;
+    }
+
+    std::exception_ptr error = stream.error;
+    if (!error && errorCode == NGHTTP2_NO_ERROR)
+    {
+        try
+        {
+            // NOTE: End of the stream ends a body without Content-Length
+            if (!stream.complete)
+            {
+                download->OnConnectionClosed();
+            }
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        // RFC 6585, 4. 429 Too Many Requests and RFC 7231, 6.6.4. 503
+        // Service Unavailable
+        const int status = download->GetStatusCode();
+        if (!error && (status == http::Status::TooManyRequests ||
+                       status == http::Status::ServiceUnavailable))
+        {
+            self.m_Limiter.OnCongestion("HTTP " + std::to_string(status));
+        }
+    }
+    else if (!error)
+    {
+        // RFC 9113, 8.7. Request Reliability, refused streams weren't
+        // processed by the server
+        stream.retryable = errorCode == NGHTTP2_REFUSED_STREAM;
+        error = std::make_exception_ptr(std::runtime_error(
+            "Stream reset by '" + self.m_Host +
+            "': " + nghttp2_http2_strerror(errorCode)));
+    }
+
+    if (error && stream.retryable && download->PrepareRetry())
+    {
+        self.m_Retry.emplace_back(download);
+        return 0;
+    }
+
+    self.m_Finished.emplace_back(download, error);
+    return 0;
+}
+
+#endif // AHD_WITH_NGHTTP2
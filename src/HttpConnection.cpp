@@ -0,0 +1,698 @@
+#include "ahd/HttpConnection.hpp"
+#include "ahd/BandwidthScheduler.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace
+{
+// Pipe between the socket and the output file for `splice`
+struct SplicePipe
+{
+    inline static constexpr int s_PreferredCapacity = 1024 * 1024;
+
+    int readDescriptor = -1;
+    int writeDescriptor = -1;
+    std::size_t capacity = 0;
+
+    SplicePipe(void)
+    {
+        Open();
+    }
+
+    ~SplicePipe()
+    {
+        Close();
+    }
+
+    void Open(void)
+    {
+        int descriptors[2];
+        if (pipe2(descriptors, O_NONBLOCK | O_CLOEXEC) == -1)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to create pipe");
+        }
+
+        readDescriptor = descriptors[0];
+        writeDescriptor = descriptors[1];
+
+        // NOTE: Larger pipe means fewer system calls per body, the default
+        // capacity is used when the limit doesn't allow it
+        (void)fcntl(writeDescriptor, F_SETPIPE_SZ, s_PreferredCapacity);
+        const int size = fcntl(writeDescriptor, F_GETPIPE_SZ);
+        capacity = size > 0 ? static_cast<std::size_t>(size) : 65536;
+    }
+
+    void Close(void)
+    {
+        if (readDescriptor != -1)
+        {
+            close(readDescriptor);
+            close(writeDescriptor);
+            readDescriptor = writeDescriptor = -1;
+        }
+    }
+
+    // NOTE: Pipe with data of an unknown size left in it is useless
+    void Reset(void)
+    {
+        Close();
+        Open();
+    }
+};
+} // namespace
+
+HttpConnection::HttpConnection(ConnectionPool &connectionPool,
+                               EventLoop &eventLoop, std::string host,
+                               std::unique_ptr<TransportStream> stream)
+    : m_ConnectionPool(connectionPool), m_EventLoop(eventLoop),
+      m_Host(std::move(host)), m_Limiter(connectionPool.GetLimiter(m_Host)),
+      m_FirstByteLatency(connectionPool.GetFirstByteLatency(m_Host)),
+      m_State(State::Connecting), m_Stream(std::move(stream)),
+      m_Persistent(false), m_KeepAlive(false), m_InFlight(), m_SentCount(0),
+      m_SendBuffer(), m_SentSize(0), m_LastActivity(),
+      m_RetryAt(Clock::time_point::max()), m_TimerAt(Clock::time_point::max()),
+      m_Retry(), m_Finished()
+{
+}
+
+void HttpConnection::Start(ConnectionPool::Downloads downloads)
+{
+    const http::Uri &uri = downloads.front()->GetUri();
+    const std::chrono::milliseconds connectTimeout =
+        downloads.front()->GetTimeouts().connect;
+    Enqueue(std::move(downloads));
+
+    if (m_Stream)
+    {
+        // NOTE: Idle connection in the pool has already served a persistent
+        // response, one handed over by HTTP/2 has negotiated HTTP/1.1
+        m_Persistent = true;
+        m_State = State::Open;
+        TakeMore();
+        Register();
+        return;
+    }
+
+    Connect(uri, connectTimeout);
+}
+
+void HttpConnection::Connect(const http::Uri &uri,
+                             std::chrono::milliseconds timeout)
+{
+    m_ConnectionPool.GetTransport().Connect(
+        uri, timeout,
+        [self = shared_from_this()](std::exception_ptr error,
+                                    std::unique_ptr<TransportStream> stream) {
+            if (error)
+            {
+                self->Fail(error);
+                return;
+            }
+
+            self->m_Stream = std::move(stream);
+            self->m_State = State::Open;
+            self->Register();
+        });
+}
+
+void HttpConnection::Register(void)
+{
+    // NOTE: Handler may be called before `Add` returns
+    m_LastActivity = Clock::now();
+
+    try
+    {
+        m_EventLoop.Add(m_Stream->GetDescriptor(),
+                        EPOLLIN | EPOLLOUT | EPOLLRDHUP, shared_from_this());
+    }
+    catch (...)
+    {
+        Fail(std::current_exception());
+    }
+}
+
+bool HttpConnection::OnEvents(uint32_t events)
+{
+    (void)events;
+
+    try
+    {
+        if (IsFrontCancelled())
+        {
+            // NOTE: Hedge of the front request has won, response can't be
+            // skipped on HTTP/1.1 without reading it, so the connection goes
+            Close(nullptr);
+        }
+        else
+        {
+            Send();
+            Receive();
+        }
+    }
+    catch (...)
+    {
+        Close(std::current_exception());
+    }
+
+    if (m_State == State::Open && m_InFlight.empty())
+    {
+        // NOTE: All requests are answered and the queue is empty, the
+        // connection goes back to the pool
+        m_KeepAlive = true;
+        return false;
+    }
+
+    if (m_State == State::Closed)
+    {
+        return false;
+    }
+
+    DeliverCompletions();
+    ArmTimer();
+    return true;
+}
+
+void HttpConnection::OnRemoved(void)
+{
+    Finalize();
+}
+
+bool HttpConnection::OnTimer(void)
+{
+    m_TimerAt = Clock::time_point::max();
+
+    // NOTE: Bandwidth scheduler has tokens again for the data left in the
+    // stream, which epoll won't report a second time
+    const Clock::time_point now = Clock::now();
+    if (m_RetryAt <= now)
+    {
+        m_RetryAt = Clock::time_point::max();
+    }
+
+    if (!m_InFlight.empty() && GetDeadline() <= now)
+    {
+        const std::string message =
+            m_InFlight.front()->IsResponseStarted()
+                ? "Response from '" + m_Host + "' stalled"
+                : "No response from '" + m_Host + "'";
+        Close(std::make_exception_ptr(std::system_error(
+            ETIMEDOUT, std::system_category(), message)));
+        return false;
+    }
+
+    StartHedges(now);
+    return OnEvents(0);
+}
+
+void HttpConnection::Enqueue(ConnectionPool::Downloads downloads)
+{
+    for (auto &download : downloads)
+    {
+        const std::vector<uint8_t> &requestData = download->GetRequestData();
+        m_SendBuffer.insert(m_SendBuffer.end(), requestData.begin(),
+                            requestData.end());
+        download->SetCancelHandler(MakeCancelHandler());
+        m_InFlight.emplace_back(std::move(download));
+    }
+}
+
+void HttpConnection::TakeMore(void)
+{
+    if (!m_Persistent || m_State != State::Open)
+    {
+        return;
+    }
+
+    const std::size_t depth = m_ConnectionPool.GetPipelineDepth(m_Host);
+    if (m_InFlight.size() < depth)
+    {
+        Enqueue(m_ConnectionPool.Take(m_Host, depth - m_InFlight.size()));
+    }
+}
+
+void HttpConnection::Send(void)
+{
+    while (m_SentSize < m_SendBuffer.size())
+    {
+        const std::size_t size =
+            m_Stream->TrySend(m_SendBuffer.data() + m_SentSize,
+                              m_SendBuffer.size() - m_SentSize);
+        if (size == TransportStream::s_WouldBlock)
+        {
+            return;
+        }
+
+        m_SentSize += size;
+    }
+
+    m_SendBuffer.clear();
+    m_SentSize = 0;
+    OnRequestsSent();
+}
+
+void HttpConnection::OnRequestsSent(void)
+{
+    const Clock::time_point now = Clock::now();
+    for (; m_SentCount < m_InFlight.size(); ++m_SentCount)
+    {
+        HttpDownload &download = *m_InFlight[m_SentCount];
+
+        Clock::time_point hedgeTime = Clock::time_point::max();
+        const double percentile = download.GetHedgePercentile();
+        if (percentile > 0)
+        {
+            const auto latency = m_FirstByteLatency.GetPercentile(percentile);
+            if (latency)
+            {
+                hedgeTime = now + *latency;
+            }
+        }
+
+        download.OnRequestSent(now, hedgeTime);
+    }
+}
+
+void HttpConnection::Receive(void)
+{
+    // NOTE: Data is handed to the downloads right away, so one buffer per
+    // reactor thread is enough
+    thread_local std::array<uint8_t, 65536> buffer;
+
+    BandwidthScheduler &scheduler = BandwidthScheduler::Get();
+
+    // NOTE: Edge-triggered mode requires reading until the stream is drained
+    while (m_State == State::Open && !m_InFlight.empty())
+    {
+        const std::shared_ptr<HttpDownload> download = m_InFlight.front();
+        const std::size_t spliceSize =
+            m_Stream->CanSplice() ? download->GetSpliceSize() : 0;
+
+        BandwidthScheduler::Clock::time_point retryAt;
+        const std::size_t granted = scheduler.Acquire(
+            download->GetFlow(), spliceSize > 0 ? spliceSize : buffer.size(),
+            retryAt);
+        if (granted == 0)
+        {
+            // NOTE: Waiting for tokens isn't the server's fault, it doesn't
+            // count towards the idle timeout
+            m_RetryAt = retryAt;
+            m_LastActivity = Clock::now();
+            return;
+        }
+
+        const std::size_t size =
+            spliceSize > 0 ? Splice(download, granted)
+                           : m_Stream->TryReceive(buffer.data(), granted);
+        if (size == TransportStream::s_WouldBlock)
+        {
+            scheduler.Refund(download->GetFlow(), granted);
+            return;
+        }
+
+        scheduler.Refund(download->GetFlow(), granted - size);
+        m_Limiter.OnReceived(size);
+        m_LastActivity = Clock::now();
+
+        if (size == 0)
+        {
+            // NOTE: Server dropped the connection with more than one request
+            // in flight, it most likely doesn't handle pipelining
+            if (m_InFlight.size() > 1)
+            {
+                m_ConnectionPool.DisablePipelining(m_Host);
+            }
+
+            Close(nullptr);
+            return;
+        }
+
+        if (spliceSize == 0)
+        {
+            Feed(buffer.data(), size);
+        }
+    }
+}
+
+std::size_t HttpConnection::Splice(
+    const std::shared_ptr<HttpDownload> &download, std::size_t size)
+{
+    // NOTE: Pipe is only a window between the socket and the file, it's
+    // drained completely after every transfer
+    thread_local SplicePipe pipe;
+
+    ssize_t received = -1;
+    do
+    {
+        received = splice(m_Stream->GetDescriptor(), nullptr,
+                          pipe.writeDescriptor, nullptr,
+                          std::min(size, pipe.capacity),
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    } while (received == -1 && errno == EINTR);
+
+    if (received == -1)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return TransportStream::s_WouldBlock;
+        }
+
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to splice from socket");
+    }
+
+    if (received == 0)
+    {
+        return 0;
+    }
+
+    const HttpDownload::FileSink &fileSink = download->GetFileSink();
+    loff_t offset = static_cast<loff_t>(fileSink.getOffset());
+    std::size_t remaining = static_cast<std::size_t>(received);
+
+    while (remaining > 0)
+    {
+        const ssize_t written =
+            splice(pipe.readDescriptor, nullptr, fileSink.descriptor, &offset,
+                   remaining, SPLICE_F_MOVE);
+        if (written == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (written == -1)
+        {
+            const int error = errno;
+            const std::size_t spliced =
+                static_cast<std::size_t>(received) - remaining;
+
+            // NOTE: File system may not support splice, the data stuck in
+            // the pipe goes through the body sink and so does everything
+            // after it
+            std::vector<uint8_t> stuck(remaining);
+            const bool drained =
+                read(pipe.readDescriptor, stuck.data(), stuck.size()) ==
+                static_cast<ssize_t>(stuck.size());
+            if (!drained)
+            {
+                pipe.Reset();
+            }
+
+            if (!drained || (error != EINVAL && error != EOPNOTSUPP))
+            {
+                throw std::system_error(error, std::system_category(),
+                                        "Failed to splice to file");
+            }
+
+            download->DisableSplice();
+            if (spliced > 0)
+            {
+                download->OnSpliced(spliced);
+            }
+
+            Feed(stuck.data(), stuck.size());
+            return static_cast<std::size_t>(received);
+        }
+
+        remaining -= static_cast<std::size_t>(written);
+    }
+
+    if (download->OnSpliced(static_cast<std::size_t>(received)))
+    {
+        OnResponseComplete(download, false);
+    }
+
+    return static_cast<std::size_t>(received);
+}
+
+void HttpConnection::Feed(const uint8_t *data, std::size_t size)
+{
+    while (size > 0)
+    {
+        if (m_InFlight.empty())
+        {
+            throw http::ResponseError("Unexpected data after the response");
+        }
+
+        const std::shared_ptr<HttpDownload> download = m_InFlight.front();
+        if (!download->IsResponseStarted() && !StartResponse(download))
+        {
+            return;
+        }
+
+        if (!download->Parse(data, size))
+        {
+            return;
+        }
+
+        // NOTE: Rest of the data belongs to the next pipelined response
+        const std::size_t parsedSize = download->GetParsedSize();
+        data += parsedSize;
+        size -= parsedSize;
+
+        if (!OnResponseComplete(download, size > 0))
+        {
+            return;
+        }
+    }
+}
+
+bool HttpConnection::StartResponse(
+    const std::shared_ptr<HttpDownload> &download)
+{
+    const Clock::time_point requestTime = download->GetRequestTime();
+    if (requestTime != Clock::time_point())
+    {
+        m_FirstByteLatency.Add(Clock::now() - requestTime);
+    }
+
+    if (download->StartResponse())
+    {
+        return true;
+    }
+
+    // NOTE: Other request of the hedge has won, the rest of this response
+    // is never going to be used
+    Close(nullptr);
+    return false;
+}
+
+bool HttpConnection::OnResponseComplete(
+    const std::shared_ptr<HttpDownload> &download, bool moreData)
+{
+    m_InFlight.pop_front();
+    if (m_SentCount > 0)
+    {
+        --m_SentCount;
+    }
+    m_Finished.emplace_back(download, nullptr);
+
+    // RFC 6585, 4. 429 Too Many Requests and RFC 7231, 6.6.4. 503 Service
+    // Unavailable
+    const int status = download->GetStatusCode();
+    if (status == http::Status::TooManyRequests ||
+        status == http::Status::ServiceUnavailable)
+    {
+        m_Limiter.OnCongestion("HTTP " + std::to_string(status));
+    }
+
+    // RFC 7230, 6.6. Tear-down, requests after the last response will never
+    // be answered and are sent again over another connection
+    if (!download->IsKeepAlive())
+    {
+        if (moreData)
+        {
+            throw http::ResponseError(
+                "Unexpected data after the last response");
+        }
+
+        Close(nullptr);
+        return false;
+    }
+
+    m_Persistent = true;
+    TakeMore();
+    Send();
+    return true;
+}
+
+void HttpConnection::ReportCongestion(std::exception_ptr error)
+{
+    std::string reason;
+    if (ConcurrencyLimiter::IsCongestion(error, reason))
+    {
+        m_Limiter.OnCongestion(reason);
+    }
+}
+
+HttpConnection::Clock::time_point HttpConnection::GetDeadline(void) const
+{
+    if (m_InFlight.empty())
+    {
+        return Clock::time_point::max();
+    }
+
+    const HttpDownload &download = *m_InFlight.front();
+    const Timeouts &timeouts = download.GetTimeouts();
+    if (download.IsResponseStarted())
+    {
+        return timeouts.idle.count() > 0 ? m_LastActivity + timeouts.idle
+                                         : Clock::time_point::max();
+    }
+
+    // NOTE: Pipelined response can't start before the previous one has
+    // ended, so the wait is counted from whichever is later
+    return timeouts.firstByte.count() > 0
+               ? std::max(download.GetRequestTime(), m_LastActivity) +
+                     timeouts.firstByte
+               : Clock::time_point::max();
+}
+
+void HttpConnection::ArmTimer(void)
+{
+    Clock::time_point timerAt = std::min(GetDeadline(), m_RetryAt);
+    for (const auto &download : m_InFlight)
+    {
+        timerAt = std::min(timerAt, download->GetHedgeTime());
+    }
+
+    if (timerAt < m_TimerAt)
+    {
+        m_TimerAt = timerAt;
+        m_EventLoop.SetTimer(this, timerAt);
+    }
+
+    // NOTE: Hedge which has won on another thread wakes the connection up
+    // through the timer, which the one set above may have replaced
+    if (IsFrontCancelled())
+    {
+        m_TimerAt = Clock::now();
+        m_EventLoop.SetTimer(this, m_TimerAt);
+    }
+}
+
+void HttpConnection::StartHedges(Clock::time_point now)
+{
+    for (const auto &download : m_InFlight)
+    {
+        if (download->GetHedgeTime() <= now)
+        {
+            m_ConnectionPool.Submit(download->Hedge(MakeCancelHandler()),
+                                    true);
+        }
+    }
+}
+
+std::function<void(void)> HttpConnection::MakeCancelHandler(void)
+{
+    return [connection = weak_from_this(), &eventLoop = m_EventLoop]() {
+        if (const auto self = connection.lock())
+        {
+            eventLoop.SetTimer(self.get(), Clock::now());
+        }
+    };
+}
+
+bool HttpConnection::IsFrontCancelled(void) const
+{
+    return !m_InFlight.empty() && m_InFlight.front()->IsCancelled();
+}
+
+void HttpConnection::Close(std::exception_ptr error)
+{
+    if (m_State == State::Closed)
+    {
+        return;
+    }
+
+    ReportCongestion(error);
+
+    m_State = State::Closed;
+    m_KeepAlive = false;
+
+    for (auto &download : m_InFlight)
+    {
+        // NOTE: Hedge has won, nothing waits for this download anymore
+        if (download->IsCancelled())
+        {
+            error = nullptr;
+            continue;
+        }
+
+        if (download->PrepareRetry())
+        {
+            m_Retry.emplace_back(std::move(download));
+            continue;
+        }
+
+        std::exception_ptr downloadError = error;
+        if (!downloadError)
+        {
+            try
+            {
+                // NOTE: Response without a length ends with the connection
+                download->OnConnectionClosed();
+            }
+            catch (...)
+            {
+                downloadError = std::current_exception();
+            }
+        }
+
+        m_Finished.emplace_back(std::move(download), downloadError);
+        error = nullptr;
+    }
+
+    m_InFlight.clear();
+    m_SentCount = 0;
+}
+
+void HttpConnection::Fail(std::exception_ptr error)
+{
+    // NOTE: Connection was never registered, so everything that's normally
+    // done when it's removed from the event loop happens right here
+    ReportCongestion(error);
+    m_State = State::Closed;
+    for (auto &download : m_InFlight)
+    {
+        m_Finished.emplace_back(std::move(download), error);
+    }
+    m_InFlight.clear();
+    m_SentCount = 0;
+
+    Finalize();
+}
+
+void HttpConnection::Finalize(void)
+{
+    if (!m_Retry.empty())
+    {
+        m_ConnectionPool.Requeue(m_Host, std::move(m_Retry));
+        m_Retry.clear();
+    }
+
+    // NOTE: Downloads are completed after the connection is back in the
+    // pool, so the next download can pick it up
+    m_ConnectionPool.Release(m_Host,
+                             m_KeepAlive ? std::move(m_Stream) : nullptr);
+    m_Stream.reset();
+
+    DeliverCompletions();
+}
+
+void HttpConnection::DeliverCompletions(void)
+{
+    auto finished = std::move(m_Finished);
+    m_Finished.clear();
+
+    for (auto &[download, error] : finished)
+    {
+        download->Finish(error);
+    }
+}
@@ -0,0 +1,323 @@
+#include "ahd/HttpDownload.hpp"
+#include "ahd/ConnectionPool.hpp"
+
+HttpDownload::HttpDownload(const std::string &requestUrl,
+                           http::BodySink bodySink,
+                           CompletionHandler onComplete)
+    : HttpDownload(requestUrl, {}, {}, std::move(bodySink),
+                   std::move(onComplete))
+{
+}
+
+HttpDownload::HttpDownload(const std::string &requestUrl,
+                           http::HeaderFields headerFields,
+                           http::HeaderHandler headerHandler,
+                           http::BodySink bodySink,
+                           CompletionHandler onComplete)
+    : m_Uri(http::parseUri(requestUrl.begin(), requestUrl.end())),
+      m_PoolKey(m_Uri.scheme + "://" + m_Uri.host + ":" +
+                (m_Uri.port.empty()
+                     ? std::string(m_Uri.scheme == "https" ? "443" : "80")
+                     : m_Uri.port)),
+      m_HeaderFields(std::move(headerFields)),
+      m_RequestData(http::encodeHtml(m_Uri, GET_REQUEST, {}, m_HeaderFields)),
+      m_HeaderHandler(std::move(headerHandler)),
+      m_BodySink(std::move(bodySink)), m_Response(),
+      m_Parser(m_Response, m_BodySink, m_HeaderHandler),
+      m_OnComplete(std::move(onComplete)), m_FileSink(),
+      m_Flow(BandwidthScheduler::Get(), m_PoolKey), m_Weight(1),
+      m_Timeouts(), m_HedgePercentile(0), m_Hedge(), m_HedgeIndex(0),
+      m_RequestTime(), m_HedgeTime(Clock::time_point::max()),
+      m_SpliceEnabled(true), m_Spliced(false), m_ResponseStarted(false),
+      m_Retries(0)
+{
+}
+
+HttpDownload::HttpDownload(const HttpDownload &original,
+                           std::shared_ptr<HedgeState> hedge)
+    : m_Uri(original.m_Uri), m_PoolKey(original.m_PoolKey),
+      m_HeaderFields(original.m_HeaderFields),
+      m_RequestData(original.m_RequestData),
+      m_HeaderHandler(original.m_HeaderHandler),
+      m_BodySink(original.m_BodySink), m_Response(),
+      m_Parser(m_Response, m_BodySink, m_HeaderHandler), m_OnComplete(),
+      m_FileSink(original.m_FileSink),
+      m_Flow(BandwidthScheduler::Get(), m_PoolKey),
+      m_Weight(original.m_Weight), m_Timeouts(original.m_Timeouts),
+      m_HedgePercentile(0), m_Hedge(std::move(hedge)), m_HedgeIndex(1),
+      m_RequestTime(), m_HedgeTime(Clock::time_point::max()),
+      m_SpliceEnabled(original.m_SpliceEnabled), m_Spliced(false),
+      m_ResponseStarted(false), m_Retries(0)
+{
+    m_Flow.SetWeight(m_Weight);
+}
+
+void HttpDownload::SetFileSink(FileSink fileSink)
+{
+    m_FileSink = std::move(fileSink);
+}
+
+void HttpDownload::SetWeight(double weight)
+{
+    m_Weight = weight;
+    m_Flow.SetWeight(weight);
+}
+
+void HttpDownload::SetTimeouts(const Timeouts &timeouts)
+{
+    m_Timeouts = timeouts;
+}
+
+void HttpDownload::SetHedgePercentile(double percentile)
+{
+    m_HedgePercentile = percentile;
+}
+
+void HttpDownload::Start(ConnectionPool &connectionPool)
+{
+    connectionPool.Submit(shared_from_this());
+}
+
+const http::Uri &HttpDownload::GetUri(void) const
+{
+    return m_Uri;
+}
+
+const std::string &HttpDownload::GetPoolKey(void) const
+{
+    return m_PoolKey;
+}
+
+const std::vector<uint8_t> &HttpDownload::GetRequestData(void) const
+{
+    return m_RequestData;
+}
+
+const http::HeaderFields &HttpDownload::GetHeaderFields(void) const
+{
+    return m_HeaderFields;
+}
+
+BandwidthScheduler::Flow &HttpDownload::GetFlow(void)
+{
+    return m_Flow;
+}
+
+const Timeouts &HttpDownload::GetTimeouts(void) const
+{
+    return m_Timeouts;
+}
+
+double HttpDownload::GetHedgePercentile(void) const
+{
+    // NOTE: Request is hedged at most once
+    return m_Hedge ? 0 : m_HedgePercentile;
+}
+
+void HttpDownload::OnRequestSent(Clock::time_point time,
+                                 Clock::time_point hedgeTime)
+{
+    m_RequestTime = time;
+    m_HedgeTime = m_Hedge ? Clock::time_point::max() : hedgeTime;
+}
+
+HttpDownload::Clock::time_point HttpDownload::GetRequestTime(void) const
+{
+    return m_RequestTime;
+}
+
+HttpDownload::Clock::time_point HttpDownload::GetHedgeTime(void) const
+{
+    return m_ResponseStarted ? Clock::time_point::max() : m_HedgeTime;
+}
+
+std::shared_ptr<HttpDownload> HttpDownload::Hedge(
+    std::function<void(void)> onCancelled)
+{
+    auto hedge = std::make_shared<HedgeState>();
+    hedge->onComplete = std::move(m_OnComplete);
+    hedge->onCancelled[m_HedgeIndex] = std::move(onCancelled);
+
+    m_Hedge = hedge;
+    m_HedgeTime = Clock::time_point::max();
+
+    // NOTE: Constructor is private, so `std::make_shared` can't be used
+    return std::shared_ptr<HttpDownload>(
+        new HttpDownload(*this, std::move(hedge)));
+}
+
+void HttpDownload::SetCancelHandler(std::function<void(void)> onCancelled)
+{
+    if (!m_Hedge)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Hedge->mutex);
+    m_Hedge->onCancelled[m_HedgeIndex] = std::move(onCancelled);
+}
+
+bool HttpDownload::IsCancelled(void) const
+{
+    if (!m_Hedge)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Hedge->mutex);
+    return m_Hedge->winner != -1 && m_Hedge->winner != m_HedgeIndex;
+}
+
+bool HttpDownload::StartResponse(void)
+{
+    m_ResponseStarted = true;
+    if (!m_Hedge)
+    {
+        return true;
+    }
+
+    std::function<void(void)> onCancelled;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Hedge->mutex);
+        if (m_Hedge->winner != -1)
+        {
+            return m_Hedge->winner == m_HedgeIndex;
+        }
+
+        m_Hedge->winner = m_HedgeIndex;
+        onCancelled = std::move(m_Hedge->onCancelled[1 - m_HedgeIndex]);
+    }
+
+    // NOTE: Connection of the loser is woken up to close, it may still be
+    // waiting for a response that's never going to be used
+    if (onCancelled)
+    {
+        onCancelled();
+    }
+
+    return true;
+}
+
+bool HttpDownload::IsResponseStarted(void) const
+{
+    return m_ResponseStarted;
+}
+
+bool HttpDownload::Parse(const uint8_t *data, std::size_t size)
+{
+    return m_Parser.parse(data, size);
+}
+
+void HttpDownload::OnConnectionClosed(void)
+{
+    m_Parser.finish();
+}
+
+bool HttpDownload::IsKeepAlive(void) const
+{
+    // RFC 7230, 6.3. Persistence
+    return m_Parser.isKeepAlive();
+}
+
+int HttpDownload::GetStatusCode(void) const
+{
+    return m_Response.status.code;
+}
+
+std::size_t HttpDownload::GetParsedSize(void) const
+{
+    return m_Parser.getParsedSize();
+}
+
+std::size_t HttpDownload::GetSpliceSize(void) const
+{
+    // NOTE: Only the file's own content goes past the body sink, error
+    // pages and such are left to it
+    const auto status = m_Response.status.code;
+    if (!m_SpliceEnabled || m_FileSink.descriptor == -1 ||
+        (status != http::Status::Ok && status != http::Status::PartialContent))
+    {
+        return 0;
+    }
+
+    // NOTE: Once started, the body is spliced up to the end
+    const std::size_t size = m_Parser.remainingBodySize();
+    if (m_Spliced || size == 0)
+    {
+        return size;
+    }
+
+    if (size < s_MinSpliceSize)
+    {
+        return 0;
+    }
+
+    // NOTE: Encoded body is left to the body sink, which decodes it when
+    // the encoding was asked for
+    for (const auto &[fieldName, fieldValue] : m_Response.headerFields)
+    {
+        if (fieldName == "content-encoding" && fieldValue != "identity")
+        {
+            return 0;
+        }
+    }
+
+    return size;
+}
+
+const HttpDownload::FileSink &HttpDownload::GetFileSink(void) const
+{
+    return m_FileSink;
+}
+
+bool HttpDownload::OnSpliced(std::size_t size)
+{
+    m_Parser.skipBody(size);
+    m_FileSink.onWritten(size);
+    m_Spliced = true;
+    return m_Parser.isComplete();
+}
+
+void HttpDownload::DisableSplice(void)
+{
+    m_SpliceEnabled = false;
+}
+
+bool HttpDownload::PrepareRetry(void)
+{
+    if (m_ResponseStarted || m_Retries >= s_MaxRetries)
+    {
+        return false;
+    }
+
+    ++m_Retries;
+    return true;
+}
+
+void HttpDownload::Finish(std::exception_ptr error)
+{
+    CompletionHandler onComplete = std::move(m_OnComplete);
+    m_OnComplete = nullptr;
+
+    if (m_Hedge)
+    {
+        // NOTE: Before either has won, a failure is reported only once the
+        // other request has failed too
+        std::lock_guard<std::mutex> lock(m_Hedge->mutex);
+        --m_Hedge->pending;
+        if (m_Hedge->winner == m_HedgeIndex ||
+            (m_Hedge->winner == -1 && m_Hedge->pending == 0))
+        {
+            onComplete = std::move(m_Hedge->onComplete);
+            m_Hedge->onComplete = nullptr;
+        }
+    }
+
+    if (onComplete)
+    {
+        onComplete(error);
+    }
+}
+
+const char *HttpDownload::GET_REQUEST = "GET";
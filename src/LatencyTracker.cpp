@@ -0,0 +1,49 @@
+#include "ahd/LatencyTracker.hpp"
+#include <algorithm>
+#include <cmath>
+
+LatencyTracker::LatencyTracker(void) : m_Mutex(), m_Samples(), m_Next(0)
+{
+    m_Samples.reserve(s_MaxSamples);
+}
+
+void LatencyTracker::Add(Duration latency)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Samples.size() < s_MaxSamples)
+    {
+        m_Samples.push_back(latency);
+        return;
+    }
+
+    m_Samples[m_Next] = latency;
+    m_Next = (m_Next + 1) % s_MaxSamples;
+}
+
+std::optional<LatencyTracker::Duration> LatencyTracker::GetPercentile(
+    double percentile) const
+{
+    std::vector<Duration> samples;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Samples.size() < s_MinSamples)
+        {
+            return std::nullopt;
+        }
+
+        samples = m_Samples;
+    }
+
+    // NOTE: Nearest rank, so the result is always one of the samples
+    const double rank =
+        std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 *
+                  static_cast<double>(samples.size()));
+    const std::size_t index =
+        std::clamp<std::size_t>(static_cast<std::size_t>(rank), 1,
+                                samples.size()) -
+        1;
+
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
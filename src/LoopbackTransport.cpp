@@ -0,0 +1,629 @@
+#include "ahd/LoopbackTransport.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// NOTE: Body byte at offset `i` is `pattern[i % pattern.size()]`, the prime
+// size keeps the pattern from lining up with buffer sizes
+using Pattern = std::array<uint8_t, 65521>;
+
+const Pattern &GetPattern(void)
+{
+    static const Pattern pattern = []() {
+        Pattern result;
+        for (std::size_t i = 0; i < result.size(); ++i)
+        {
+            result[i] = static_cast<uint8_t>((i * 2654435761u) >> 24);
+        }
+        return result;
+    }();
+    return pattern;
+}
+
+std::string ToLower(std::string value)
+{
+    std::transform(value.begin(), value.end(), value.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return value;
+}
+
+// NOTE: Calls `handler` with the name and value of every `name=value` item
+// of the list, returns `false` as soon as the handler does
+template <typename Handler>
+bool ForEachOption(const std::string &options, char separator,
+                   Handler handler)
+{
+    std::size_t start = 0;
+    while (start < options.size())
+    {
+        std::size_t end = options.find(separator, start);
+        if (end == std::string::npos)
+        {
+            end = options.size();
+        }
+
+        const std::string item = options.substr(start, end - start);
+        const auto equals = item.find('=');
+        if (!item.empty() &&
+            !handler(item.substr(0, equals),
+                     equals == std::string::npos ? std::string()
+                                                 : item.substr(equals + 1)))
+        {
+            return false;
+        }
+
+        start = end + 1;
+    }
+
+    return true;
+}
+
+struct Response
+{
+    std::string header;
+    std::size_t headerSent = 0;
+    // NOTE: Offset of the body in the synthetic entity
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    uint64_t sent = 0;
+    uint64_t rate = 0;
+    // NOTE: Set when the body starts, the rate is measured from there
+    Clock::time_point start;
+    bool close = false;
+};
+
+// In-memory server of one connection. Requests are answered as soon as
+// their header section is complete, responses of pipelined requests are
+// queued in order. Descriptor is a timer, which is set to expire whenever
+// the stream has something new to receive
+class LoopbackStream : public TransportStream
+{
+public:
+    LoopbackStream(uint64_t size, uint64_t rate)
+        : m_Descriptor(timerfd_create(CLOCK_MONOTONIC,
+                                      TFD_NONBLOCK | TFD_CLOEXEC)),
+          m_Size(size), m_Rate(rate), m_Input(), m_Responses(),
+          m_Waiting(false), m_Closed(false)
+    {
+        if (m_Descriptor == -1)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to create timer");
+        }
+
+        // NOTE: Stands for the socket becoming writable on connect
+        Notify(Clock::now());
+    }
+
+    virtual ~LoopbackStream()
+    {
+        close(m_Descriptor);
+    }
+
+    virtual int GetDescriptor(void) const override
+    {
+        return m_Descriptor;
+    }
+
+    virtual std::size_t TrySend(const uint8_t *data,
+                                std::size_t size) override
+    {
+        if (m_Closed)
+        {
+            throw std::system_error(EPIPE, std::system_category(),
+                                    "Failed to send data");
+        }
+
+        m_Input.append(reinterpret_cast<const char *>(data), size);
+        Answer();
+
+        if (m_Waiting && !m_Responses.empty())
+        {
+            m_Waiting = false;
+            Notify(Clock::now());
+        }
+
+        return size;
+    }
+
+    virtual std::size_t TryReceive(uint8_t *data, std::size_t size) override
+    {
+        const Clock::time_point now = Clock::now();
+        std::size_t received = 0;
+
+        while (received < size && !m_Responses.empty())
+        {
+            Response &response = m_Responses.front();
+
+            const std::size_t headerSize =
+                std::min(response.header.size() - response.headerSent,
+                         size - received);
+            std::memcpy(data + received,
+                        response.header.data() + response.headerSent,
+                        headerSize);
+            response.headerSent += headerSize;
+            received += headerSize;
+            if (response.headerSent < response.header.size())
+            {
+                break;
+            }
+
+            if (response.start == Clock::time_point())
+            {
+                response.start = now;
+            }
+
+            const uint64_t available = GetAvailable(response, now);
+            const std::size_t bodySize = static_cast<std::size_t>(
+                std::min<uint64_t>(available, size - received));
+            CopyBody(response, data + received, bodySize);
+            received += bodySize;
+
+            if (response.sent < response.length)
+            {
+                if (bodySize == available)
+                {
+                    // NOTE: Rest of the body isn't due yet
+                    break;
+                }
+                continue;
+            }
+
+            const bool close = response.close;
+            m_Responses.pop_front();
+            if (close)
+            {
+                m_Closed = true;
+                m_Responses.clear();
+                break;
+            }
+        }
+
+        if (received > 0)
+        {
+            return received;
+        }
+
+        if (m_Closed)
+        {
+            return 0;
+        }
+
+        if (!m_Responses.empty())
+        {
+            const Response &response = m_Responses.front();
+            const uint64_t due = std::min(
+                response.length,
+                (response.sent / s_PacingQuantum + 1) * s_PacingQuantum);
+            Notify(response.start +
+                   std::chrono::duration_cast<Clock::duration>(
+                       std::chrono::duration<double>(
+                           static_cast<double>(due) / response.rate)));
+            return s_WouldBlock;
+        }
+
+        m_Waiting = true;
+        return s_WouldBlock;
+    }
+
+    virtual bool IsAlive(void) const override
+    {
+        return !m_Closed && m_Input.empty() && m_Responses.empty();
+    }
+
+private:
+    // NOTE: Body bytes the rate allows to be received by `now`. Paced body
+    // is released a quantum at a time, so a stream isn't read byte by byte
+    static uint64_t GetAvailable(const Response &response,
+                                 Clock::time_point now)
+    {
+        const uint64_t remaining = response.length - response.sent;
+        if (response.rate == 0)
+        {
+            return remaining;
+        }
+
+        const double elapsed =
+            std::chrono::duration<double>(now - response.start).count();
+        uint64_t due = static_cast<uint64_t>(elapsed * response.rate);
+        due = due >= response.length
+                  ? response.length
+                  : due / s_PacingQuantum * s_PacingQuantum;
+        return due > response.sent ? std::min(remaining, due - response.sent)
+                                   : 0;
+    }
+
+    static void CopyBody(Response &response, uint8_t *data, std::size_t size)
+    {
+        const Pattern &pattern = GetPattern();
+        while (size > 0)
+        {
+            const std::size_t start = static_cast<std::size_t>(
+                (response.offset + response.sent) % pattern.size());
+            const std::size_t chunk = std::min(size, pattern.size() - start);
+            std::memcpy(data, pattern.data() + start, chunk);
+            data += chunk;
+            size -= chunk;
+            response.sent += chunk;
+        }
+    }
+
+    // NOTE: Timer fires once, setting it again clears the expiration so the
+    // next one is a new edge for epoll
+    void Notify(Clock::time_point time)
+    {
+        const auto delay = std::max<Clock::duration>(
+            time - Clock::now(), std::chrono::nanoseconds(1));
+        const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(
+            delay);
+
+        itimerspec value = {};
+        value.it_value.tv_sec = static_cast<time_t>(seconds.count());
+        value.it_value.tv_nsec = static_cast<long>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(delay -
+                                                                 seconds)
+                .count());
+        if (timerfd_settime(m_Descriptor, 0, &value, nullptr) == -1)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to set timer");
+        }
+    }
+
+    // NOTE: Queues a response for every complete request, nothing after a
+    // request which closes the connection is answered
+    void Answer(void)
+    {
+        for (;;)
+        {
+            const auto end = m_Input.find("\r\n\r\n");
+            if (end == std::string::npos)
+            {
+                return;
+            }
+
+            const std::string header = m_Input.substr(0, end);
+            m_Input.erase(0, end + 4);
+
+            m_Responses.emplace_back(Respond(header));
+            if (m_Responses.back().close)
+            {
+                m_Input.clear();
+                return;
+            }
+        }
+    }
+
+    Response Respond(const std::string &header) const
+    {
+        // RFC 7230, 3.1.1. Request Line
+        const auto lineEnd = header.find("\r\n");
+        const std::string requestLine = header.substr(0, lineEnd);
+        const auto methodEnd = requestLine.find(' ');
+        const auto targetEnd = requestLine.rfind(' ');
+        if (methodEnd == std::string::npos || targetEnd == methodEnd)
+        {
+            return MakeError(400, "Bad Request");
+        }
+
+        const std::string method = requestLine.substr(0, methodEnd);
+        const std::string target =
+            requestLine.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+
+        std::unordered_map<std::string, std::string> fields;
+        std::size_t start = lineEnd == std::string::npos
+                                ? header.size()
+                                : lineEnd + 2;
+        while (start < header.size())
+        {
+            std::size_t end = header.find("\r\n", start);
+            if (end == std::string::npos)
+            {
+                end = header.size();
+            }
+
+            const std::string line = header.substr(start, end - start);
+            const auto colon = line.find(':');
+            if (colon != std::string::npos)
+            {
+                const auto valueStart =
+                    line.find_first_not_of(" \t", colon + 1);
+                fields[ToLower(line.substr(0, colon))] =
+                    valueStart == std::string::npos ? ""
+                                                    : line.substr(valueStart);
+            }
+
+            start = end + 2;
+        }
+
+        // NOTE: Request bodies aren't read, the stream can't continue
+        // after one
+        const auto contentLength = fields.find("content-length");
+        if (contentLength != fields.end() && contentLength->second != "0")
+        {
+            return MakeError(400, "Bad Request");
+        }
+
+        if (method != "GET" && method != "HEAD")
+        {
+            return MakeError(501, "Not Implemented");
+        }
+
+        uint64_t size = m_Size;
+        uint64_t rate = m_Rate;
+        const auto query = target.find('?');
+        if (query != std::string::npos &&
+            !ForEachOption(target.substr(query + 1), '&',
+                           [&](const std::string &name,
+                               const std::string &value) {
+                               if (name == "size")
+                               {
+                                   return LoopbackTransport::ParseSize(value,
+                                                                       size);
+                               }
+                               if (name == "rate")
+                               {
+                                   return LoopbackTransport::ParseSize(value,
+                                                                       rate);
+                               }
+                               return true;
+                           }))
+        {
+            return MakeError(400, "Bad Request");
+        }
+
+        const bool close = fields["connection"] == "close";
+        const std::string entityTag = "\"loopback-" + std::to_string(size) +
+                                      "\"";
+
+        Response response;
+        response.rate = rate;
+        response.close = close;
+
+        // RFC 7232, 3.2. If-None-Match
+        const std::string &ifNoneMatch = fields["if-none-match"];
+        if (ifNoneMatch == entityTag || ifNoneMatch == "*")
+        {
+            response.header = "HTTP/1.1 304 Not Modified\r\nETag: " +
+                              entityTag + "\r\n" +
+                              (close ? "Connection: close\r\n" : "") + "\r\n";
+            return response;
+        }
+
+        std::string status = "200 OK";
+        std::string contentRange;
+        uint64_t first = 0;
+        uint64_t length = size;
+
+        // RFC 7233, 3.1. Range and 3.2. If-Range
+        const std::string &range = fields["range"];
+        const auto ifRange = fields.find("if-range");
+        uint64_t rangeFirst = 0;
+        uint64_t rangeLast = 0;
+        if (!range.empty() &&
+            (ifRange == fields.end() || ifRange->second == entityTag) &&
+            ParseRange(range, size, rangeFirst, rangeLast))
+        {
+            if (rangeFirst >= size)
+            {
+                response.header =
+                    "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                    "Content-Length: 0\r\nContent-Range: bytes */" +
+                    std::to_string(size) + "\r\nETag: " + entityTag + "\r\n" +
+                    (close ? "Connection: close\r\n" : "") + "\r\n";
+                return response;
+            }
+
+            status = "206 Partial Content";
+            first = rangeFirst;
+            length = rangeLast - rangeFirst + 1;
+            contentRange = "Content-Range: bytes " +
+                           std::to_string(rangeFirst) + "-" +
+                           std::to_string(rangeLast) + "/" +
+                           std::to_string(size) + "\r\n";
+        }
+
+        response.header = "HTTP/1.1 " + status +
+                          "\r\nContent-Length: " + std::to_string(length) +
+                          "\r\nAccept-Ranges: bytes\r\nETag: " + entityTag +
+                          "\r\n" + contentRange +
+                          (close ? "Connection: close\r\n" : "") + "\r\n";
+        response.offset = first;
+        response.length = method == "HEAD" ? 0 : length;
+        return response;
+    }
+
+    // NOTE: Only a single range is supported, `first` past the end means
+    // the range can't be satisfied
+    static bool ParseRange(const std::string &value, uint64_t size,
+                           uint64_t &first, uint64_t &last)
+    {
+        const std::string prefix = "bytes=";
+        if (value.compare(0, prefix.size(), prefix) != 0 ||
+            value.find(',') != std::string::npos)
+        {
+            return false;
+        }
+
+        const std::string spec = value.substr(prefix.size());
+        const auto dash = spec.find('-');
+        if (dash == std::string::npos)
+        {
+            return false;
+        }
+
+        const std::string firstText = spec.substr(0, dash);
+        const std::string lastText = spec.substr(dash + 1);
+        uint64_t number = 0;
+
+        // RFC 7233, 2.1. Byte Ranges, suffix range asks for the last bytes
+        if (firstText.empty())
+        {
+            if (!ParseNumber(lastText, number))
+            {
+                return false;
+            }
+
+            first = number == 0 ? size : size - std::min(number, size);
+            last = size - 1;
+            return true;
+        }
+
+        if (!ParseNumber(firstText, first))
+        {
+            return false;
+        }
+
+        last = size - 1;
+        if (!lastText.empty())
+        {
+            if (!ParseNumber(lastText, number) || number < first)
+            {
+                return false;
+            }
+            last = std::min(number, last);
+        }
+
+        return true;
+    }
+
+    static bool ParseNumber(const std::string &value, uint64_t &number)
+    {
+        if (value.empty() ||
+            value.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+
+        errno = 0;
+        number = std::strtoull(value.c_str(), nullptr, 10);
+        return errno == 0;
+    }
+
+    static Response MakeError(int code, const std::string &reason)
+    {
+        Response response;
+        response.header = "HTTP/1.1 " + std::to_string(code) + " " + reason +
+                          "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        response.close = true;
+        return response;
+    }
+
+    const int m_Descriptor;
+    const uint64_t m_Size;
+    const uint64_t m_Rate;
+
+    std::string m_Input;
+    std::deque<Response> m_Responses;
+    // NOTE: Last receive found nothing to answer, the next request has to
+    // wake the connection up
+    bool m_Waiting;
+    bool m_Closed;
+
+    // NOTE: Paced body becomes available in pieces of this size, smaller
+    // ones would cost more wake ups than they add in smoothness
+    inline static constexpr uint64_t s_PacingQuantum = 16 * 1024;
+};
+} // namespace
+
+LoopbackTransport::LoopbackTransport(const std::string &options)
+    : m_Size(s_DefaultSize), m_Rate(0)
+{
+    const auto parseOption = [this](const std::string &name,
+                                    const std::string &value) {
+        if (name == "size")
+        {
+            return ParseSize(value, m_Size);
+        }
+        if (name == "rate")
+        {
+            return ParseSize(value, m_Rate);
+        }
+        return false;
+    };
+
+    if (!ForEachOption(options, ',', parseOption))
+    {
+        throw std::invalid_argument("Invalid loopback transport options: " +
+                                    options);
+    }
+}
+
+void LoopbackTransport::Connect(const http::Uri &uri,
+                                std::chrono::milliseconds timeout,
+                                ConnectHandler handler)
+{
+    (void)uri;
+    (void)timeout;
+
+    std::unique_ptr<TransportStream> stream;
+    try
+    {
+        stream = std::make_unique<LoopbackStream>(m_Size, m_Rate);
+    }
+    catch (...)
+    {
+        handler(std::current_exception(), nullptr);
+        return;
+    }
+
+    handler(nullptr, std::move(stream));
+}
+
+bool LoopbackTransport::ParseSize(const std::string &value, uint64_t &size)
+{
+    if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])))
+    {
+        return false;
+    }
+
+    char *end = nullptr;
+    errno = 0;
+    const unsigned long long result = std::strtoull(value.c_str(), &end, 10);
+    if (errno != 0)
+    {
+        return false;
+    }
+
+    uint64_t multiplier = 1;
+    switch (*end)
+    {
+    case '\0':
+        break;
+    case 'k':
+    case 'K':
+        multiplier = 1024;
+        break;
+    case 'm':
+    case 'M':
+        multiplier = 1024 * 1024;
+        break;
+    case 'g':
+    case 'G':
+        multiplier = 1024 * 1024 * 1024;
+        break;
+    default:
+        return false;
+    }
+
+    if (*end != '\0' && end[1] != '\0')
+    {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(result) * multiplier;
+    return true;
+}
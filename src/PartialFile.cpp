@@ -0,0 +1,146 @@
+#include "ahd/PartialFile.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+PartialFile::PartialFile(const std::filesystem::path &outputPath)
+    : m_OutputPath(outputPath),
+      m_PartPath(outputPath.string() + s_PartExtension),
+      m_StatePath(outputPath.string() + s_StateExtension)
+{
+}
+
+const std::filesystem::path &PartialFile::GetPath(void) const
+{
+    return m_PartPath;
+}
+
+std::optional<PartialFile::State> PartialFile::Load(
+    const std::string &url) const
+{
+    const std::optional<State> state = ReadState(m_StatePath);
+    if (!state)
+    {
+        return std::nullopt;
+    }
+
+    std::error_code error;
+    const auto partSize = std::filesystem::file_size(m_PartPath, error);
+    if (error || state->url != url || GetValidator(*state).empty())
+    {
+        return std::nullopt;
+    }
+
+    // NOTE: State is saved after the data, so the file may only be longer
+    if (partSize < state->size)
+    {
+        return std::nullopt;
+    }
+
+    return state;
+}
+
+void PartialFile::Save(const State &state) const
+{
+    WriteState(m_StatePath, state);
+}
+
+void PartialFile::Discard(void) const
+{
+    std::error_code error;
+    std::filesystem::remove(m_PartPath, error);
+    std::filesystem::remove(m_StatePath, error);
+}
+
+void PartialFile::Commit(void) const
+{
+    std::filesystem::rename(m_PartPath, m_OutputPath);
+
+    std::error_code error;
+    std::filesystem::remove(m_StatePath, error);
+}
+
+std::string PartialFile::GetValidator(const State &state)
+{
+    if (!state.entityTag.empty() && state.entityTag.rfind("W/", 0) != 0)
+    {
+        return state.entityTag;
+    }
+
+    return state.lastModified;
+}
+
+std::optional<PartialFile::State> PartialFile::ReadState(
+    const std::filesystem::path &path)
+{
+    std::ifstream stateStream(path);
+    if (!stateStream)
+    {
+        return std::nullopt;
+    }
+
+    State state;
+    std::string line;
+    while (std::getline(stateStream, line))
+    {
+        const auto separator = line.find(": ");
+        if (separator == std::string::npos)
+        {
+            continue;
+        }
+
+        const std::string field = line.substr(0, separator);
+        const std::string value = line.substr(separator + 2);
+
+        if (field == s_UrlField)
+        {
+            state.url = value;
+        }
+        else if (field == s_SizeField)
+        {
+            state.size = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (field == s_EntityTagField)
+        {
+            state.entityTag = value;
+        }
+        else if (field == s_LastModifiedField)
+        {
+            state.lastModified = value;
+        }
+    }
+
+    return state;
+}
+
+void PartialFile::WriteState(const std::filesystem::path &path,
+                             const State &state)
+{
+    // NOTE: Written aside and renamed, so an interrupted save never leaves
+    // a broken state behind
+    const std::filesystem::path temporaryPath = path.string() + ".tmp";
+
+    {
+        std::ofstream stateStream(temporaryPath, std::ios::trunc);
+        stateStream << s_UrlField << ": " << state.url << '\n'
+                    << s_SizeField << ": " << state.size << '\n';
+        if (!state.entityTag.empty())
+        {
+            stateStream << s_EntityTagField << ": " << state.entityTag
+                        << '\n';
+        }
+        if (!state.lastModified.empty())
+        {
+            stateStream << s_LastModifiedField << ": " << state.lastModified
+                        << '\n';
+        }
+
+        if (!stateStream.flush())
+        {
+            throw std::runtime_error("Failed to write '" +
+                                     temporaryPath.string() + "'");
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path);
+}
@@ -0,0 +1,794 @@
+#include "ahd/Resolver.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace
+{
+// RFC 1035, 3.2.2. TYPE values and RFC 3596, 2.1. AAAA record type
+constexpr uint16_t A_RECORD = 1;
+constexpr uint16_t CNAME_RECORD = 5;
+constexpr uint16_t AAAA_RECORD = 28;
+constexpr uint16_t INTERNET_CLASS = 1;
+
+// RFC 1035, 4.1.1. Header section format
+constexpr std::size_t HEADER_SIZE = 12;
+constexpr uint16_t RESPONSE_FLAG = 0x8000;
+constexpr uint16_t TRUNCATED_FLAG = 0x0200;
+constexpr uint16_t RECURSION_DESIRED_FLAG = 0x0100;
+constexpr uint16_t RESPONSE_CODE_MASK = 0x000F;
+constexpr uint16_t NAME_ERROR = 3;
+
+// RFC 1035, 4.2.1. UDP usage
+constexpr std::size_t MAX_MESSAGE_SIZE = 512;
+
+uint16_t ReadUint16(const uint8_t *data)
+{
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+uint32_t ReadUint32(const uint8_t *data)
+{
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) |
+           (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+void WriteUint16(std::vector<uint8_t> &message, uint16_t value)
+{
+    message.push_back(static_cast<uint8_t>(value >> 8));
+    message.push_back(static_cast<uint8_t>(value & 0xFF));
+}
+
+// RFC 1035, 4.1.4. Message compression, returns offset after the name or 0
+std::size_t SkipName(const uint8_t *data, std::size_t size,
+                     std::size_t offset)
+{
+    while (offset < size)
+    {
+        const uint8_t length = data[offset];
+        if ((length & 0xC0) == 0xC0)
+        {
+            return offset + 2 <= size ? offset + 2 : 0;
+        }
+
+        if (length == 0)
+        {
+            return offset + 1;
+        }
+
+        offset += length + 1;
+    }
+
+    return 0;
+}
+
+std::vector<uint8_t> EncodeQuery(uint16_t id, const std::string &name,
+                                 uint16_t type)
+{
+    std::vector<uint8_t> message;
+    message.reserve(HEADER_SIZE + name.size() + 6);
+
+    WriteUint16(message, id);
+    WriteUint16(message, RECURSION_DESIRED_FLAG);
+    WriteUint16(message, 1); // QDCOUNT
+    WriteUint16(message, 0); // ANCOUNT
+    WriteUint16(message, 0); // NSCOUNT
+    WriteUint16(message, 0); // ARCOUNT
+
+    // RFC 1035, 3.1. Name space definitions
+    std::istringstream labels(name);
+    std::string label;
+    while (std::getline(labels, label, '.'))
+    {
+        if (label.empty())
+        {
+            continue;
+        }
+
+        if (label.size() > 63)
+        {
+            throw std::invalid_argument("Invalid host name: " + name);
+        }
+
+        message.push_back(static_cast<uint8_t>(label.size()));
+        message.insert(message.end(), label.begin(), label.end());
+    }
+    message.push_back(0);
+
+    WriteUint16(message, type);
+    WriteUint16(message, INTERNET_CLASS);
+    return message;
+}
+} // namespace
+
+// Lookup of one host name. Every attempt, which is a pair of A and AAAA
+// queries to one server, has its own socket and registration, the next one
+// is started from `OnRemoved` once the previous is unregistered
+class DnsQuery : public EventHandler,
+                 public std::enable_shared_from_this<DnsQuery>
+{
+public:
+    DnsQuery(Resolver &resolver, std::string host)
+        : m_Resolver(resolver), m_Host(std::move(host)),
+          m_Names(resolver.GetQueryNames(m_Host)), m_NameIndex(0),
+          m_Attempt(0), m_Descriptor(-1), m_Ids(), m_Answered(),
+          m_Addresses(), m_Ttl(Resolver::s_MaxTtl), m_Outcome(Outcome::Pending)
+    {
+    }
+
+    virtual ~DnsQuery(void)
+    {
+        CloseSocket();
+    }
+
+    void Start(void)
+    {
+        if (m_Resolver.m_NameServers.empty())
+        {
+            m_Resolver.LookupWithGetAddrInfo(m_Host);
+            return;
+        }
+
+        Send();
+    }
+
+    virtual bool OnEvents(uint32_t events) override
+    {
+        (void)events;
+
+        std::array<uint8_t, MAX_MESSAGE_SIZE> buffer;
+        for (;;)
+        {
+            const ssize_t size =
+                recv(m_Descriptor, buffer.data(), buffer.size(), 0);
+            if (size == -1)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return true;
+                }
+
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                // NOTE: ICMP errors are reported on connected sockets, the
+                // server is most likely unreachable
+                m_Outcome = Outcome::NextServer;
+                return false;
+            }
+
+            if (!OnMessage(buffer.data(), static_cast<std::size_t>(size)))
+            {
+                return false;
+            }
+        }
+    }
+
+    virtual bool OnTimer(void) override
+    {
+        // NOTE: Some servers never answer AAAA queries, addresses of the
+        // other family are good enough then
+        m_Outcome = m_Addresses.empty() ? Outcome::NextServer : Outcome::Done;
+        return false;
+    }
+
+    virtual void OnRemoved(void) override
+    {
+        CloseSocket();
+
+        switch (m_Outcome)
+        {
+        case Outcome::Done:
+            m_Resolver.Complete(m_Host, nullptr, std::move(m_Addresses),
+                                m_Ttl);
+            break;
+
+        case Outcome::NextName:
+            if (++m_NameIndex < m_Names.size())
+            {
+                m_Attempt = 0;
+                Send();
+            }
+            else
+            {
+                m_Resolver.Complete(
+                    m_Host,
+                    std::make_exception_ptr(std::runtime_error(
+                        "Failed to resolve host " + m_Host + ": not found")),
+                    {}, {});
+            }
+            break;
+
+        case Outcome::NextServer:
+            ++m_Attempt;
+            Send();
+            break;
+
+        case Outcome::Fallback:
+        case Outcome::Pending:
+            m_Resolver.LookupWithGetAddrInfo(m_Host);
+            break;
+        }
+    }
+
+private:
+    enum class Outcome
+    {
+        Pending,
+        Done,
+        NextName,
+        NextServer,
+        Fallback,
+    };
+
+    void Send(void)
+    {
+        const auto &nameServers = m_Resolver.m_NameServers;
+
+        // NOTE: Servers are tried in turn like the system resolver does
+        for (; m_Attempt < nameServers.size() * m_Resolver.m_Attempts;
+             ++m_Attempt)
+        {
+            const SocketAddress &nameServer =
+                nameServers[m_Attempt % nameServers.size()];
+
+            try
+            {
+                OpenSocket(nameServer);
+                SendQueries();
+
+                m_Outcome = Outcome::Pending;
+                m_Resolver.m_EventLoop.Add(m_Descriptor, EPOLLIN,
+                                           shared_from_this());
+                m_Resolver.m_EventLoop.SetTimer(
+                    this, EventLoop::Clock::now() + m_Resolver.m_Timeout);
+                return;
+            }
+            catch (const std::exception &)
+            {
+                CloseSocket();
+            }
+        }
+
+        m_Resolver.LookupWithGetAddrInfo(m_Host);
+    }
+
+    void OpenSocket(const SocketAddress &nameServer)
+    {
+        m_Descriptor = socket(nameServer.storage.ss_family,
+                              SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_Descriptor == -1)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to create socket");
+        }
+
+        // NOTE: Connected socket accepts datagrams only from the server
+        if (connect(m_Descriptor,
+                    reinterpret_cast<const sockaddr *>(&nameServer.storage),
+                    nameServer.size) == -1)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to connect to name server");
+        }
+    }
+
+    void SendQueries(void)
+    {
+        thread_local std::mt19937 generator{std::random_device{}()};
+        std::uniform_int_distribution<uint16_t> distribution;
+
+        m_Addresses.clear();
+        m_Ttl = Resolver::s_MaxTtl;
+
+        const std::array<uint16_t, 2> types = {A_RECORD, AAAA_RECORD};
+        for (std::size_t i = 0; i < types.size(); ++i)
+        {
+            m_Ids[i] = distribution(generator);
+            m_Answered[i] = false;
+
+            const auto message =
+                EncodeQuery(m_Ids[i], m_Names[m_NameIndex], types[i]);
+            if (send(m_Descriptor, message.data(), message.size(), 0) == -1)
+            {
+                throw std::system_error(errno, std::system_category(),
+                                        "Failed to send query");
+            }
+        }
+    }
+
+    // NOTE: Returns `false` once the attempt is over
+    bool OnMessage(const uint8_t *data, std::size_t size)
+    {
+        if (size < HEADER_SIZE)
+        {
+            return true;
+        }
+
+        const uint16_t id = ReadUint16(data);
+        const uint16_t flags = ReadUint16(data + 2);
+
+        std::size_t query = 0;
+        while (query < m_Ids.size() &&
+               (m_Ids[query] != id || m_Answered[query]))
+        {
+            ++query;
+        }
+
+        if (query == m_Ids.size() || !(flags & RESPONSE_FLAG))
+        {
+            return true;
+        }
+
+        if (flags & TRUNCATED_FLAG)
+        {
+            m_Outcome = Outcome::Fallback;
+            return false;
+        }
+
+        const uint16_t responseCode = flags & RESPONSE_CODE_MASK;
+        if (responseCode == NAME_ERROR)
+        {
+            m_Outcome = Outcome::NextName;
+            return false;
+        }
+
+        if (responseCode != 0 || !ParseAnswers(data, size))
+        {
+            m_Outcome = Outcome::NextServer;
+            return false;
+        }
+
+        m_Answered[query] = true;
+        if (!std::all_of(m_Answered.begin(), m_Answered.end(),
+                         [](bool answered) { return answered; }))
+        {
+            return true;
+        }
+
+        // NOTE: Name exists but has no addresses, the next search domain
+        // may have them
+        m_Outcome = m_Addresses.empty() ? Outcome::NextName : Outcome::Done;
+        return false;
+    }
+
+    // RFC 1035, 4.1.3. Resource record format
+    bool ParseAnswers(const uint8_t *data, std::size_t size)
+    {
+        const uint16_t questionCount = ReadUint16(data + 4);
+        const uint16_t answerCount = ReadUint16(data + 6);
+
+        std::size_t offset = HEADER_SIZE;
+        for (uint16_t i = 0; i < questionCount; ++i)
+        {
+            offset = SkipName(data, size, offset);
+            if (offset == 0 || offset + 4 > size)
+            {
+                return false;
+            }
+            offset += 4;
+        }
+
+        // NOTE: Answer may start with a chain of CNAME records, all records
+        // are related to the queried name since recursion was asked for
+        for (uint16_t i = 0; i < answerCount; ++i)
+        {
+            offset = SkipName(data, size, offset);
+            if (offset == 0 || offset + 10 > size)
+            {
+                return false;
+            }
+
+            const uint16_t type = ReadUint16(data + offset);
+            const uint16_t recordClass = ReadUint16(data + offset + 2);
+            const std::chrono::seconds ttl{ReadUint32(data + offset + 4)};
+            const uint16_t length = ReadUint16(data + offset + 8);
+            offset += 10;
+
+            if (offset + length > size)
+            {
+                return false;
+            }
+
+            if (recordClass == INTERNET_CLASS &&
+                (type == A_RECORD || type == AAAA_RECORD ||
+                 type == CNAME_RECORD))
+            {
+                m_Ttl = std::min(m_Ttl, ttl);
+            }
+
+            SocketAddress address = {};
+            if (recordClass == INTERNET_CLASS && type == A_RECORD &&
+                length == 4)
+            {
+                auto *ipv4 = reinterpret_cast<sockaddr_in *>(&address.storage);
+                ipv4->sin_family = AF_INET;
+                std::memcpy(&ipv4->sin_addr, data + offset, length);
+                address.size = sizeof(sockaddr_in);
+                m_Addresses.push_back(address);
+            }
+            else if (recordClass == INTERNET_CLASS && type == AAAA_RECORD &&
+                     length == 16)
+            {
+                auto *ipv6 =
+                    reinterpret_cast<sockaddr_in6 *>(&address.storage);
+                ipv6->sin6_family = AF_INET6;
+                std::memcpy(&ipv6->sin6_addr, data + offset, length);
+                address.size = sizeof(sockaddr_in6);
+                m_Addresses.push_back(address);
+            }
+
+            offset += length;
+        }
+
+        return true;
+    }
+
+    void CloseSocket(void)
+    {
+        if (m_Descriptor != -1)
+        {
+            close(m_Descriptor);
+            m_Descriptor = -1;
+        }
+    }
+
+    Resolver &m_Resolver;
+    const std::string m_Host;
+    const std::vector<std::string> m_Names;
+    std::size_t m_NameIndex;
+    std::size_t m_Attempt;
+
+    int m_Descriptor;
+    std::array<uint16_t, 2> m_Ids;
+    std::array<bool, 2> m_Answered;
+    std::vector<SocketAddress> m_Addresses;
+    std::chrono::seconds m_Ttl;
+    Outcome m_Outcome;
+};
+
+Resolver::Resolver(EventLoop &eventLoop)
+    : m_EventLoop(eventLoop), m_Hosts(), m_NameServers(), m_SearchDomains(),
+      m_Dots(1), m_Timeout(5), m_Attempts(2), m_Mutex(), m_Cache()
+{
+    ReadHosts("/etc/hosts");
+    ReadResolvConf("/etc/resolv.conf");
+}
+
+void Resolver::Resolve(const std::string &host, uint16_t port,
+                       ResolveHandler handler)
+{
+    SocketAddress literal;
+    if (ParseAddress(host, literal))
+    {
+        handler(nullptr, WithPort({literal}, port));
+        return;
+    }
+
+    const auto hostsEntry = m_Hosts.find(host);
+    if (hostsEntry != m_Hosts.end())
+    {
+        handler(nullptr, WithPort(hostsEntry->second, port));
+        return;
+    }
+
+    std::vector<SocketAddress> addresses;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        CacheEntry &entry = m_Cache[host];
+
+        if (!entry.pending && !entry.addresses.empty() &&
+            Clock::now() < entry.expiry)
+        {
+            addresses = WithPort(entry.addresses, port);
+        }
+        else
+        {
+            const bool lookup = !entry.pending;
+            entry.pending = true;
+            entry.waiters.push_back({port, std::move(handler)});
+
+            if (!lookup)
+            {
+                return;
+            }
+        }
+    }
+
+    if (addresses.empty())
+    {
+        Lookup(host);
+        return;
+    }
+
+    handler(nullptr, addresses);
+}
+
+Resolver &Resolver::Get(void)
+{
+    static Resolver resolver(EventLoop::Get());
+    return resolver;
+}
+
+void Resolver::ReadHosts(const char *path)
+{
+    std::ifstream file(path);
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        std::string addressText;
+        SocketAddress address;
+        if (!(fields >> addressText) || !ParseAddress(addressText, address))
+        {
+            continue;
+        }
+
+        std::string name;
+        while (fields >> name)
+        {
+            m_Hosts[name].push_back(address);
+        }
+    }
+
+    for (auto &[name, addresses] : m_Hosts)
+    {
+        std::stable_partition(addresses.begin(), addresses.end(),
+                              [](const SocketAddress &address) {
+                                  return address.storage.ss_family == AF_INET;
+                              });
+    }
+}
+
+void Resolver::ReadResolvConf(const char *path)
+{
+    std::ifstream file(path);
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find_first_of("#;"));
+
+        std::istringstream fields(line);
+        std::string keyword;
+        if (!(fields >> keyword))
+        {
+            continue;
+        }
+
+        if (keyword == "nameserver")
+        {
+            std::string addressText;
+            SocketAddress address;
+            if (fields >> addressText && ParseAddress(addressText, address) &&
+                m_NameServers.size() < s_MaxNameServers)
+            {
+                m_NameServers.push_back(WithPort({address},
+                                                 s_NameServerPort)[0]);
+            }
+        }
+        else if (keyword == "search" || keyword == "domain")
+        {
+            // NOTE: The last of these lines wins
+            m_SearchDomains.clear();
+            std::string domain;
+            while (fields >> domain)
+            {
+                m_SearchDomains.push_back(domain);
+            }
+        }
+        else if (keyword == "options")
+        {
+            std::string option;
+            while (fields >> option)
+            {
+                const auto separator = option.find(':');
+                if (separator == std::string::npos)
+                {
+                    continue;
+                }
+
+                const std::string name = option.substr(0, separator);
+                const unsigned long value =
+                    std::strtoul(option.c_str() + separator + 1, nullptr, 10);
+
+                if (name == "ndots")
+                {
+                    m_Dots = std::min<unsigned long>(value, 15);
+                }
+                else if (name == "timeout" && value > 0)
+                {
+                    m_Timeout = std::chrono::seconds(
+                        std::min<unsigned long>(value, 30));
+                }
+                else if (name == "attempts" && value > 0)
+                {
+                    m_Attempts = std::min<unsigned long>(value, 5);
+                }
+            }
+        }
+    }
+}
+
+std::vector<std::string> Resolver::GetQueryNames(const std::string &host) const
+{
+    // NOTE: Trailing dot marks a fully qualified name
+    if (!host.empty() && host.back() == '.')
+    {
+        return {host};
+    }
+
+    std::vector<std::string> names;
+    const bool absoluteFirst =
+        static_cast<std::size_t>(std::count(host.begin(), host.end(), '.')) >=
+        m_Dots;
+
+    if (absoluteFirst)
+    {
+        names.push_back(host);
+    }
+
+    for (const auto &domain : m_SearchDomains)
+    {
+        names.push_back(host + "." + domain);
+    }
+
+    if (!absoluteFirst)
+    {
+        names.push_back(host);
+    }
+
+    return names;
+}
+
+void Resolver::Lookup(const std::string &host)
+{
+    std::make_shared<DnsQuery>(*this, host)->Start();
+}
+
+void Resolver::LookupWithGetAddrInfo(const std::string &host)
+{
+    // NOTE: `getaddrinfo` blocks, so it never runs on an event loop thread
+    std::thread([this, host]() {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo *info;
+        const int result = getaddrinfo(host.c_str(), nullptr, &hints, &info);
+        if (result != 0)
+        {
+            Complete(host,
+                     std::make_exception_ptr(std::runtime_error(
+                         "Failed to get address info of " + host + ": " +
+                         gai_strerror(result))),
+                     {}, {});
+            return;
+        }
+
+        std::vector<SocketAddress> addresses;
+        for (const addrinfo *i = info; i != nullptr; i = i->ai_next)
+        {
+            SocketAddress address = {};
+            std::memcpy(&address.storage, i->ai_addr, i->ai_addrlen);
+            address.size = static_cast<socklen_t>(i->ai_addrlen);
+            addresses.push_back(address);
+        }
+        freeaddrinfo(info);
+
+        Complete(host, nullptr, std::move(addresses), s_GetAddrInfoTtl);
+    }).detach();
+}
+
+void Resolver::Complete(const std::string &host, std::exception_ptr error,
+                        std::vector<SocketAddress> addresses,
+                        std::chrono::seconds ttl)
+{
+    std::stable_partition(addresses.begin(), addresses.end(),
+                          [](const SocketAddress &address) {
+                              return address.storage.ss_family == AF_INET;
+                          });
+
+    std::vector<Waiter> waiters;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        CacheEntry &entry = m_Cache[host];
+        waiters.swap(entry.waiters);
+        entry.pending = false;
+
+        // NOTE: Failures aren't cached, the next request asks again
+        if (error || addresses.empty())
+        {
+            m_Cache.erase(host);
+        }
+        else
+        {
+            entry.addresses = addresses;
+            entry.expiry = Clock::now() + std::clamp(ttl, s_MinTtl, s_MaxTtl);
+        }
+    }
+
+    if (!error && addresses.empty())
+    {
+        error = std::make_exception_ptr(
+            std::runtime_error("Failed to resolve host " + host));
+    }
+
+    for (const auto &waiter : waiters)
+    {
+        waiter.handler(error, WithPort(addresses, waiter.port));
+    }
+}
+
+bool Resolver::ParseAddress(const std::string &text, SocketAddress &address)
+{
+    address = {};
+
+    auto *ipv4 = reinterpret_cast<sockaddr_in *>(&address.storage);
+    if (inet_pton(AF_INET, text.c_str(), &ipv4->sin_addr) == 1)
+    {
+        ipv4->sin_family = AF_INET;
+        address.size = sizeof(sockaddr_in);
+        return true;
+    }
+
+    // NOTE: Literal IPv6 host in an URI is enclosed in brackets
+    std::string ipv6Text = text;
+    if (ipv6Text.size() > 2 && ipv6Text.front() == '[' &&
+        ipv6Text.back() == ']')
+    {
+        ipv6Text = ipv6Text.substr(1, ipv6Text.size() - 2);
+    }
+
+    auto *ipv6 = reinterpret_cast<sockaddr_in6 *>(&address.storage);
+    if (inet_pton(AF_INET6, ipv6Text.c_str(), &ipv6->sin6_addr) == 1)
+    {
+        ipv6->sin6_family = AF_INET6;
+        address.size = sizeof(sockaddr_in6);
+        return true;
+    }
+
+    return false;
+}
+
+std::vector<SocketAddress> Resolver::WithPort(
+    const std::vector<SocketAddress> &addresses, uint16_t port)
+{
+    std::vector<SocketAddress> result = addresses;
+    for (auto &address : result)
+    {
+        if (address.storage.ss_family == AF_INET)
+        {
+            reinterpret_cast<sockaddr_in *>(&address.storage)->sin_port =
+                htons(port);
+        }
+        else
+        {
+            reinterpret_cast<sockaddr_in6 *>(&address.storage)->sin6_port =
+                htons(port);
+        }
+    }
+
+    return result;
+}
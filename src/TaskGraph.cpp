@@ -0,0 +1,158 @@
+#include "ahd/TaskGraph.hpp"
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+TaskGraph::TaskGraph(const TaskMap &taskMap)
+    : m_Names(), m_Tasks(), m_Roots(), m_SuccessorOffsets(), m_Successors(),
+      m_PendingDependencies()
+{
+    if (taskMap.size() >= std::numeric_limits<Id>::max())
+    {
+        throw std::invalid_argument("Too many tasks");
+    }
+
+    const std::size_t size = taskMap.size();
+    m_Names.reserve(size);
+    m_Tasks.reserve(size);
+
+    std::unordered_map<std::string, Id> ids;
+    ids.reserve(size);
+    for (const auto &[name, task] : taskMap)
+    {
+        ids.emplace(name, static_cast<Id>(m_Names.size()));
+        m_Names.push_back(name);
+        m_Tasks.push_back(task);
+    }
+
+    // NOTE: Dependencies are resolved to IDs once, edges are counted first
+    // so successors can be laid out in place
+    std::vector<std::vector<Id>> dependencies(size);
+    m_SuccessorOffsets.assign(size + 1, 0);
+    for (Id id = 0; id < size; ++id)
+    {
+        dependencies[id].reserve(m_Tasks[id]->dependencies.size());
+        for (const std::string &dependency : m_Tasks[id]->dependencies)
+        {
+            const auto found = ids.find(dependency);
+            if (found == ids.end())
+            {
+                std::ostringstream errorMessage;
+                errorMessage << "Can't find dependency '" << dependency
+                             << "' that '" << m_Names[id] << "' requires";
+                throw std::invalid_argument(errorMessage.str());
+            }
+
+            dependencies[id].push_back(found->second);
+            ++m_SuccessorOffsets[found->second + 1];
+        }
+    }
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        m_SuccessorOffsets[i + 1] += m_SuccessorOffsets[i];
+    }
+
+    m_Successors.resize(m_SuccessorOffsets[size]);
+    std::vector<std::size_t> next(m_SuccessorOffsets.begin(),
+                                  m_SuccessorOffsets.end() - 1);
+    m_PendingDependencies =
+        std::make_unique<std::atomic<uint32_t>[]>(size);
+    for (Id id = 0; id < size; ++id)
+    {
+        for (const Id dependency : dependencies[id])
+        {
+            m_Successors[next[dependency]++] = id;
+        }
+
+        m_PendingDependencies[id].store(
+            static_cast<uint32_t>(dependencies[id].size()),
+            std::memory_order_relaxed);
+        if (dependencies[id].empty())
+        {
+            m_Roots.push_back(id);
+        }
+    }
+
+    ValidateAcyclic();
+}
+
+std::size_t TaskGraph::GetSize(void) const
+{
+    return m_Tasks.size();
+}
+
+const std::string &TaskGraph::GetName(Id id) const
+{
+    return m_Names[id];
+}
+
+const Task &TaskGraph::GetTask(Id id) const
+{
+    return *m_Tasks[id];
+}
+
+const std::vector<TaskGraph::Id> &TaskGraph::GetRoots(void) const
+{
+    return m_Roots;
+}
+
+void TaskGraph::Complete(Id id, std::vector<Id> &ready)
+{
+    for (std::size_t i = m_SuccessorOffsets[id];
+         i < m_SuccessorOffsets[id + 1]; ++i)
+    {
+        const Id successor = m_Successors[i];
+
+        // NOTE: Completion of every dependency is released to the one
+        // which takes the count to zero and starts the successor
+        if (m_PendingDependencies[successor].fetch_sub(
+                1, std::memory_order_acq_rel) == 1)
+        {
+            ready.push_back(successor);
+        }
+    }
+}
+
+void TaskGraph::ValidateAcyclic(void) const
+{
+    // NOTE: Tasks are completed in topological order (Kahn's algorithm),
+    // those never reached depend on a cycle
+    std::vector<uint32_t> pending(m_Tasks.size());
+    for (std::size_t i = 0; i < pending.size(); ++i)
+    {
+        pending[i] =
+            m_PendingDependencies[i].load(std::memory_order_relaxed);
+    }
+
+    std::vector<Id> queue(m_Roots);
+    for (std::size_t next = 0; next < queue.size(); ++next)
+    {
+        const Id id = queue[next];
+        for (std::size_t i = m_SuccessorOffsets[id];
+             i < m_SuccessorOffsets[id + 1]; ++i)
+        {
+            if (--pending[m_Successors[i]] == 0)
+            {
+                queue.push_back(m_Successors[i]);
+            }
+        }
+    }
+
+    if (queue.size() == m_Tasks.size())
+    {
+        return;
+    }
+
+    for (std::size_t i = 0; i < pending.size(); ++i)
+    {
+        if (pending[i] != 0)
+        {
+            std::ostringstream errorMessage;
+            errorMessage << "Found circular dependency that '" << m_Names[i]
+                         << "' requires";
+            throw std::invalid_argument(errorMessage.str());
+        }
+    }
+}
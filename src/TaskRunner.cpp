@@ -1,50 +1,166 @@
 #include "ahd/TaskRunner.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <utility>
 
-TaskRunner::TaskRunner(
-    std::unordered_map<std::string, std::shared_ptr<Task>> &fileTasks)
-    : m_FileTasks(fileTasks), m_FileTaskStatuses()
+TaskRunner::TaskRunner(const TaskMap &fileTasks, std::size_t ioWorkerCount,
+                       std::size_t cpuWorkerCount)
+    : m_Graph(fileTasks), m_IoWorkerCount(ioWorkerCount),
+      m_CpuWorkerCount(cpuWorkerCount), m_IoPool(nullptr),
+      m_CpuPool(nullptr), m_NextActions(), m_Outstanding(0),
+      m_Failed(false), m_Mutex(), m_Finished(), m_Error()
 {
-    m_FileTaskStatuses.reserve(m_FileTasks.size());
-    for (const auto &[name, _] : m_FileTasks)
+}
+
+void TaskRunner::Run()
+{
+    const std::vector<TaskGraph::Id> &roots = m_Graph.GetRoots();
+    if (roots.empty())
+    {
+        return;
+    }
+
+    m_NextActions.assign(m_Graph.GetSize(), 0);
+    m_Outstanding.store(roots.size());
+    m_Failed.store(false);
+    m_Error = nullptr;
+
+    {
+        // NOTE: There's no use for more workers than tasks
+        ThreadPool ioPool(
+            std::min(m_IoWorkerCount, m_Graph.GetSize()),
+            [this](ThreadPool::Job id) { Execute(ResourceClass::Io, id); });
+        ThreadPool cpuPool(
+            std::min(m_CpuWorkerCount, m_Graph.GetSize()),
+            [this](ThreadPool::Job id) { Execute(ResourceClass::Cpu, id); });
+        m_IoPool = &ioPool;
+        m_CpuPool = &cpuPool;
+
+        for (const TaskGraph::Id id : roots)
+        {
+            Schedule(id);
+        }
+
+        std::unique_lock lock(m_Mutex);
+        while (!m_Finished.wait_for(lock, s_StatsInterval, [this] {
+            return m_Outstanding.load() == 0;
+        }))
+        {
+            if (s_StatsLogging)
+            {
+                LogStats();
+            }
+        }
+
+        if (s_StatsLogging)
+        {
+            LogStats();
+        }
+    }
+    m_IoPool = nullptr;
+    m_CpuPool = nullptr;
+
+    if (m_Error)
     {
-        m_FileTaskStatuses[name] = false;
+        std::rethrow_exception(m_Error);
     }
 }
 
-void TaskRunner::Run()
+void TaskRunner::SetStatsLogging(bool logging)
+{
+    s_StatsLogging = logging;
+}
+
+void TaskRunner::Execute(ResourceClass resourceClass, TaskGraph::Id id)
 {
-    std::vector<std::future<void>> workers;
-    workers.reserve(m_FileTasks.size());
+    const std::vector<std::shared_ptr<Action>> &actions =
+        m_Graph.GetTask(id).actions;
+    std::size_t &next = m_NextActions[id];
 
-    for (const auto &[name, task] : m_FileTasks)
+    bool completed = false;
+    if (!m_Failed.load())
     {
-        const auto executionFunc =
-            [&](const Task *fileTask,
-                const std::unordered_map<std::string, bool> *fileTaskStatuses,
-                bool *statusOut) {
-                for (const std::string dependency : fileTask->dependencies)
-                {
-                    while (!fileTaskStatuses->at(dependency))
-                    {
-                        // NOTE: Waiting...
-                    }
-                }
-
-                for (const std::shared_ptr<Action> action : fileTask->actions)
-                {
-                    action->Execute();
-                }
-
-                *statusOut = true;
-            };
-
-        workers.emplace_back(std::async(std::launch::async, executionFunc,
-                                        task.get(), &m_FileTaskStatuses,
-                                        &(m_FileTaskStatuses[name])));
+        try
+        {
+            while (next < actions.size() &&
+                   actions[next]->GetResourceClass() == resourceClass)
+            {
+                actions[next]->Execute();
+                ++next;
+            }
+
+            if (next < actions.size())
+            {
+                // NOTE: Task stays outstanding while it moves between pools
+                GetPool(actions[next]->GetResourceClass()).Submit(id);
+                return;
+            }
+            completed = true;
+        }
+        catch (...)
+        {
+            const std::lock_guard lock(m_Mutex);
+            if (!m_Error)
+            {
+                m_Error = std::current_exception();
+            }
+            m_Failed.store(true);
+        }
+    }
+
+    if (completed)
+    {
+        std::vector<TaskGraph::Id> ready;
+        m_Graph.Complete(id, ready);
+
+        // NOTE: Successors are counted before this task is done, so the
+        // count can't reach zero in between
+        m_Outstanding.fetch_add(ready.size());
+        for (const TaskGraph::Id successor : ready)
+        {
+            Schedule(successor);
+        }
     }
 
-    for (const std::future<void> &w : workers)
+    if (m_Outstanding.fetch_sub(1) == 1)
+    {
+        const std::lock_guard lock(m_Mutex);
+        m_Finished.notify_all();
+    }
+}
+
+void TaskRunner::Schedule(TaskGraph::Id id)
+{
+    const std::vector<std::shared_ptr<Action>> &actions =
+        m_Graph.GetTask(id).actions;
+
+    // NOTE: Task without actions completes right away, which takes no I/O
+    GetPool(actions.empty() ? ResourceClass::Cpu
+                            : actions.front()->GetResourceClass())
+        .Submit(id);
+}
+
+ThreadPool &TaskRunner::GetPool(ResourceClass resourceClass)
+{
+    return resourceClass == ResourceClass::Io ? *m_IoPool : *m_CpuPool;
+}
+
+void TaskRunner::LogStats(void) const
+{
+    const std::pair<const char *, const ThreadPool *> pools[] = {
+        {"io", m_IoPool},
+        {"cpu", m_CpuPool},
+    };
+
+    for (const auto &[name, pool] : pools)
     {
-        w.wait();
+        const ThreadPool::Stats stats = pool->GetStats();
+        std::fprintf(stderr,
+                     "%s pool: %zu of %zu workers busy, %zu queued (peak "
+                     "%zu), %llu jobs run, %.0f%% utilized\n",
+                     name, stats.busy, stats.size, stats.queued,
+                     stats.peakQueued,
+                     static_cast<unsigned long long>(stats.completed),
+                     stats.utilization * 100.0);
     }
 }
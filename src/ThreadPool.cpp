@@ -0,0 +1,288 @@
+#include "ahd/ThreadPool.hpp"
+#include <stdexcept>
+
+WorkStealingDeque::Buffer::Buffer(std::size_t capacity)
+    : mask(capacity - 1),
+      slots(std::make_unique<std::atomic<Job>[]>(capacity))
+{
+}
+
+WorkStealingDeque::WorkStealingDeque(void)
+    : m_Top(0), m_Bottom(0), m_Buffer(nullptr), m_Buffers()
+{
+    m_Buffers.push_back(std::make_unique<Buffer>(s_InitialCapacity));
+    m_Buffer.store(m_Buffers.back().get(), std::memory_order_relaxed);
+}
+
+void WorkStealingDeque::Push(Job job)
+{
+    const int64_t bottom = m_Bottom.load(std::memory_order_relaxed);
+    const int64_t top = m_Top.load(std::memory_order_acquire);
+    Buffer *buffer = m_Buffer.load(std::memory_order_relaxed);
+
+    if (bottom - top > static_cast<int64_t>(buffer->mask))
+    {
+        buffer = Grow(buffer, top, bottom);
+    }
+
+    buffer->slots[bottom & buffer->mask].store(job,
+                                               std::memory_order_relaxed);
+    // NOTE: Job is published to thieves together with the new bottom
+    std::atomic_thread_fence(std::memory_order_release);
+    m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+}
+
+bool WorkStealingDeque::Pop(Job &job)
+{
+    const int64_t bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+    Buffer *buffer = m_Buffer.load(std::memory_order_relaxed);
+    m_Bottom.store(bottom, std::memory_order_relaxed);
+    // NOTE: Thieves must see the job reserved before the top is read
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_Top.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    job = buffer->slots[bottom & buffer->mask].load(
+        std::memory_order_relaxed);
+    if (top < bottom)
+    {
+        return true;
+    }
+
+    // NOTE: Last job, a thief may be taking it at the same time
+    const bool taken = m_Top.compare_exchange_strong(
+        top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+    return taken;
+}
+
+bool WorkStealingDeque::Steal(Job &job)
+{
+    int64_t top = m_Top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = m_Bottom.load(std::memory_order_acquire);
+
+    if (top >= bottom)
+    {
+        return false;
+    }
+
+    Buffer *buffer = m_Buffer.load(std::memory_order_acquire);
+    job = buffer->slots[top & buffer->mask].load(std::memory_order_relaxed);
+    return m_Top.compare_exchange_strong(
+        top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+WorkStealingDeque::Buffer *WorkStealingDeque::Grow(Buffer *buffer,
+                                                   int64_t top,
+                                                   int64_t bottom)
+{
+    auto grown = std::make_unique<Buffer>((buffer->mask + 1) * 2);
+    for (int64_t i = top; i < bottom; ++i)
+    {
+        grown->slots[i & grown->mask].store(
+            buffer->slots[i & buffer->mask].load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+    }
+
+    Buffer *result = grown.get();
+    m_Buffers.push_back(std::move(grown));
+    m_Buffer.store(result, std::memory_order_release);
+    return result;
+}
+
+ThreadPool::ThreadPool(std::size_t size, Handler handler)
+    : m_Handler(std::move(handler)), m_Workers(), m_InjectedMutex(),
+      m_Injected(), m_InjectedCount(0), m_Queued(0), m_Sleeping(0),
+      m_Mutex(), m_WorkAvailable(), m_Stopping(false),
+      m_Started(Clock::now()), m_PeakQueued(0), m_Busy(0), m_Completed(0),
+      m_BusyTime(0)
+{
+    if (size == 0)
+    {
+        throw std::invalid_argument("Thread pool can't be empty");
+    }
+
+    m_Workers.reserve(size);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        m_Workers.push_back(std::make_unique<Worker>());
+        m_Workers.back()->seed = static_cast<uint32_t>(i) * 2654435761u + 1;
+    }
+
+    // NOTE: Workers are started once all of them exist, the first ones may
+    // steal from the others right away
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        m_Workers[i]->thread = std::thread(&ThreadPool::Run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        const std::lock_guard lock(m_Mutex);
+        m_Stopping = true;
+    }
+    m_WorkAvailable.notify_all();
+
+    for (const std::unique_ptr<Worker> &worker : m_Workers)
+    {
+        worker->thread.join();
+    }
+}
+
+void ThreadPool::Submit(Job job)
+{
+    const std::size_t queued =
+        m_Queued.fetch_add(1, std::memory_order_seq_cst) + 1;
+
+    std::size_t peak = m_PeakQueued.load(std::memory_order_relaxed);
+    while (queued > peak && !m_PeakQueued.compare_exchange_weak(
+                                peak, queued, std::memory_order_relaxed))
+    {
+    }
+
+    if (s_CurrentPool == this)
+    {
+        m_Workers[s_CurrentIndex]->deque.Push(job);
+    }
+    else
+    {
+        const std::lock_guard lock(m_InjectedMutex);
+        m_Injected.push_back(job);
+        m_InjectedCount.fetch_add(1, std::memory_order_release);
+    }
+
+    // NOTE: Either the sleeping worker has seen the job counted or it's
+    // seen here and woken up
+    if (m_Sleeping.load(std::memory_order_seq_cst) > 0)
+    {
+        const std::lock_guard lock(m_Mutex);
+        m_WorkAvailable.notify_one();
+    }
+}
+
+std::size_t ThreadPool::GetSize(void) const
+{
+    return m_Workers.size();
+}
+
+ThreadPool::Stats ThreadPool::GetStats(void) const
+{
+    Stats stats;
+    stats.size = m_Workers.size();
+    stats.queued = m_Queued.load(std::memory_order_relaxed);
+    stats.peakQueued = m_PeakQueued.load(std::memory_order_relaxed);
+    stats.busy = m_Busy.load(std::memory_order_relaxed);
+    stats.completed = m_Completed.load(std::memory_order_relaxed);
+
+    const Clock::duration elapsed = Clock::now() - m_Started;
+    if (elapsed.count() > 0)
+    {
+        stats.utilization =
+            static_cast<double>(m_BusyTime.load(std::memory_order_relaxed)) /
+            (static_cast<double>(elapsed.count()) * stats.size);
+    }
+
+    return stats;
+}
+
+std::size_t ThreadPool::GetDefaultSize(void)
+{
+    const unsigned int count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+}
+
+void ThreadPool::Run(std::size_t index)
+{
+    s_CurrentPool = this;
+    s_CurrentIndex = index;
+
+    while (true)
+    {
+        Job job;
+        if (TryTake(index, job))
+        {
+            m_Queued.fetch_sub(1, std::memory_order_relaxed);
+            m_Busy.fetch_add(1, std::memory_order_relaxed);
+
+            const Clock::time_point start = Clock::now();
+            m_Handler(job);
+            m_BusyTime.fetch_add((Clock::now() - start).count(),
+                                 std::memory_order_relaxed);
+
+            m_Completed.fetch_add(1, std::memory_order_relaxed);
+            m_Busy.fetch_sub(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        std::unique_lock lock(m_Mutex);
+        m_Sleeping.fetch_add(1, std::memory_order_seq_cst);
+        m_WorkAvailable.wait(lock, [this] {
+            return m_Stopping ||
+                   m_Queued.load(std::memory_order_seq_cst) > 0;
+        });
+        m_Sleeping.fetch_sub(1, std::memory_order_relaxed);
+
+        if (m_Stopping)
+        {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::TryTake(std::size_t index, Job &job)
+{
+    if (m_Workers[index]->deque.Pop(job))
+    {
+        return true;
+    }
+
+    if (m_InjectedCount.load(std::memory_order_acquire) > 0)
+    {
+        const std::lock_guard lock(m_InjectedMutex);
+        if (!m_Injected.empty())
+        {
+            job = m_Injected.front();
+            m_Injected.pop_front();
+            m_InjectedCount.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return TrySteal(index, job);
+}
+
+bool ThreadPool::TrySteal(std::size_t index, Job &job)
+{
+    const std::size_t size = m_Workers.size();
+    if (size == 1)
+    {
+        return false;
+    }
+
+    // NOTE: Victims are tried from a random one on (xorshift), so thieves
+    // don't all fall on the same worker
+    uint32_t &seed = m_Workers[index]->seed;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    const std::size_t start = seed % size;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        const std::size_t victim = (start + i) % size;
+        if (victim != index && m_Workers[victim]->deque.Steal(job))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
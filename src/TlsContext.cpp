@@ -0,0 +1,205 @@
+#include "ahd/TlsContext.hpp"
+#include <csignal>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+namespace
+{
+bool IsAddress(const std::string &host)
+{
+    in6_addr address;
+    return inet_pton(AF_INET, host.c_str(), &address) == 1 ||
+           inet_pton(AF_INET6, host.c_str(), &address) == 1;
+}
+} // namespace
+
+TlsContext::TlsContext(void)
+    : m_Context(SSL_CTX_new(TLS_client_method())), m_Mutex(), m_Sessions()
+{
+    if (m_Context == nullptr)
+    {
+        throw std::runtime_error("Failed to create TLS context: " +
+                                 TakeError());
+    }
+
+    // NOTE: OpenSSL writes to sockets with `write`, which raises SIGPIPE
+    // when the server has closed the connection
+    std::signal(SIGPIPE, SIG_IGN);
+
+    SSL_CTX_set_min_proto_version(m_Context, TLS1_2_VERSION);
+    SSL_CTX_set_verify(m_Context, SSL_VERIFY_PEER, nullptr);
+    SSL_CTX_set_default_verify_paths(m_Context);
+
+    // NOTE: Send buffer of a connection grows while requests are pipelined,
+    // so a retried write may start at another address
+    SSL_CTX_set_mode(m_Context, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                                    SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    // NOTE: Responses carry their own length, many servers close the
+    // connection without `close_notify`
+    SSL_CTX_set_options(m_Context, SSL_OP_IGNORE_UNEXPECTED_EOF);
+
+    // NOTE: TLS 1.3 tickets arrive after the handshake, the callback is the
+    // only reliable way to get them. OpenSSL's own cache is keyed by session
+    // ID, which a client can't look up by host
+    SSL_CTX_set_session_cache_mode(m_Context,
+                                   SSL_SESS_CACHE_CLIENT |
+                                       SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(m_Context, &TlsContext::OnNewSession);
+}
+
+TlsContext::~TlsContext()
+{
+    for (auto &[key, sessions] : m_Sessions)
+    {
+        for (SSL_SESSION *session : sessions)
+        {
+            SSL_SESSION_free(session);
+        }
+    }
+
+    SSL_CTX_free(m_Context);
+}
+
+SSL *TlsContext::CreateConnection(const std::string &host,
+                                  const std::string &sessionKey)
+{
+    SSL *ssl = SSL_new(m_Context);
+    if (ssl == nullptr)
+    {
+        throw std::runtime_error("Failed to create TLS connection: " +
+                                 TakeError());
+    }
+
+    // RFC 6066, 3. Server Name Indication, literal addresses aren't sent
+    bool configured = false;
+    if (IsAddress(host))
+    {
+        configured =
+            X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host.c_str());
+    }
+    else
+    {
+        configured = SSL_set_tlsext_host_name(ssl, host.c_str()) == 1 &&
+                     SSL_set1_host(ssl, host.c_str()) == 1;
+    }
+
+    if (!configured)
+    {
+        SSL_free(ssl);
+        throw std::runtime_error("Failed to set TLS host name '" + host +
+                                 "': " + TakeError());
+    }
+
+    SSL_set_app_data(ssl, const_cast<std::string *>(&sessionKey));
+
+    SSL_SESSION *session = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        const auto sessions = m_Sessions.find(sessionKey);
+        if (sessions != m_Sessions.end() && !sessions->second.empty())
+        {
+            // NOTE: Newest session is the least likely to have expired
+            session = sessions->second.back();
+            if (sessions->second.size() > 1)
+            {
+                sessions->second.pop_back();
+            }
+            else
+            {
+                SSL_SESSION_up_ref(session);
+            }
+        }
+    }
+
+    if (session != nullptr)
+    {
+        // NOTE: Session the server refuses only costs a full handshake
+        (void)SSL_set_session(ssl, session);
+        SSL_SESSION_free(session);
+    }
+
+    return ssl;
+}
+
+void TlsContext::SetCaFile(const std::filesystem::path &path)
+{
+    if (SSL_CTX_load_verify_locations(m_Context, path.c_str(), nullptr) != 1)
+    {
+        throw std::runtime_error("Can't load CA file '" + path.string() +
+                                 "': " + TakeError());
+    }
+}
+
+void TlsContext::SetProtocols(const std::vector<std::string> &protocols)
+{
+    // RFC 7301, 3.1. The Application-Layer Protocol Negotiation Extension,
+    // every name is prefixed with its length
+    std::vector<unsigned char> list;
+    for (const std::string &protocol : protocols)
+    {
+        if (protocol.empty() || protocol.size() > 255)
+        {
+            throw std::invalid_argument("Invalid application protocol: '" +
+                                        protocol + "'");
+        }
+
+        list.push_back(static_cast<unsigned char>(protocol.size()));
+        list.insert(list.end(), protocol.begin(), protocol.end());
+    }
+
+    // NOTE: Unlike the rest of OpenSSL it returns zero on success
+    if (SSL_CTX_set_alpn_protos(m_Context, list.data(),
+                                static_cast<unsigned int>(list.size())) != 0)
+    {
+        throw std::runtime_error("Failed to set application protocols: " +
+                                 TakeError());
+    }
+}
+
+std::string TlsContext::TakeError(void)
+{
+    const unsigned long error = ERR_get_error();
+    ERR_clear_error();
+
+    const char *reason = ERR_reason_error_string(error);
+    return reason != nullptr ? reason : "unknown error";
+}
+
+TlsContext &TlsContext::Get(void)
+{
+    static TlsContext tlsContext;
+    return tlsContext;
+}
+
+int TlsContext::OnNewSession(SSL *ssl, SSL_SESSION *session)
+{
+    const auto *sessionKey =
+        static_cast<const std::string *>(SSL_get_app_data(ssl));
+    if (sessionKey == nullptr || !SSL_SESSION_is_resumable(session))
+    {
+        return 0;
+    }
+
+    TlsContext &tlsContext = Get();
+    SSL_SESSION *expired = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(tlsContext.m_Mutex);
+        auto &sessions = tlsContext.m_Sessions[*sessionKey];
+        sessions.push_back(session);
+        if (sessions.size() > s_MaxSessionsPerHost)
+        {
+            expired = sessions.front();
+            sessions.pop_front();
+        }
+    }
+
+    SSL_SESSION_free(expired);
+
+    // NOTE: Cache keeps the reference it's given
+    return 1;
+}
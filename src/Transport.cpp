@@ -0,0 +1,319 @@
+#include "ahd/Transport.hpp"
+#include "ahd/Connector.hpp"
+#include "ahd/LoopbackTransport.hpp"
+#include "ahd/Resolver.hpp"
+#include "ahd/TlsContext.hpp"
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/socket.h>
+
+namespace
+{
+// NOTE: Idle connection must have nothing to read, data or EOF means that
+// the server has closed it or sent something unexpected
+bool IsSocketIdle(int descriptor)
+{
+    uint8_t byte;
+    const ssize_t result =
+        recv(descriptor, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT);
+    return result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+class TcpStream : public TransportStream
+{
+public:
+    explicit TcpStream(std::unique_ptr<http::Socket> socket)
+        : m_Socket(std::move(socket))
+    {
+    }
+
+    virtual int GetDescriptor(void) const override
+    {
+        return m_Socket->getHandle();
+    }
+
+    virtual std::size_t TrySend(const uint8_t *data,
+                                std::size_t size) override
+    {
+        return m_Socket->trySend(data, size);
+    }
+
+    virtual std::size_t TryReceive(uint8_t *data, std::size_t size) override
+    {
+        return m_Socket->tryRecv(data, size);
+    }
+
+    virtual bool IsAlive(void) const override
+    {
+        return IsSocketIdle(m_Socket->getHandle());
+    }
+
+    virtual bool CanSplice(void) const override
+    {
+        return true;
+    }
+
+private:
+    std::unique_ptr<http::Socket> m_Socket;
+};
+
+// TLS over a connected socket. Handshake is driven by the first sends and
+// receives, so it takes no extra round of events
+class TlsStream : public TransportStream
+{
+public:
+    TlsStream(std::unique_ptr<http::Socket> socket, const std::string &host,
+              std::string sessionKey)
+        : m_Socket(std::move(socket)), m_Host(host),
+          m_SessionKey(std::move(sessionKey)),
+          m_Ssl(TlsContext::Get().CreateConnection(host, m_SessionKey)),
+          m_Connected(false), m_Failed(false)
+    {
+        if (SSL_set_fd(m_Ssl, m_Socket->getHandle()) != 1)
+        {
+            SSL_free(m_Ssl);
+            throw std::runtime_error("Failed to attach TLS to socket: " +
+                                     TlsContext::TakeError());
+        }
+
+        SSL_set_connect_state(m_Ssl);
+    }
+
+    virtual ~TlsStream()
+    {
+        // NOTE: `close_notify` is sent if the socket takes it, the peer
+        // doesn't need it to tell the end of a response. Connection which
+        // has failed must not be shut down
+        if (m_Connected && !m_Failed)
+        {
+            (void)SSL_shutdown(m_Ssl);
+        }
+
+        SSL_free(m_Ssl);
+    }
+
+    virtual int GetDescriptor(void) const override
+    {
+        return m_Socket->getHandle();
+    }
+
+    virtual std::size_t TrySend(const uint8_t *data,
+                                std::size_t size) override
+    {
+        if (!Handshake())
+        {
+            return s_WouldBlock;
+        }
+
+        std::size_t written = 0;
+        const int result = SSL_write_ex(m_Ssl, data, size, &written);
+        return result == 1 ? written : OnError(result, "send");
+    }
+
+    virtual std::size_t TryReceive(uint8_t *data, std::size_t size) override
+    {
+        if (!Handshake())
+        {
+            return s_WouldBlock;
+        }
+
+        std::size_t read = 0;
+        const int result = SSL_read_ex(m_Ssl, data, size, &read);
+        return result == 1 ? read : OnError(result, "receive");
+    }
+
+    virtual bool IsAlive(void) const override
+    {
+        return SSL_pending(m_Ssl) == 0 && IsSocketIdle(m_Socket->getHandle());
+    }
+
+    virtual bool Handshake(void) override
+    {
+        if (m_Connected)
+        {
+            return true;
+        }
+
+        const int result = SSL_do_handshake(m_Ssl);
+        if (result == 1)
+        {
+            m_Connected = true;
+            return true;
+        }
+
+        const int error = SSL_get_error(m_Ssl, result);
+        if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+        {
+            return false;
+        }
+
+        m_Failed = true;
+        std::string reason = TlsContext::TakeError();
+        const long verifyResult = SSL_get_verify_result(m_Ssl);
+        if (verifyResult != X509_V_OK)
+        {
+            reason = X509_verify_cert_error_string(verifyResult);
+        }
+
+        throw std::runtime_error("TLS handshake with '" + m_Host +
+                                 "' failed: " + reason);
+    }
+
+    virtual std::string GetProtocol(void) const override
+    {
+        const unsigned char *protocol = nullptr;
+        unsigned int size = 0;
+        SSL_get0_alpn_selected(m_Ssl, &protocol, &size);
+        if (protocol == nullptr)
+        {
+            return std::string();
+        }
+
+        return std::string(reinterpret_cast<const char *>(protocol), size);
+    }
+
+private:
+
+    std::size_t OnError(int result, const char *operation)
+    {
+        const int error = SSL_get_error(m_Ssl, result);
+        switch (error)
+        {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            return s_WouldBlock;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        default:
+            break;
+        }
+
+        m_Failed = true;
+        if (error == SSL_ERROR_SYSCALL && errno != 0)
+        {
+            // NOTE: Resets must reach the connection limiter as they are
+            throw std::system_error(errno, std::system_category(),
+                                    std::string("Failed to ") + operation +
+                                        " TLS data");
+        }
+
+        throw std::runtime_error(std::string("Failed to ") + operation +
+                                 " TLS data: " + TlsContext::TakeError());
+    }
+
+    const std::unique_ptr<http::Socket> m_Socket;
+    const std::string m_Host;
+    // NOTE: Sessions received on this connection are cached under it
+    const std::string m_SessionKey;
+    SSL *const m_Ssl;
+    bool m_Connected;
+    bool m_Failed;
+};
+
+// Resolves the host and races connections to its addresses, `https` URIs
+// get TLS on top of the connected socket
+class TcpTransport : public Transport
+{
+public:
+    virtual void Connect(const http::Uri &uri,
+                         std::chrono::milliseconds timeout,
+                         ConnectHandler handler) override
+    {
+        const bool secure = uri.scheme == "https";
+        uint16_t port = secure ? 443 : 80;
+        try
+        {
+            if (!uri.port.empty())
+            {
+                port = http::detail::stringToUint<uint16_t>(uri.port.cbegin(),
+                                                            uri.port.cend());
+            }
+        }
+        catch (...)
+        {
+            handler(std::current_exception(), nullptr);
+            return;
+        }
+
+        Resolver::Get().Resolve(
+            uri.host, port,
+            [host = uri.host, port, secure, timeout,
+             handler = std::move(handler)](std::exception_ptr error,
+                const std::vector<SocketAddress> &addresses) {
+                if (error)
+                {
+                    handler(error, nullptr);
+                    return;
+                }
+
+                Connector::Get().Connect(
+                    host, addresses, timeout,
+                    [host, port, secure,
+                     handler](std::exception_ptr connectError,
+                              std::unique_ptr<http::Socket> socket) {
+                        if (connectError)
+                        {
+                            handler(connectError, nullptr);
+                            return;
+                        }
+
+                        std::unique_ptr<TransportStream> stream;
+                        try
+                        {
+                            stream = Open(std::move(socket), host, port,
+                                          secure);
+                        }
+                        catch (...)
+                        {
+                            handler(std::current_exception(), nullptr);
+                            return;
+                        }
+
+                        handler(nullptr, std::move(stream));
+                    });
+            });
+    }
+
+private:
+    static std::unique_ptr<TransportStream> Open(
+        std::unique_ptr<http::Socket> socket, const std::string &host,
+        uint16_t port, bool secure)
+    {
+        if (!secure)
+        {
+            return std::make_unique<TcpStream>(std::move(socket));
+        }
+
+        return std::make_unique<TlsStream>(std::move(socket), host,
+                                           host + ":" + std::to_string(port));
+    }
+};
+} // namespace
+
+std::unique_ptr<Transport> Transport::Create(const std::string &specification)
+{
+    const auto separator = specification.find(':');
+    const std::string name = specification.substr(0, separator);
+    const std::string options = separator == std::string::npos
+                                    ? std::string()
+                                    : specification.substr(separator + 1);
+
+    if (name == s_Tcp && separator == std::string::npos)
+    {
+        return std::make_unique<TcpTransport>();
+    }
+
+    if (name == s_Loopback)
+    {
+        return std::make_unique<LoopbackTransport>(options);
+    }
+
+    throw std::invalid_argument("Unsupported transport: " + specification);
+}
+
+const char *Transport::GetTransports(void)
+{
+    return "tcp, loopback";
+}
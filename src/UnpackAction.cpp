@@ -32,3 +32,8 @@ void UnpackAction::Execute(void) const
         std::exit(EXIT_FAILURE);
     }
 }
+
+ResourceClass UnpackAction::GetResourceClass(void) const
+{
+    return ResourceClass::Cpu;
+}
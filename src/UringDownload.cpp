@@ -0,0 +1,364 @@
+#include "ahd/UringDownload.hpp"
+
+#ifdef AHD_WITH_IO_URING
+
+#include "ahd/ConnectionPool.hpp"
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+UringDownload::UringDownload(const std::string &requestUrl,
+                             int outputDescriptor,
+                             http::HeaderHandler headerHandler,
+                             CompletionHandler onComplete)
+    : m_Uri(http::parseUri(requestUrl.begin(), requestUrl.end())),
+      m_OutputDescriptor(outputDescriptor), m_Response(),
+      m_HeaderHandler(std::move(headerHandler)),
+      m_Parser(
+          m_Response,
+          [this](const uint8_t *data, std::size_t size) { Stage(data, size); },
+          [this](const http::Response &response) { OnHeader(response); }),
+      m_OnComplete(std::move(onComplete)), m_UringLoop(nullptr),
+      m_Limiter(nullptr), m_Socket(),
+      m_Address(), m_AddressSize(0), m_RequestData(), m_Receiving(false),
+      m_ReceiveCancelled(false), m_ReceivePaused(false), m_Done(false),
+      m_ReceiveOperation(0), m_Error(), m_Staging(), m_FileOffset(0),
+      m_InFlightWrites(0)
+{
+}
+
+void UringDownload::Start(UringLoop &uringLoop)
+{
+    if (m_Uri.scheme != "http")
+    {
+        throw http::RequestError("Only HTTP scheme is supported");
+    }
+
+    const uint16_t port = m_Uri.port.empty()
+                              ? 80
+                              : http::detail::stringToUint<uint16_t>(
+                                    m_Uri.port.cbegin(), m_Uri.port.cend());
+
+    m_RequestData = http::encodeHtml(m_Uri, GET_REQUEST, {}, {});
+    m_Staging.reserve(s_WriteBlockSize);
+    m_UringLoop = &uringLoop;
+    m_Limiter = &ConnectionPool::Get().GetLimiter(
+        m_Uri.scheme + "://" + m_Uri.host + ":" +
+        (m_Uri.port.empty() ? std::string("80") : m_Uri.port));
+
+    // NOTE: Resolver runs on the epoll threads, everything after it runs on
+    // the io_uring thread
+    Resolver::Get().Resolve(
+        m_Uri.host, port,
+        [self = shared_from_this()](
+            std::exception_ptr error,
+            const std::vector<SocketAddress> &addresses) {
+            if (!error)
+            {
+                try
+                {
+                    self->Open(addresses.front());
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+            }
+
+            self->m_UringLoop->Post([self, error]() {
+                if (error)
+                {
+                    self->Fail(error);
+                    return;
+                }
+
+                self->Connect();
+            });
+        });
+}
+
+void UringDownload::OnHeader(const http::Response &response)
+{
+    // RFC 6585, 4. 429 Too Many Requests and RFC 7231, 6.6.4. 503 Service
+    // Unavailable
+    const int status = response.status.code;
+    if (status == http::Status::TooManyRequests ||
+        status == http::Status::ServiceUnavailable)
+    {
+        m_Limiter->OnCongestion("HTTP " + std::to_string(status));
+    }
+
+    if (m_HeaderHandler)
+    {
+        m_HeaderHandler(response);
+    }
+}
+
+void UringDownload::Open(const SocketAddress &address)
+{
+    m_Address = address.storage;
+    m_AddressSize = address.size;
+    m_Socket = std::make_unique<http::Socket>(
+        address.storage.ss_family == AF_INET6 ? http::InternetProtocol::v6
+                                              : http::InternetProtocol::v4);
+
+    // NOTE: io_uring does its own readiness polling, with a non-blocking
+    // socket connect would complete with EINPROGRESS
+    const int flags = fcntl(m_Socket->getHandle(), F_GETFL);
+    if (flags == -1 ||
+        fcntl(m_Socket->getHandle(), F_SETFL, flags & ~O_NONBLOCK) == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to set socket flags");
+    }
+}
+
+void UringDownload::Connect(void)
+{
+    io_uring_sqe &entry = m_UringLoop->Prepare(
+        [self = shared_from_this()](int32_t result, uint32_t) {
+            if (result < 0)
+            {
+                self->Fail(std::make_exception_ptr(std::system_error(
+                    -result, std::system_category(), "Failed to connect")));
+            }
+        });
+    entry.opcode = IORING_OP_CONNECT;
+    entry.fd = m_Socket->getHandle();
+    entry.addr = reinterpret_cast<uint64_t>(&m_Address);
+    entry.off = m_AddressSize;
+
+    // NOTE: Request is linked to the connect, so both are submitted at once
+    // and the request is cancelled if connect fails
+    entry.flags = IOSQE_IO_LINK;
+    Send(0);
+}
+
+void UringDownload::Send(std::size_t offset)
+{
+    io_uring_sqe &entry = m_UringLoop->Prepare(
+        [self = shared_from_this(), offset](int32_t result, uint32_t) {
+            if (result < 0)
+            {
+                self->Fail(std::make_exception_ptr(std::system_error(
+                    -result, std::system_category(), "Failed to send data")));
+            }
+            else if (offset + result < self->m_RequestData.size())
+            {
+                self->Send(offset + result);
+            }
+            else
+            {
+                self->Receive();
+            }
+        });
+    entry.opcode = IORING_OP_SEND;
+    entry.fd = m_Socket->getHandle();
+    entry.addr = reinterpret_cast<uint64_t>(m_RequestData.data() + offset);
+    entry.len = static_cast<uint32_t>(m_RequestData.size() - offset);
+    entry.msg_flags = MSG_NOSIGNAL;
+}
+
+void UringDownload::Receive(void)
+{
+    io_uring_sqe &entry = m_UringLoop->Prepare(
+        [self = shared_from_this()](int32_t result, uint32_t flags) {
+            self->OnReceived(result, flags);
+        });
+    entry.opcode = IORING_OP_RECV;
+    entry.fd = m_Socket->getHandle();
+    entry.ioprio = IORING_RECV_MULTISHOT;
+    entry.flags = IOSQE_BUFFER_SELECT;
+    entry.buf_group = m_UringLoop->GetBufferGroup();
+
+    m_Receiving = true;
+    m_ReceiveCancelled = false;
+    m_ReceiveOperation = entry.user_data;
+}
+
+void UringDownload::OnReceived(int32_t result, uint32_t flags)
+{
+    try
+    {
+        if (flags & IORING_CQE_F_BUFFER)
+        {
+            const uint16_t id =
+                static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+
+            // NOTE: Parser hands the body over to `Stage` which copies it,
+            // so the buffer can go back to the kernel right after parsing,
+            // even when the response has been rejected
+            bool complete = false;
+            try
+            {
+                complete = !m_Done && result > 0 &&
+                           m_Parser.parse(m_UringLoop->GetBuffer(id),
+                                          static_cast<std::size_t>(result));
+            }
+            catch (...)
+            {
+                m_UringLoop->RecycleBuffer(id);
+                throw;
+            }
+            m_UringLoop->RecycleBuffer(id);
+
+            if (complete)
+            {
+                m_Done = true;
+            }
+        }
+        else if (!m_Done && result == 0)
+        {
+            m_Parser.finish();
+            m_Done = true;
+        }
+        else if (!m_Done && result < 0 && result != -ENOBUFS &&
+                 result != -ECANCELED)
+        {
+            throw std::system_error(-result, std::system_category(),
+                                    "Failed to read data");
+        }
+    }
+    catch (...)
+    {
+        Fail(std::current_exception());
+    }
+
+    if (!(flags & IORING_CQE_F_MORE))
+    {
+        // NOTE: Multishot receive ends on its own when the kernel runs out
+        // of provided buffers, in that case it's simply armed again
+        m_Receiving = false;
+        if (!m_Done && !m_ReceivePaused)
+        {
+            Receive();
+        }
+    }
+    else if (m_Done)
+    {
+        StopReceiving();
+    }
+
+    if (m_Done && !m_Staging.empty())
+    {
+        FlushStaging();
+    }
+
+    TryFinish();
+}
+
+void UringDownload::Stage(const uint8_t *data, std::size_t size)
+{
+    m_Staging.insert(m_Staging.end(), data, data + size);
+    if (m_Staging.size() < s_WriteBlockSize)
+    {
+        return;
+    }
+
+    FlushStaging();
+    m_Staging.reserve(s_WriteBlockSize);
+
+    // NOTE: Disk is behind the network, receiving is paused so memory usage
+    // stays bounded
+    if (m_InFlightWrites >= s_MaxInFlightWrites && !m_ReceivePaused)
+    {
+        m_ReceivePaused = true;
+        StopReceiving();
+    }
+}
+
+void UringDownload::FlushStaging(void)
+{
+    auto block = std::make_shared<std::vector<uint8_t>>();
+    block->swap(m_Staging);
+
+    const uint64_t fileOffset = m_FileOffset;
+    m_FileOffset += block->size();
+    Write(std::move(block), 0, fileOffset);
+}
+
+void UringDownload::Write(std::shared_ptr<std::vector<uint8_t>> block,
+                          std::size_t offset, uint64_t fileOffset)
+{
+    io_uring_sqe &entry = m_UringLoop->Prepare(
+        [self = shared_from_this(), block, offset,
+         fileOffset](int32_t result, uint32_t) {
+            --self->m_InFlightWrites;
+
+            if (result <= 0)
+            {
+                self->Fail(std::make_exception_ptr(std::system_error(
+                    result < 0 ? -result : EIO, std::system_category(),
+                    "Failed to write to output file")));
+            }
+            else if (offset + result < block->size())
+            {
+                self->Write(block, offset + result, fileOffset + result);
+            }
+
+            if (self->m_ReceivePaused &&
+                self->m_InFlightWrites < s_MaxInFlightWrites / 2)
+            {
+                self->m_ReceivePaused = false;
+                if (!self->m_Receiving && !self->m_Done)
+                {
+                    self->Receive();
+                }
+            }
+
+            self->TryFinish();
+        });
+    entry.opcode = IORING_OP_WRITE;
+    entry.fd = m_OutputDescriptor;
+    entry.addr = reinterpret_cast<uint64_t>(block->data() + offset);
+    entry.len = static_cast<uint32_t>(block->size() - offset);
+    entry.off = fileOffset;
+
+    ++m_InFlightWrites;
+}
+
+void UringDownload::Fail(std::exception_ptr error)
+{
+    if (!m_Error)
+    {
+        m_Error = error;
+
+        // NOTE: Resets and timeouts usually mean the host is overloaded
+        std::string reason;
+        if (m_Limiter != nullptr &&
+            ConcurrencyLimiter::IsCongestion(error, reason))
+        {
+            m_Limiter->OnCongestion(reason);
+        }
+    }
+
+    m_Done = true;
+    m_Staging.clear();
+    StopReceiving();
+    TryFinish();
+}
+
+void UringDownload::StopReceiving(void)
+{
+    if (m_Receiving && !m_ReceiveCancelled)
+    {
+        m_UringLoop->Cancel(m_ReceiveOperation);
+        m_ReceiveCancelled = true;
+    }
+}
+
+void UringDownload::TryFinish(void)
+{
+    if (!m_Done || m_Receiving || m_InFlightWrites > 0 || !m_OnComplete)
+    {
+        return;
+    }
+
+    m_OnComplete(m_Error);
+    m_OnComplete = nullptr;
+}
+
+const char *UringDownload::GET_REQUEST = "GET";
+
+#endif // AHD_WITH_IO_URING
@@ -0,0 +1,540 @@
+#include "ahd/UringLoop.hpp"
+
+#ifdef AHD_WITH_IO_URING
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+int SetupRing(unsigned entries, io_uring_params *params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int RegisterRing(int descriptor, unsigned opcode, void *argument,
+                 unsigned argumentCount)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, descriptor,
+                                    opcode, argument, argumentCount));
+}
+
+int EnterRing(int descriptor, unsigned submitCount, unsigned waitCount,
+              unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, descriptor,
+                                    submitCount, waitCount, flags, nullptr,
+                                    0));
+}
+
+template <typename T> T LoadAcquire(T *value)
+{
+    return std::atomic_ref<T>(*value).load(std::memory_order_acquire);
+}
+
+template <typename T> void StoreRelease(T *value, T newValue)
+{
+    std::atomic_ref<T>(*value).store(newValue, std::memory_order_release);
+}
+
+template <typename T> T *RingField(void *memory, uint32_t offset)
+{
+    return reinterpret_cast<T *>(static_cast<uint8_t *>(memory) + offset);
+}
+} // namespace
+
+UringLoop::UringLoop(unsigned entries, uint16_t bufferCount,
+                     uint32_t bufferSize)
+    : m_RingDescriptor(-1), m_WakeDescriptor(-1), m_WakeValue(0),
+      m_RingMemory(MAP_FAILED), m_RingMemorySize(0),
+      m_CompletionRingMemory(MAP_FAILED), m_CompletionRingMemorySize(0),
+      m_Entries(nullptr), m_EntriesSize(0), m_SubmissionHead(nullptr),
+      m_SubmissionTail(nullptr), m_SubmissionArray(nullptr),
+      m_SubmissionMask(0), m_SubmissionEntries(0), m_LocalTail(0),
+      m_SubmittedTail(0), m_CompletionHead(nullptr),
+      m_CompletionTail(nullptr), m_CompletionMask(0), m_Completions(nullptr),
+      m_Buffers(), m_BufferSize(bufferSize),
+      m_NextOperation(s_UntrackedOperation + 1), m_Operations(),
+      m_PostedTasksMutex(), m_PostedTasks(), m_Running(true), m_Thread()
+{
+    io_uring_params params = {};
+    m_RingDescriptor = SetupRing(entries, &params);
+    if (m_RingDescriptor == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to set up io_uring");
+    }
+
+    // NOTE: Destructor doesn't run for a constructor that throws, and
+    // kernels lacking the needed operations make it throw routinely
+    try
+    {
+        Initialize(params, bufferCount);
+    }
+    catch (...)
+    {
+        Release();
+        throw;
+    }
+
+    m_Thread = std::thread(&UringLoop::Work, this);
+}
+
+UringLoop::~UringLoop()
+{
+    if (m_Thread.joinable())
+    {
+        m_Running = false;
+        const uint64_t value = 1;
+        (void)write(m_WakeDescriptor, &value, sizeof(value));
+        m_Thread.join();
+    }
+
+    Release();
+}
+
+void UringLoop::Initialize(const io_uring_params &params,
+                           uint16_t bufferCount)
+{
+    CheckOperations();
+
+    m_RingMemorySize =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_CompletionRingMemorySize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap)
+    {
+        m_RingMemorySize =
+            std::max(m_RingMemorySize, m_CompletionRingMemorySize);
+    }
+
+    m_RingMemory = mmap(nullptr, m_RingMemorySize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, m_RingDescriptor,
+                        IORING_OFF_SQ_RING);
+    if (m_RingMemory == MAP_FAILED)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to map submission ring");
+    }
+
+    if (singleMap)
+    {
+        m_CompletionRingMemory = m_RingMemory;
+    }
+    else
+    {
+        m_CompletionRingMemory =
+            mmap(nullptr, m_CompletionRingMemorySize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, m_RingDescriptor,
+                 IORING_OFF_CQ_RING);
+        if (m_CompletionRingMemory == MAP_FAILED)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to map completion ring");
+        }
+    }
+
+    m_EntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *entriesMemory =
+        mmap(nullptr, m_EntriesSize, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, m_RingDescriptor, IORING_OFF_SQES);
+    if (entriesMemory == MAP_FAILED)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to map submission entries");
+    }
+    m_Entries = static_cast<io_uring_sqe *>(entriesMemory);
+
+    m_SubmissionHead = RingField<unsigned>(m_RingMemory, params.sq_off.head);
+    m_SubmissionTail = RingField<unsigned>(m_RingMemory, params.sq_off.tail);
+    m_SubmissionArray = RingField<unsigned>(m_RingMemory, params.sq_off.array);
+    m_SubmissionMask =
+        *RingField<unsigned>(m_RingMemory, params.sq_off.ring_mask);
+    m_SubmissionEntries = params.sq_entries;
+    m_LocalTail = m_SubmittedTail = *m_SubmissionTail;
+
+    m_CompletionHead =
+        RingField<unsigned>(m_CompletionRingMemory, params.cq_off.head);
+    m_CompletionTail =
+        RingField<unsigned>(m_CompletionRingMemory, params.cq_off.tail);
+    m_CompletionMask =
+        *RingField<unsigned>(m_CompletionRingMemory, params.cq_off.ring_mask);
+    m_Completions =
+        RingField<io_uring_cqe>(m_CompletionRingMemory, params.cq_off.cqes);
+
+    // NOTE: Buffers are handed to the kernel with IORING_OP_PROVIDE_BUFFERS
+    // which goes out with the first submission
+    m_Buffers = std::make_unique<uint8_t[]>(std::size_t(bufferCount) *
+                                            m_BufferSize);
+    ProvideBuffers(0, bufferCount);
+    CheckMultishotReceive();
+
+    m_WakeDescriptor = eventfd(0, EFD_CLOEXEC);
+    if (m_WakeDescriptor == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to create eventfd");
+    }
+}
+
+void UringLoop::CheckOperations(void)
+{
+    // NOTE: Probing itself arrived in 5.6, a kernel without it doesn't
+    // have provided buffers (5.7) either
+    const std::size_t opcodeCount = 256;
+    std::vector<uint8_t> memory(sizeof(io_uring_probe) +
+                                opcodeCount * sizeof(io_uring_probe_op));
+    auto *probe = reinterpret_cast<io_uring_probe *>(memory.data());
+    if (RegisterRing(m_RingDescriptor, IORING_REGISTER_PROBE, probe,
+                     opcodeCount) == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to probe io_uring operations");
+    }
+
+    const std::pair<uint8_t, const char *> operations[] = {
+        {IORING_OP_CONNECT, "IORING_OP_CONNECT"},
+        {IORING_OP_SEND, "IORING_OP_SEND"},
+        {IORING_OP_RECV, "IORING_OP_RECV"},
+        {IORING_OP_READ, "IORING_OP_READ"},
+        {IORING_OP_WRITE, "IORING_OP_WRITE"},
+        {IORING_OP_PROVIDE_BUFFERS, "IORING_OP_PROVIDE_BUFFERS"},
+        {IORING_OP_ASYNC_CANCEL, "IORING_OP_ASYNC_CANCEL"},
+    };
+
+    for (const auto &[opcode, name] : operations)
+    {
+        if (opcode > probe->last_op || opcode >= probe->ops_len ||
+            !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+        {
+            throw std::system_error(
+                ENOTSUP, std::system_category(),
+                std::string("Kernel doesn't support ") + name);
+        }
+    }
+}
+
+void UringLoop::CheckMultishotReceive(void)
+{
+    // NOTE: Receive flags aren't covered by the probe. Kernels before 6.0
+    // reject IORING_RECV_MULTISHOT or ignore it and complete the receive
+    // once, so a real receive is tried on a socket pair
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to create socket pair");
+    }
+
+    int32_t result = 0;
+    bool completed = false;
+    bool multishot = false;
+
+    try
+    {
+        const uint8_t byte = 0;
+        if (write(sockets[1], &byte, sizeof(byte)) != sizeof(byte))
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Failed to write to socket pair");
+        }
+
+        io_uring_sqe &entry = Prepare([&](int32_t received, uint32_t flags) {
+            if (flags & IORING_CQE_F_BUFFER)
+            {
+                RecycleBuffer(
+                    static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+
+            if (!completed)
+            {
+                completed = true;
+                result = received;
+                multishot = received > 0 && (flags & IORING_CQE_F_MORE);
+            }
+        });
+        entry.opcode = IORING_OP_RECV;
+        entry.fd = sockets[0];
+        entry.ioprio = IORING_RECV_MULTISHOT;
+        entry.flags = IOSQE_BUFFER_SELECT;
+        entry.buf_group = s_BufferGroup;
+        const uint64_t operation = entry.user_data;
+
+        while (!completed)
+        {
+            SubmitAndWait(1);
+            ReapCompletions();
+        }
+
+        // NOTE: Receive still armed ends with one last completion once
+        // it's cancelled
+        if (m_Operations.count(operation) != 0)
+        {
+            Cancel(operation);
+        }
+        while (m_Operations.count(operation) != 0)
+        {
+            SubmitAndWait(1);
+            ReapCompletions();
+        }
+    }
+    catch (...)
+    {
+        close(sockets[0]);
+        close(sockets[1]);
+        throw;
+    }
+
+    close(sockets[0]);
+    close(sockets[1]);
+
+    if (!multishot)
+    {
+        throw std::system_error(result < 0 ? -result : ENOTSUP,
+                                std::system_category(),
+                                "Kernel doesn't support multishot receive");
+    }
+}
+
+void UringLoop::Release(void)
+{
+    if (m_WakeDescriptor != -1)
+    {
+        close(m_WakeDescriptor);
+    }
+
+    if (m_Entries != nullptr)
+    {
+        munmap(m_Entries, m_EntriesSize);
+    }
+
+    if (m_CompletionRingMemory != MAP_FAILED &&
+        m_CompletionRingMemory != m_RingMemory)
+    {
+        munmap(m_CompletionRingMemory, m_CompletionRingMemorySize);
+    }
+
+    if (m_RingMemory != MAP_FAILED)
+    {
+        munmap(m_RingMemory, m_RingMemorySize);
+    }
+
+    if (m_RingDescriptor != -1)
+    {
+        close(m_RingDescriptor);
+    }
+}
+
+void UringLoop::Post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_PostedTasksMutex);
+        m_PostedTasks.emplace_back(std::move(task));
+    }
+
+    const uint64_t value = 1;
+    (void)write(m_WakeDescriptor, &value, sizeof(value));
+}
+
+io_uring_sqe &UringLoop::Prepare(Completion completion)
+{
+    if (m_LocalTail - LoadAcquire(m_SubmissionHead) >= m_SubmissionEntries)
+    {
+        SubmitAndWait(0);
+    }
+
+    const unsigned index = m_LocalTail & m_SubmissionMask;
+    io_uring_sqe &entry = m_Entries[index];
+    std::memset(&entry, 0, sizeof(entry));
+    m_SubmissionArray[index] = index;
+    ++m_LocalTail;
+
+    const uint64_t operation =
+        completion ? m_NextOperation++ : s_UntrackedOperation;
+    if (completion)
+    {
+        m_Operations.emplace(operation, std::make_unique<Completion>(
+                                            std::move(completion)));
+    }
+
+    entry.user_data = operation;
+    return entry;
+}
+
+void UringLoop::Cancel(uint64_t operation)
+{
+    io_uring_sqe &entry = Prepare(nullptr);
+    entry.opcode = IORING_OP_ASYNC_CANCEL;
+    entry.fd = -1;
+    entry.addr = operation;
+}
+
+uint16_t UringLoop::GetBufferGroup(void) const
+{
+    return s_BufferGroup;
+}
+
+const uint8_t *UringLoop::GetBuffer(uint16_t id) const
+{
+    return m_Buffers.get() + std::size_t(id) * m_BufferSize;
+}
+
+void UringLoop::RecycleBuffer(uint16_t id)
+{
+    // NOTE: Entry is submitted together with the next batch, so recycling
+    // doesn't cost an extra system call
+    ProvideBuffers(id, 1);
+}
+
+UringLoop *UringLoop::Get(void)
+{
+    static const std::unique_ptr<UringLoop> uringLoop =
+        []() -> std::unique_ptr<UringLoop> {
+        try
+        {
+            return std::make_unique<UringLoop>(s_EntryCount, s_BufferCount,
+                                               s_BufferSize);
+        }
+        catch (const std::system_error &e)
+        {
+            std::fprintf(stderr,
+                         "WARNING: io_uring is unavailable (%s), falling back "
+                         "to epoll\n",
+                         e.what());
+            return nullptr;
+        }
+    }();
+
+    return uringLoop.get();
+}
+
+void UringLoop::Work(void)
+{
+    ArmWakeUp();
+
+    while (m_Running)
+    {
+        RunPostedTasks();
+        SubmitAndWait(1);
+        ReapCompletions();
+    }
+}
+
+void UringLoop::ArmWakeUp(void)
+{
+    io_uring_sqe &entry = Prepare([this](int32_t, uint32_t) { ArmWakeUp(); });
+    entry.opcode = IORING_OP_READ;
+    entry.fd = m_WakeDescriptor;
+    entry.addr = reinterpret_cast<uint64_t>(&m_WakeValue);
+    entry.len = sizeof(m_WakeValue);
+}
+
+void UringLoop::ProvideBuffers(uint16_t firstId, uint16_t count)
+{
+    io_uring_sqe &entry = Prepare(nullptr);
+    entry.opcode = IORING_OP_PROVIDE_BUFFERS;
+    entry.fd = count;
+    entry.addr = reinterpret_cast<uint64_t>(GetBuffer(firstId));
+    entry.len = m_BufferSize;
+    entry.off = firstId;
+    entry.buf_group = s_BufferGroup;
+}
+
+void UringLoop::SubmitAndWait(unsigned waitCount)
+{
+    const unsigned submitCount = m_LocalTail - m_SubmittedTail;
+    StoreRelease(m_SubmissionTail, m_LocalTail);
+    m_SubmittedTail = m_LocalTail;
+
+    if (submitCount == 0 && waitCount == 0)
+    {
+        return;
+    }
+
+    while (EnterRing(m_RingDescriptor, submitCount, waitCount,
+                     waitCount > 0 ? IORING_ENTER_GETEVENTS : 0) == -1)
+    {
+        if (errno == EINTR)
+        {
+            // NOTE: Entries were consumed before the wait got interrupted
+            if (waitCount == 0)
+            {
+                return;
+            }
+            continue;
+        }
+
+        if (errno == EAGAIN || errno == EBUSY)
+        {
+            ReapCompletions();
+            continue;
+        }
+
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to enter io_uring");
+    }
+}
+
+void UringLoop::ReapCompletions(void)
+{
+    // NOTE: Head is reloaded on every step since completion handlers may
+    // reap completions themselves when the submission queue is full
+    for (;;)
+    {
+        const unsigned head = *m_CompletionHead;
+        if (head == LoadAcquire(m_CompletionTail))
+        {
+            break;
+        }
+
+        const io_uring_cqe completion = m_Completions[head & m_CompletionMask];
+        StoreRelease(m_CompletionHead, head + 1);
+
+        const auto operation = m_Operations.find(completion.user_data);
+        if (operation == m_Operations.end())
+        {
+            continue;
+        }
+
+        // NOTE: Completion may prepare new operations and rehash the map,
+        // but the handler itself lives on the heap
+        Completion *handler = operation->second.get();
+        (*handler)(completion.res, completion.flags);
+
+        if (!(completion.flags & IORING_CQE_F_MORE))
+        {
+            m_Operations.erase(completion.user_data);
+        }
+    }
+}
+
+void UringLoop::RunPostedTasks(void)
+{
+    std::vector<std::function<void()>> tasks;
+
+    {
+        std::lock_guard<std::mutex> lock(m_PostedTasksMutex);
+        tasks.swap(m_PostedTasks);
+    }
+
+    for (const auto &task : tasks)
+    {
+        task();
+    }
+}
+
+#endif // AHD_WITH_IO_URING
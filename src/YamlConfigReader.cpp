@@ -1,4 +1,6 @@
 #include "ahd/YamlConfigReader.hpp"
+#include "ahd/Checksum.hpp"
+#include <cmath>
 #include <iostream>
 
 TaskMap YamlConfigReader::Read(const std::filesystem::path &configPath)
@@ -13,7 +15,10 @@ TaskMap YamlConfigReader::Read(const std::filesystem::path &configPath)
         const std::string target =
             configYaml[s_ConfigTargetField].as<std::string>();
 
-        return MakeTaskMap(host, target, configYaml[s_ConfigFilesField]);
+        return MakeTaskMap(
+            host, target,
+            DispatchDownloadOptionsYaml(m_DownloadOptions, configYaml),
+            configYaml[s_ConfigFilesField]);
     }
     catch (YAML::BadFile &e)
     {
@@ -25,6 +30,7 @@ TaskMap YamlConfigReader::Read(const std::filesystem::path &configPath)
 
 TaskMap YamlConfigReader::MakeTaskMap(const std::string &host,
                                       const std::string &target,
+                                      const DownloadOptions &downloadOptions,
                                       const YAML::Node &filesYaml)
 {
     TaskMap taskMap;
@@ -37,8 +43,10 @@ TaskMap YamlConfigReader::MakeTaskMap(const std::string &host,
 
         std::shared_ptr<Task> task = std::make_shared<Task>();
         task->file = fileYaml[s_FileFileField].as<std::string>();
-        task->actions = DispatchActionsYaml(i, host, target, task,
-                                            fileYaml[s_FileActionsField]);
+        task->actions = DispatchActionsYaml(
+            i, host, target, task,
+            DispatchDownloadOptionsYaml(i, downloadOptions, fileYaml),
+            fileYaml[s_FileActionsField]);
 
         if (fileYaml[s_FileDependenciesField])
         {
@@ -164,10 +172,160 @@ void YamlConfigReader::ValidateFileYaml(uint64_t index,
     }
 }
 
+DownloadOptions YamlConfigReader::DispatchDownloadOptionsYaml(
+    const DownloadOptions &defaultOptions, const YAML::Node &configYaml)
+{
+    DownloadOptions downloadOptions = defaultOptions;
+
+    if (configYaml[s_ConfigCompressionField])
+    {
+        downloadOptions.compression =
+            configYaml[s_ConfigCompressionField].as<bool>();
+    }
+
+    DispatchDeadlinesYaml("", configYaml, downloadOptions);
+
+    return downloadOptions;
+}
+
+DownloadOptions YamlConfigReader::DispatchDownloadOptionsYaml(
+    uint64_t index, const DownloadOptions &defaultOptions,
+    const YAML::Node &fileYaml)
+{
+    DownloadOptions downloadOptions = defaultOptions;
+
+    if (fileYaml[s_FileSegmentsField])
+    {
+        const int64_t segments = fileYaml[s_FileSegmentsField].as<int64_t>();
+        if (segments < 1)
+        {
+            std::ostringstream errorMessage;
+            errorMessage << "'" << s_FileSegmentsField << "' at index "
+                         << index << " must be at least 1";
+            throw std::invalid_argument(errorMessage.str());
+        }
+
+        downloadOptions.segments = static_cast<std::size_t>(segments);
+    }
+
+    if (fileYaml[s_FileMinSegmentSizeField])
+    {
+        const int64_t minSegmentSize =
+            fileYaml[s_FileMinSegmentSizeField].as<int64_t>();
+        if (minSegmentSize < 1)
+        {
+            std::ostringstream errorMessage;
+            errorMessage << "'" << s_FileMinSegmentSizeField << "' at index "
+                         << index << " must be at least 1";
+            throw std::invalid_argument(errorMessage.str());
+        }
+
+        downloadOptions.minSegmentSize = static_cast<uint64_t>(minSegmentSize);
+    }
+
+    if (fileYaml[s_FileCompressionField])
+    {
+        downloadOptions.compression =
+            fileYaml[s_FileCompressionField].as<bool>();
+    }
+
+    if (fileYaml[s_FileWeightField])
+    {
+        const double weight = fileYaml[s_FileWeightField].as<double>();
+        if (!(weight > 0))
+        {
+            std::ostringstream errorMessage;
+            errorMessage << "'" << s_FileWeightField << "' at index " << index
+                         << " must be greater than 0";
+            throw std::invalid_argument(errorMessage.str());
+        }
+
+        downloadOptions.weight = weight;
+    }
+
+    if (fileYaml[s_FileChecksumField])
+    {
+        const std::string checksum =
+            fileYaml[s_FileChecksumField].as<std::string>();
+        if (!Checksum::Parse(checksum, downloadOptions.checksumAlgorithm,
+                             downloadOptions.checksum))
+        {
+            std::ostringstream errorMessage;
+            errorMessage << "'" << s_FileChecksumField << "' at index "
+                         << index << " must be '<algorithm>:<hex digest>' "
+                         << "with one of the supported algorithms: "
+                         << Checksum::GetAlgorithms();
+            throw std::invalid_argument(errorMessage.str());
+        }
+    }
+
+    std::ostringstream location;
+    location << " at index " << index;
+    DispatchDeadlinesYaml(location.str(), fileYaml, downloadOptions);
+
+    return downloadOptions;
+}
+
+void YamlConfigReader::DispatchDeadlinesYaml(const std::string &location,
+                                             const YAML::Node &yaml,
+                                             DownloadOptions &downloadOptions)
+{
+    Timeouts &timeouts = downloadOptions.timeouts;
+    if (yaml[s_ConnectTimeoutField])
+    {
+        timeouts.connect =
+            DispatchTimeoutYaml(location, yaml, s_ConnectTimeoutField);
+    }
+
+    if (yaml[s_FirstByteTimeoutField])
+    {
+        timeouts.firstByte =
+            DispatchTimeoutYaml(location, yaml, s_FirstByteTimeoutField);
+    }
+
+    if (yaml[s_IdleTimeoutField])
+    {
+        timeouts.idle = DispatchTimeoutYaml(location, yaml, s_IdleTimeoutField);
+    }
+
+    if (yaml[s_HedgePercentileField])
+    {
+        const double percentile = yaml[s_HedgePercentileField].as<double>();
+        if (!(percentile >= 0 && percentile < 100))
+        {
+            std::ostringstream errorMessage;
+            errorMessage << "'" << s_HedgePercentileField << "'" << location
+                         << " must be at least 0 and less than 100";
+            throw std::invalid_argument(errorMessage.str());
+        }
+
+        downloadOptions.hedgePercentile = percentile;
+    }
+}
+
+std::chrono::milliseconds YamlConfigReader::DispatchTimeoutYaml(
+    const std::string &location, const YAML::Node &yaml, const char *field)
+{
+    // NOTE: Seconds, fractions are allowed and zero disables the timeout
+    const double seconds = yaml[field].as<double>();
+    if (!(seconds >= 0 && seconds <= s_MaxTimeoutSeconds))
+    {
+        std::ostringstream errorMessage;
+        errorMessage << "'" << field << "'" << location
+                     << " must be a number of seconds from 0 to "
+                     << s_MaxTimeoutSeconds;
+        throw std::invalid_argument(errorMessage.str());
+    }
+
+    return std::chrono::milliseconds(
+        static_cast<int64_t>(std::ceil(seconds * 1000)));
+}
+
 // TODO: Add `ActionBuilder`
 std::vector<std::shared_ptr<Action>> YamlConfigReader::DispatchActionsYaml(
     uint64_t index, const std::string &host, const std::string &target,
-    std::shared_ptr<Task> &task, const YAML::Node &actionsYaml)
+    std::shared_ptr<Task> &task, const DownloadOptions &downloadOptions,
+    const YAML::Node &actionsYaml)
 {
     std::vector<std::shared_ptr<Action>> actions;
     actions.reserve(actionsYaml.size());
@@ -180,7 +338,7 @@ std::vector<std::shared_ptr<Action>> YamlConfigReader::DispatchActionsYaml(
         {
             // TODO: Add option for working directory
             actions.emplace_back(std::move(std::make_shared<DownloadAction>(
-                host + target + task->file, task->file)));
+                host + target + task->file, task->file, downloadOptions)));
         }
         else if (actionString == "unpack")
         {
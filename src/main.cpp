@@ -1,40 +1,448 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <string>
 
+#include "ahd/BandwidthScheduler.hpp"
+#include "ahd/ConcurrencyLimiter.hpp"
+#include "ahd/ConnectionPool.hpp"
+#include "ahd/DownloadOptions.hpp"
 #include "ahd/TaskRunner.hpp"
+#include "ahd/ThreadPool.hpp"
+#include "ahd/TlsContext.hpp"
+#include "ahd/Transport.hpp"
 #include "ahd/YamlConfigReader.hpp"
 
+struct Arguments
+{
+    std::filesystem::path configPath;
+    DownloadOptions downloadOptions;
+    std::size_t maxConnectionsPerHost =
+        ConnectionPool::s_DefaultMaxConnectionsPerHost;
+    std::size_t maxIdleConnectionsPerHost =
+        ConnectionPool::s_DefaultMaxIdleConnectionsPerHost;
+    std::size_t pipelineDepth = ConnectionPool::s_DefaultPipelineDepth;
+    uint64_t maxRate = 0;
+    uint64_t maxHostRate = 0;
+    // NOTE: `nullptr` keeps the connection pool's default
+    std::unique_ptr<Transport> transport;
+    Http2Settings http2Settings;
+    std::size_t ioWorkerCount = TaskRunner::s_DefaultIoWorkerCount;
+    std::size_t cpuWorkerCount = ThreadPool::GetDefaultSize();
+};
+
 const std::unique_ptr<ConfigReader> DispatchConfigType(
-    const std::filesystem::path &configPath)
+    const std::filesystem::path &configPath,
+    const DownloadOptions &downloadOptions)
 {
     // TODO: If nessesery, add config dispatching logic
     (void)configPath;
 
-    return std::make_unique<YamlConfigReader>();
+    return std::make_unique<YamlConfigReader>(downloadOptions);
 }
 
 void PrintUsage(void)
 {
-    std::cout << "usage: async-http-downloader <path-to-config.yaml>\n";
+    std::cout
+        << "usage: async-http-downloader [options] <path-to-config.yaml>\n"
+           "\n"
+           "options:\n"
+           "  --io-backend <epoll|uring>  I/O backend used for downloads "
+           "(default: epoll)\n"
+           "  --max-connections-per-host <n>\n"
+           "                              Most open connections per host, the "
+           "limit adapts\n"
+           "                              to the host below it (default: "
+        << ConnectionPool::s_DefaultMaxConnectionsPerHost
+        << ")\n"
+           "  --max-idle-connections <n>  Idle connections kept per host "
+           "(default: "
+        << ConnectionPool::s_DefaultMaxIdleConnectionsPerHost
+        << ")\n"
+           "  --concurrency-log           Print changes of the per-host "
+           "connection limit\n"
+           "  --pipeline-depth <n>        Requests in flight on one connection "
+           "(default: "
+        << ConnectionPool::s_DefaultPipelineDepth
+        << ")\n"
+           "  --cache-dir <path>          Download cache shared between "
+           "processes\n"
+           "  --max-rate <bytes/s>        Bandwidth limit for all downloads, "
+           "accepts k, m and g\n"
+           "                              suffixes (default: unlimited)\n"
+           "  --max-host-rate <bytes/s>   Bandwidth limit for every host "
+           "(default: unlimited)\n"
+           "  --transport <spec>          Transport used by the epoll backend, "
+           "tcp or\n"
+           "                              loopback[:size=<n>,rate=<bytes/s>]\n"
+           "                              (default: tcp)\n"
+           "  --ca-file <path>            Certificates trusted for HTTPS in "
+           "addition to the\n"
+           "                              system's ones\n"
+           "  --http2 <off|on|prior-knowledge>\n"
+           "                              HTTP/2 for HTTPS hosts which choose "
+           "it,\n"
+           "                              prior-knowledge also assumes it for "
+           "plain\n"
+           "                              HTTP hosts (default: on)\n"
+           "  --http2-max-streams <n>     Requests in flight on an HTTP/2 "
+           "connection\n"
+           "                              (default: "
+        << Http2Settings::s_DefaultMaxConcurrentStreams
+        << ")\n"
+           "  --http2-window <bytes>      Flow control window of every HTTP/2 "
+           "stream\n"
+           "                              (default: "
+        << Http2Settings::s_DefaultStreamWindowSize / (1024 * 1024)
+        << "m)\n"
+           "  --http2-connection-window <bytes>\n"
+           "                              Flow control window of an HTTP/2 "
+           "connection\n"
+           "                              (default: "
+        << Http2Settings::s_DefaultConnectionWindowSize / (1024 * 1024)
+        << "m)\n"
+           "  --io-workers <n>            Downloads run at the same time "
+           "(default: "
+        << TaskRunner::s_DefaultIoWorkerCount
+        << ")\n"
+           "  --cpu-workers <n>           Archives extracted at the same time "
+           "(default:\n"
+           "                              number of hardware threads, "
+        << ThreadPool::GetDefaultSize()
+        << ")\n"
+           "  --pool-stats                Print queue depth and utilization "
+           "of the I/O\n"
+           "                              and CPU pools\n";
+}
+
+bool ParseIoBackend(const char *value, IoBackend &ioBackend)
+{
+    if (std::strcmp(value, "epoll") == 0)
+    {
+        ioBackend = IoBackend::Epoll;
+        return true;
+    }
+
+    if (std::strcmp(value, "uring") == 0)
+    {
+#ifndef AHD_WITH_IO_URING
+        std::fprintf(stderr, "WARNING: Built without io_uring support, "
+                             "falling back to epoll\n");
+        ioBackend = IoBackend::Epoll;
+#else
+        ioBackend = IoBackend::Uring;
+#endif // AHD_WITH_IO_URING
+        return true;
+    }
+
+    std::fprintf(stderr, "Error: unknown I/O backend: '%s'\n", value);
+    return false;
+}
+
+bool ParseCount(const char *value, std::size_t &count)
+{
+    char *end = nullptr;
+    errno = 0;
+    const unsigned long long result = std::strtoull(value, &end, 10);
+    if (errno != 0 || end == value || *end != '\0' || value[0] == '-')
+    {
+        std::fprintf(stderr, "Error: invalid number: '%s'\n", value);
+        return false;
+    }
+
+    count = static_cast<std::size_t>(result);
+    return true;
+}
+
+// NOTE: Number of bytes with an optional `k`, `m` or `g` suffix
+bool ParseSize(const char *value, uint64_t &size)
+{
+    char *end = nullptr;
+    errno = 0;
+    const unsigned long long result = std::strtoull(value, &end, 10);
+    if (errno != 0 || end == value || value[0] == '-')
+    {
+        return false;
+    }
+
+    uint64_t multiplier = 1;
+    switch (*end)
+    {
+    case '\0':
+        break;
+    case 'k':
+    case 'K':
+        multiplier = 1024;
+        break;
+    case 'm':
+    case 'M':
+        multiplier = 1024 * 1024;
+        break;
+    case 'g':
+    case 'G':
+        multiplier = 1024 * 1024 * 1024;
+        break;
+    default:
+        return false;
+    }
+
+    if (*end != '\0' && end[1] != '\0')
+    {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(result) * multiplier;
+    return true;
+}
+
+bool ParseRate(const char *value, uint64_t &rate)
+{
+    if (!ParseSize(value, rate))
+    {
+        std::fprintf(stderr, "Error: invalid rate: '%s'\n", value);
+        return false;
+    }
+
+    return true;
+}
+
+bool ParseWindowSize(const char *value, uint32_t &windowSize)
+{
+    // RFC 9113, 6.5.2. Defined Settings
+    uint64_t size = 0;
+    if (!ParseSize(value, size) || size < 65535 || size > 2147483647)
+    {
+        std::fprintf(stderr,
+                     "Error: invalid window size: '%s' (64k to 2g-1)\n",
+                     value);
+        return false;
+    }
+
+    windowSize = static_cast<uint32_t>(size);
+    return true;
+}
+
+bool ParseHttp2Mode(const char *value, Http2Mode &mode)
+{
+    if (std::strcmp(value, "off") == 0)
+    {
+        mode = Http2Mode::Off;
+        return true;
+    }
+
+    if (std::strcmp(value, "on") == 0 ||
+        std::strcmp(value, "prior-knowledge") == 0)
+    {
+#ifndef AHD_WITH_NGHTTP2
+        std::fprintf(stderr, "WARNING: Built without HTTP/2 support, "
+                             "falling back to HTTP/1.1\n");
+        mode = Http2Mode::Off;
+#else
+        mode = std::strcmp(value, "on") == 0 ? Http2Mode::Alpn
+                                             : Http2Mode::PriorKnowledge;
+#endif // AHD_WITH_NGHTTP2
+        return true;
+    }
+
+    std::fprintf(stderr, "Error: unknown HTTP/2 mode: '%s'\n", value);
+    return false;
+}
+
+bool ParseTransport(const char *value, std::unique_ptr<Transport> &transport)
+{
+    try
+    {
+        transport = Transport::Create(value);
+        return true;
+    }
+    catch (const std::exception &error)
+    {
+        std::fprintf(stderr, "Error: %s (supported: %s)\n", error.what(),
+                     Transport::GetTransports());
+        return false;
+    }
+}
+
+bool LoadCaFile(const char *value)
+{
+    try
+    {
+        TlsContext::Get().SetCaFile(value);
+        return true;
+    }
+    catch (const std::exception &error)
+    {
+        std::fprintf(stderr, "Error: %s\n", error.what());
+        return false;
+    }
+}
+
+bool ParseArguments(int argc, const char **argv, Arguments &arguments)
+{
+    bool configPathFound = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *argument = argv[i];
+
+        if (std::strcmp(argument, "--io-backend") == 0 && i + 1 < argc)
+        {
+            if (!ParseIoBackend(argv[++i],
+                                arguments.downloadOptions.ioBackend))
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--max-connections-per-host") == 0 &&
+                 i + 1 < argc)
+        {
+            if (!ParseCount(argv[++i], arguments.maxConnectionsPerHost) ||
+                arguments.maxConnectionsPerHost == 0)
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--max-idle-connections") == 0 &&
+                 i + 1 < argc)
+        {
+            if (!ParseCount(argv[++i], arguments.maxIdleConnectionsPerHost))
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--concurrency-log") == 0)
+        {
+            ConcurrencyLimiter::SetLogging(true);
+        }
+        else if (std::strcmp(argument, "--io-workers") == 0 && i + 1 < argc)
+        {
+            if (!ParseCount(argv[++i], arguments.ioWorkerCount) ||
+                arguments.ioWorkerCount == 0)
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--cpu-workers") == 0 && i + 1 < argc)
+        {
+            if (!ParseCount(argv[++i], arguments.cpuWorkerCount) ||
+                arguments.cpuWorkerCount == 0)
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--pool-stats") == 0)
+        {
+            TaskRunner::SetStatsLogging(true);
+        }
+        else if (std::strcmp(argument, "--pipeline-depth") == 0 &&
+                 i + 1 < argc)
+        {
+            if (!ParseCount(argv[++i], arguments.pipelineDepth) ||
+                arguments.pipelineDepth == 0)
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--max-rate") == 0 && i + 1 < argc)
+        {
+            if (!ParseRate(argv[++i], arguments.maxRate))
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--max-host-rate") == 0 &&
+                 i + 1 < argc)
+        {
+            if (!ParseRate(argv[++i], arguments.maxHostRate))
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--transport") == 0 && i + 1 < argc)
+        {
+            if (!ParseTransport(argv[++i], arguments.transport))
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--ca-file") == 0 && i + 1 < argc)
+        {
+            if (!LoadCaFile(argv[++i]))
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--http2") == 0 && i + 1 < argc)
+        {
+            if (!ParseHttp2Mode(argv[++i], arguments.http2Settings.mode))
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--http2-max-streams") == 0 &&
+                 i + 1 < argc)
+        {
+            if (!ParseCount(argv[++i],
+                            arguments.http2Settings.maxConcurrentStreams) ||
+                arguments.http2Settings.maxConcurrentStreams == 0)
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--http2-window") == 0 && i + 1 < argc)
+        {
+            if (!ParseWindowSize(argv[++i],
+                                 arguments.http2Settings.streamWindowSize))
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--http2-connection-window") == 0 &&
+                 i + 1 < argc)
+        {
+            if (!ParseWindowSize(argv[++i],
+                                 arguments.http2Settings.connectionWindowSize))
+            {
+                return false;
+            }
+        }
+        else if (std::strcmp(argument, "--cache-dir") == 0 && i + 1 < argc)
+        {
+            arguments.downloadOptions.cacheDirectory = argv[++i];
+        }
+        else if (argument[0] == '-')
+        {
+            std::fprintf(stderr, "Error: unknown option: '%s'\n", argument);
+            return false;
+        }
+        else if (!configPathFound)
+        {
+            arguments.configPath = argument;
+            configPathFound = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return configPathFound;
 }
 
 int main(int argc, const char **argv)
 {
-    if (argc < 2)
+    Arguments arguments;
+    if (!ParseArguments(argc, argv, arguments))
     {
         PrintUsage();
         return EXIT_FAILURE;
     }
 
-    enum Args : uint32_t
-    {
-        EXECUTABLE_PATH,
-        CONFIG_PATH,
-    };
-
-    const std::filesystem::path configPath(argv[Args::CONFIG_PATH]);
+    const std::filesystem::path &configPath = arguments.configPath;
 
     if (!std::filesystem::exists(configPath))
     {
@@ -43,10 +451,32 @@ int main(int argc, const char **argv)
         return EXIT_FAILURE;
     }
 
-    const auto configReader = DispatchConfigType(configPath);
+    ConnectionPool::Get().SetLimits(arguments.maxConnectionsPerHost,
+                                    arguments.maxIdleConnectionsPerHost);
+    ConnectionPool::Get().SetPipelineDepth(arguments.pipelineDepth);
+    ConnectionPool::Get().SetHttp2Settings(arguments.http2Settings);
+    if (arguments.transport)
+    {
+        ConnectionPool::Get().SetTransport(std::move(arguments.transport));
+    }
+    BandwidthScheduler::Get().SetLimits(arguments.maxRate,
+                                        arguments.maxHostRate);
+
+    const auto configReader =
+        DispatchConfigType(configPath, arguments.downloadOptions);
     TaskMap taskMap = configReader->Read(configPath);
-    TaskRunner runner(taskMap);
-    runner.Run();
+
+    try
+    {
+        TaskRunner runner(taskMap, arguments.ioWorkerCount,
+                          arguments.cpuWorkerCount);
+        runner.Run();
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "Error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
 
     return EXIT_SUCCESS;
 }